@@ -9,12 +9,37 @@ bool (*BlogHandler::validate_session_func)(const string& session_id) = nullptr;
 string (*BlogHandler::get_username_func)(const string& session_id) = nullptr;
 string (*BlogHandler::get_role_func)(const string& session_id) = nullptr;
 
-BlogHandler::BlogHandler() : m_conn_pool(nullptr) {
+// 渲染期间是否有查询失败：失败的查询按没有数据渲染，这样的页面不放入缓存，也不替换旧页面
+static thread_local bool t_query_failed = false;
+
+static bool run_query(MYSQL* mysql, const char* sql) {
+    if (mysql && mysql_query(mysql, sql) == 0) {
+        return true;
+    }
+    t_query_failed = true;
+    return false;
+}
+
+static MYSQL_RES* store_result(MYSQL* mysql) {
+    MYSQL_RES* result = mysql_store_result(mysql);
+    if (!result) {
+        t_query_failed = true;
+    }
+    return result;
+}
+
+BlogHandler::BlogHandler() : m_conn_pool(nullptr), m_refresh_started(false), m_refresh_stop(false) {
     markdown_parser = new MarkdownParser();
     image_uploader = new ImageUploader();
+    register_routes();
 }
 
 BlogHandler::~BlogHandler() {
+    if (m_refresh_started) {
+        m_refresh_stop = true;
+        m_refresh_stat.post();
+        pthread_join(m_refresh_thread, NULL);
+    }
     delete markdown_parser;
     delete image_uploader;
 }
@@ -23,138 +48,470 @@ void BlogHandler::init(connection_pool* conn_pool) {
     m_conn_pool = conn_pool;
 }
 
-string BlogHandler::handle_request(const string& method, const string& url, const string& post_data, const string& client_ip, const string& cookie_header) {
-    if (!is_blog_route(url)) {
-        return "";
-    }
-    
-    // 处理方法覆盖（_method字段）
-    string actual_method = method;
-    if (method == "POST" && !post_data.empty()) {
-        map<string, string> form_data = parse_post_data(post_data);
-        if (!form_data["_method"].empty()) {
-            actual_method = form_data["_method"];
+void BlogHandler::set_page_cache(size_t max_bytes) {
+    m_pages.set_limits(max_bytes, page_cache::DEFAULT_MAX_AGE);
+}
+
+Response BlogHandler::handle_request(const Request& request, ResponseSink* sink) {
+    if (!is_blog_route(request.path)) {
+        return Response();
+    }
+    
+    // 处理方法覆盖（_method字段），只解析这一个字段
+    Request routed = request;
+    string override_method;
+    if (request.method == "POST" && !request.body.empty()) {
+        override_method = form_value(request.body, "_method");
+        if (!override_method.empty()) {
+            routed.method = override_method;
         }
     }
     
     
     try {
-        // 路由分发
-        if (url == "/blog/" || url == "/blog") {
-            return render_blog_index();
+        // 路由分发：path已不含查询串，参数指向path
+        int method = route_method_id(routed.method.str().c_str());
+        const Route* route = m_routes.match(method, routed.path.data(), routed.path.size(), routed.params);
+        if (route) {
+            return (this->*(*route))(routed, sink);
         }
-        else if (url.find("/blog/article/") == 0) {
-            string article_id_str = extract_route_param(url, "/blog/article/");
-            int article_id = atoi(article_id_str.c_str());
-            if (article_id > 0) {
-                return render_article_detail(article_id);
-            }
+        
+        return build_error_response(404, "Page not found");
+    }
+    catch (const exception& e) {
+        return build_error_response(500, "Internal server error");
+    }
+}
+
+void BlogHandler::register_routes() {
+    const int any = route_trie<Route>::ANY_METHOD;
+    const int get = route_method_id("GET");
+    const int post = route_method_id("POST");
+    
+    // 页面
+    m_routes.add(any, "/blog", &BlogHandler::route_index);
+    m_routes.add(any, "/blog/", &BlogHandler::route_index);
+    m_routes.add(any, "/blog/article/:id", &BlogHandler::route_article);
+    m_routes.add(any, "/blog/category/:id", &BlogHandler::route_category);
+    m_routes.add(any, "/blog/admin", &BlogHandler::route_admin_dashboard);
+    m_routes.add(any, "/blog/admin/", &BlogHandler::route_admin_dashboard);
+    m_routes.add(any, "/blog/admin/new", &BlogHandler::route_admin_new);
+    m_routes.add(any, "/blog/admin/edit/:id", &BlogHandler::route_admin_edit);
+    
+    // API路由
+    m_routes.add(get, "/blog/api/articles", &BlogHandler::route_api_list_articles);
+    m_routes.add(post, "/blog/api/articles", &BlogHandler::route_api_create_article);
+    m_routes.add(get, "/blog/api/articles/:id", &BlogHandler::route_api_get_article);
+    m_routes.add(route_method_id("PUT"), "/blog/api/articles/:id", &BlogHandler::route_api_update_article);
+    m_routes.add(route_method_id("DELETE"), "/blog/api/articles/:id", &BlogHandler::route_api_delete_article);
+    m_routes.add(post, "/blog/api/comments", &BlogHandler::route_api_add_comment);
+    m_routes.add(post, "/blog/api/like", &BlogHandler::route_api_toggle_like);
+    m_routes.add(post, "/blog/api/upload/image", &BlogHandler::route_api_upload_image);
+}
+
+Response BlogHandler::route_index(const Request& request, ResponseSink* sink) {
+    return cached_page(request, PAGE_INDEX, 0, 1, sink);
+}
+
+Response BlogHandler::route_article(const Request& request, ResponseSink* sink) {
+    int article_id = 0;
+    if (!request.params.get_int("id", article_id) || article_id <= 0) {
+        return build_error_response(404, "Page not found");
+    }
+    return cached_page(request, PAGE_ARTICLE, article_id, 1, sink);
+}
+
+Response BlogHandler::route_category(const Request& request, ResponseSink* sink) {
+    int category_id = 0;
+    if (!request.params.get_int("id", category_id) || category_id <= 0) {
+        return build_error_response(404, "Page not found");
+    }
+    // 解析page参数
+    int page = 1;
+    string page_param = parse_url_param(request.query, "page");
+    if (!page_param.empty()) {
+        page = max(1, atoi(page_param.c_str()));
+    }
+    return cached_page(request, PAGE_CATEGORY, category_id, page, sink);
+}
+
+// 记下渲染时写出的各段，next非空时同时转交给连接，渲染完成后与剩余部分拼成整页放入缓存
+class PageCapture : public ResponseSink {
+public:
+    explicit PageCapture(ResponseSink* next) : m_next(next) {}
+    void write(const string& data) {
+        m_page.append(data);
+        if (m_next) {
+            m_next->write(data);
         }
-        else if (url.find("/blog/category/") == 0) {
-            string category_id_str = extract_route_param(url, "/blog/category/");
-            int category_id = atoi(category_id_str.c_str());
-            if (category_id > 0) {
-                // 解析page参数
-                int page = 1;
-                string page_param = parse_url_param(url, "page");
-                if (!page_param.empty()) {
-                    page = max(1, atoi(page_param.c_str()));
-                }
-                return render_category_page(category_id, page);
-            }
+    }
+    string& page() { return m_page; }
+    
+private:
+    ResponseSink* m_next;
+    string m_page;
+};
+
+Response BlogHandler::render_page(PageKind kind, int id, int page, ResponseSink* sink) {
+    t_query_failed = false;
+    switch (kind) {
+    case PAGE_ARTICLE:
+        return render_article_detail(id, sink);
+    case PAGE_CATEGORY:
+        return render_category_page(id, page, sink);
+    default:
+        return render_blog_index(page, sink);
+    }
+}
+
+// 键由路由与参数组成；标签记下页面依赖的数据：首页与分类页都带有分类侧栏("categories")
+void BlogHandler::page_key(PageKind kind, int id, int page, string& key, vector<string>& tags) {
+    switch (kind) {
+    case PAGE_ARTICLE:
+        key = "article:" + to_string(id);
+        tags.push_back(key);
+        break;
+    case PAGE_CATEGORY:
+        key = "category:" + to_string(id) + ":" + to_string(page);
+        tags.push_back("category:" + to_string(id));
+        tags.push_back("categories");
+        break;
+    default:
+        key = "index:" + to_string(page);
+        tags.push_back("index");
+        tags.push_back("categories");
+        break;
+    }
+}
+
+// 页面的校验值取缓存代数与DEFAULT_MAX_AGE秒的时间段：文章、评论、分类的写操作都会使代数变化
+// 浏览、点赞计数不参与，最多在一个时间段后随页面刷新；内容编码不同的表示是等价的，用弱校验值
+string BlogHandler::page_etag() {
+    char etag[48];
+    snprintf(etag, sizeof(etag), "W/\"%llx-%lx\"", (unsigned long long)m_pages.generation(),
+             (long)(time(nullptr) / page_cache::DEFAULT_MAX_AGE));
+    return etag;
+}
+
+// If-None-Match按弱比较：列表中任一校验值(忽略W/前缀)与etag相同即命中
+static bool etag_matches(StrView list, const string& etag) {
+    StrView tag = StrView(etag).starts_with("W/") ? StrView(etag).substr(2) : StrView(etag);
+    size_t pos = 0;
+    while (pos < list.size()) {
+        while (pos < list.size() && (' ' == list[pos] || '\t' == list[pos] || ',' == list[pos])) {
+            ++pos;
         }
-        else if (url == "/blog/admin/" || url == "/blog/admin") {
-            // 检查管理员权限
-            if (!check_user_permission(cookie_header, "admin")) {
-                return build_error_response(403, "需要管理员权限访问");
-            }
-            return render_admin_dashboard();
+        if (pos < list.size() && '*' == list[pos]) {
+            return true;
         }
-        else if (url == "/blog/admin/new") {
-            // 检查管理员权限
-            if (!check_user_permission(cookie_header, "admin")) {
-                return build_error_response(403, "需要管理员权限访问");
-            }
-            return render_admin_editor();
+        if (list.substr(pos).starts_with("W/")) {
+            pos += 2;
         }
-        else if (url.find("/blog/admin/edit/") == 0) {
-            // 检查管理员权限
-            if (!check_user_permission(cookie_header, "admin")) {
-                return build_error_response(403, "需要管理员权限访问");
-            }
-            string article_id_str = extract_route_param(url, "/blog/admin/edit/");
-            int article_id = atoi(article_id_str.c_str());
-            if (article_id > 0) {
-                return render_admin_editor(article_id);
-            }
+        if (pos >= list.size() || '"' != list[pos]) {
+            break;
         }
-        // API路由
-        else if (url == "/blog/api/articles") {
-            printf("Debug: 处理 /blog/api/articles 路由，方法: %s\n", actual_method.c_str());
-            if (actual_method == "GET") {
-                return api_get_articles();
-            } else if (actual_method == "POST") {
-                // 创建文章需要管理员权限
-                printf("Debug: 检查用户权限，cookie: %s\n", cookie_header.c_str());
-                bool has_permission = check_user_permission(cookie_header, "admin");
-                printf("Debug: 权限检查结果: %s\n", has_permission ? "true" : "false");
-                if (!has_permission) {
-                    return build_json_response("{\"success\":false,\"message\":\"需要管理员权限\"}", 403);
-                }
-                printf("Debug: 开始调用 api_create_article\n");
-                return api_create_article(post_data);
-            }
+        size_t end = list.find('"', pos + 1);
+        if (StrView::npos == end) {
+            break;
         }
-        else if (url.find("/blog/api/articles/") == 0) {
-            string article_id_str = extract_route_param(url, "/blog/api/articles/");
-            int article_id = atoi(article_id_str.c_str());
-            if (article_id > 0) {
-                if (actual_method == "GET") {
-                    return api_get_article(article_id);
-                } else if (actual_method == "PUT") {
-                    // 更新文章需要管理员权限
-                    printf("Debug: 更新文章权限检查，cookie: %s\n", cookie_header.c_str());
-                    bool has_permission = check_user_permission(cookie_header, "admin");
-                    printf("Debug: 更新权限检查结果: %s\n", has_permission ? "true" : "false");
-                    if (!has_permission) {
-                        return build_json_response("{\"success\":false,\"message\":\"需要管理员权限\"}", 403);
-                    }
-                    return api_update_article(article_id, post_data);
-                } else if (actual_method == "DELETE") {
-                    // 删除文章需要管理员权限
-                    if (!check_user_permission(cookie_header, "admin")) {
-                        return build_json_response("{\"success\":false,\"message\":\"需要管理员权限\"}", 403);
-                    }
-                    return api_delete_article(article_id);
-                }
-            }
+        if (list.substr(pos, end + 1 - pos) == tag) {
+            return true;
         }
-        else if (url == "/blog/api/comments" && actual_method == "POST") {
-            return api_add_comment(post_data);
+        pos = end + 1;
+    }
+    return false;
+}
+
+// 整页借用缓存中的数据，不复制
+Response BlogHandler::cached_response(const page_cache::page_ptr& page) {
+    Response response = build_html_response("");
+    response.borrow(page->data(), page->size(), page);
+    return response;
+}
+
+Response BlogHandler::cached_page(const Request& request, PageKind kind, int id, int page, ResponseSink* sink) {
+    // 浏览先记在内存，渲染该文章时一并写入数据库
+    if (PAGE_ARTICLE == kind) {
+        note_view(id);
+    }
+    // 校验值在渲染前取得，客户端的页面仍有效时不渲染也不访问数据库
+    string etag = page_etag();
+    if (etag_matches(request.if_none_match, etag)) {
+        Response response = build_html_response("", 304);
+        response.cache_control = "no-cache";
+        response.etag = etag;
+        return response;
+    }
+    if (sink) {
+        sink->set_etag(etag);
+    }
+    Response response = page_response(kind, id, page, sink);
+    if (200 == response.status) {
+        response.etag = etag;
+    }
+    return response;
+}
+
+Response BlogHandler::page_response(PageKind kind, int id, int page, ResponseSink* sink) {
+    if (!m_pages.enabled()) {
+        return render_page(kind, id, page, sink);
+    }
+    
+    string key;
+    vector<string> tags;
+    page_key(kind, id, page, key, tags);
+    
+    // 命中(包括过期的页面)时不访问数据库；过期时由第一个取到它的请求安排后台刷新
+    bool lead = false;
+    page_cache::page_ptr cached = m_pages.acquire(key, lead);
+    if (cached) {
+        if (lead) {
+            schedule_refresh(kind, id, page);
         }
-        else if (url == "/blog/api/like" && actual_method == "POST") {
-            return api_toggle_like(post_data);
+        return cached_response(cached);
+    }
+    // 等待的渲染失败或超时，自行渲染，不放入缓存
+    if (!lead) {
+        return render_page(kind, id, page, sink);
+    }
+    
+    uint64_t generation = m_pages.generation();
+    PageCapture capture(sink);
+    Response rest;
+    try {
+        rest = render_page(kind, id, page, &capture);
+    }
+    catch (...) {
+        m_pages.finish(key, page_cache::page_ptr(), tags, generation);
+        throw;
+    }
+    string& html = capture.page();
+    
+    // 错误页(如文章不存在)与查询失败时渲染出的页面不缓存
+    if (200 != rest.status || t_query_failed) {
+        m_pages.finish(key, page_cache::page_ptr(), tags, generation);
+        if (!sink && !html.empty()) {
+            rest.body.insert(rest.body.begin(), BodySegment(move(html)));
         }
-        else if (url == "/blog/api/upload/image" && actual_method == "POST") {
-            // 图片上传需要管理员权限
-            if (!check_user_permission(cookie_header, "admin")) {
-                return build_json_response("{\"success\":false,\"message\":\"需要管理员权限\"}", 403);
-            }
-            return api_upload_image("multipart/form-data", post_data);
+        return rest;
+    }
+    for (size_t i = 0; i < rest.body.size(); ++i) {
+        html.append(rest.body[i].data(), rest.body[i].size());
+    }
+    cached = m_pages.finish(key, make_shared<const string>(move(html)), tags, generation);
+    // 流式输出时已写出的部分不再返回
+    if (sink) {
+        return rest;
+    }
+    return cached_response(cached);
+}
+
+void BlogHandler::schedule_refresh(PageKind kind, int id, int page) {
+    PageJob job = {kind, id, page};
+    m_refresh_lock.lock();
+    if (!m_refresh_started) {
+        m_refresh_started = pthread_create(&m_refresh_thread, NULL, refresh_worker, this) == 0;
+    }
+    if (!m_refresh_started) {
+        m_refresh_lock.unlock();
+        // 没有刷新线程时放弃这次刷新，旧页面继续使用
+        string key;
+        vector<string> tags;
+        page_key(kind, id, page, key, tags);
+        m_pages.finish(key, page_cache::page_ptr(), tags, 0);
+        return;
+    }
+    m_refresh_jobs.push_back(job);
+    m_refresh_lock.unlock();
+    m_refresh_stat.post();
+}
+
+void* BlogHandler::refresh_worker(void* arg) {
+    BlogHandler* handler = (BlogHandler*)arg;
+    while (true) {
+        handler->m_refresh_stat.wait();
+        if (handler->m_refresh_stop) {
+            break;
         }
-        
+        handler->m_refresh_lock.lock();
+        if (handler->m_refresh_jobs.empty()) {
+            handler->m_refresh_lock.unlock();
+            continue;
+        }
+        PageJob job = handler->m_refresh_jobs.front();
+        handler->m_refresh_jobs.pop_front();
+        handler->m_refresh_lock.unlock();
+        handler->refresh_page(job);
+    }
+    return NULL;
+}
+
+// 重新渲染过期的页面：成功时替换旧页面；数据库不可用时保留旧页面，稍后再试；页面已不存在(404)时删除
+void BlogHandler::refresh_page(const PageJob& job) {
+    string key;
+    vector<string> tags;
+    page_key(job.kind, job.id, job.page, key, tags);
+    uint64_t generation = m_pages.generation();
+    Response response;
+    try {
+        response = render_page(job.kind, job.id, job.page, nullptr);
+    }
+    catch (...) {
+        m_pages.finish(key, page_cache::page_ptr(), tags, generation);
+        return;
+    }
+    if (t_query_failed) {
+        m_pages.finish(key, page_cache::page_ptr(), tags, generation);
+        return;
+    }
+    if (200 != response.status) {
+        m_pages.remove(key);
+        m_pages.finish(key, page_cache::page_ptr(), tags, generation);
+        return;
+    }
+    m_pages.finish(key, make_shared<const string>(response.flatten()), tags, generation);
+}
+
+// 不存在的一侧(新建之前、删除之后)按未发布处理；分类计数与列表只包含已发布的文章
+void BlogHandler::invalidate_pages(int article_id, int old_category, bool old_published, int new_category, bool new_published) {
+    if (article_id > 0) {
+        m_pages.invalidate("article:" + to_string(article_id));
+    }
+    if (!old_published && !new_published) {
+        return;
+    }
+    m_pages.invalidate("index");
+    if (old_published != new_published || old_category != new_category) {
+        // 分类计数变化，所有带分类侧栏的页面都失效
+        m_pages.invalidate("categories");
+        return;
+    }
+    m_pages.invalidate("category:" + to_string(old_category));
+}
+
+void BlogHandler::note_view(int article_id, int count) {
+    m_views_lock.lock();
+    m_pending_views[article_id] += count;
+    m_views_lock.unlock();
+}
+
+int BlogHandler::take_pending_views(int article_id) {
+    int count = 0;
+    m_views_lock.lock();
+    map<int, int>::iterator it = m_pending_views.find(article_id);
+    if (it != m_pending_views.end()) {
+        count = it->second;
+        m_pending_views.erase(it);
+    }
+    m_views_lock.unlock();
+    return count;
+}
+
+// 管理页面只给登录的管理员看，不允许共享缓存保存
+static Response private_page(Response response) {
+    if (200 == response.status) {
+        response.cache_control = "private, no-cache";
+    }
+    return response;
+}
+
+Response BlogHandler::route_admin_dashboard(const Request& request, ResponseSink*) {
+    // 检查管理员权限
+    if (!check_user_permission(request.cookie, "admin")) {
+        return build_error_response(403, "需要管理员权限访问");
+    }
+    return private_page(render_admin_dashboard());
+}
+
+Response BlogHandler::route_admin_new(const Request& request, ResponseSink*) {
+    // 检查管理员权限
+    if (!check_user_permission(request.cookie, "admin")) {
+        return build_error_response(403, "需要管理员权限访问");
+    }
+    return private_page(render_admin_editor());
+}
+
+Response BlogHandler::route_admin_edit(const Request& request, ResponseSink*) {
+    // 检查管理员权限
+    if (!check_user_permission(request.cookie, "admin")) {
+        return build_error_response(403, "需要管理员权限访问");
+    }
+    int article_id = 0;
+    if (!request.params.get_int("id", article_id) || article_id <= 0) {
         return build_error_response(404, "Page not found");
     }
-    catch (const exception& e) {
-        return build_error_response(500, "Internal server error");
+    return private_page(render_admin_editor(article_id));
+}
+
+Response BlogHandler::route_api_list_articles(const Request&, ResponseSink*) {
+    return api_get_articles();
+}
+
+Response BlogHandler::route_api_create_article(const Request& request, ResponseSink*) {
+    // 创建文章需要管理员权限
+    printf("Debug: 检查用户权限，cookie: %.*s\n", (int)request.cookie.size(), request.cookie.data());
+    bool has_permission = check_user_permission(request.cookie, "admin");
+    printf("Debug: 权限检查结果: %s\n", has_permission ? "true" : "false");
+    if (!has_permission) {
+        return build_json_response("{\"success\":false,\"message\":\"需要管理员权限\"}", 403);
+    }
+    printf("Debug: 开始调用 api_create_article\n");
+    return api_create_article(request.body);
+}
+
+Response BlogHandler::route_api_get_article(const Request& request, ResponseSink*) {
+    int article_id = 0;
+    if (!request.params.get_int("id", article_id) || article_id <= 0) {
+        return build_error_response(404, "Page not found");
     }
+    return api_get_article(article_id);
 }
 
-string BlogHandler::render_blog_index(int page) {
-    vector<Article> articles = get_articles_list(page);
-    vector<Category> categories = get_categories();
-    
-    // 直接生成HTML，统一现代化风格
+Response BlogHandler::route_api_update_article(const Request& request, ResponseSink*) {
+    int article_id = 0;
+    if (!request.params.get_int("id", article_id) || article_id <= 0) {
+        return build_error_response(404, "Page not found");
+    }
+    // 更新文章需要管理员权限
+    printf("Debug: 更新文章权限检查，cookie: %.*s\n", (int)request.cookie.size(), request.cookie.data());
+    bool has_permission = check_user_permission(request.cookie, "admin");
+    printf("Debug: 更新权限检查结果: %s\n", has_permission ? "true" : "false");
+    if (!has_permission) {
+        return build_json_response("{\"success\":false,\"message\":\"需要管理员权限\"}", 403);
+    }
+    return api_update_article(article_id, request.body);
+}
+
+Response BlogHandler::route_api_delete_article(const Request& request, ResponseSink*) {
+    int article_id = 0;
+    if (!request.params.get_int("id", article_id) || article_id <= 0) {
+        return build_error_response(404, "Page not found");
+    }
+    // 删除文章需要管理员权限
+    if (!check_user_permission(request.cookie, "admin")) {
+        return build_json_response("{\"success\":false,\"message\":\"需要管理员权限\"}", 403);
+    }
+    return api_delete_article(article_id);
+}
+
+Response BlogHandler::route_api_add_comment(const Request& request, ResponseSink*) {
+    return api_add_comment(request.body);
+}
+
+Response BlogHandler::route_api_toggle_like(const Request& request, ResponseSink*) {
+    return api_toggle_like(request.body);
+}
+
+Response BlogHandler::route_api_upload_image(const Request& request, ResponseSink*) {
+    // 图片上传需要管理员权限
+    if (!check_user_permission(request.cookie, "admin")) {
+        return build_json_response("{\"success\":false,\"message\":\"需要管理员权限\"}", 403);
+    }
+    return api_upload_image("multipart/form-data", request.body);
+}
+
+Response BlogHandler::render_blog_index(int page, ResponseSink* sink) {
+    // 直接生成HTML，统一现代化风格；头部与样式不依赖数据库，先于查询写出
     stringstream html;
     html << "<!DOCTYPE html>\n";
     html << "<html lang=\"zh-CN\">\n";
@@ -212,7 +569,9 @@ string BlogHandler::render_blog_index(int page) {
     
     html << "<div class=\"main-content\">\n";
     html << "<div class=\"content\">\n";
+    flush_html(html, sink);
     
+    vector<Article> articles = get_articles_list(page);
     if (articles.empty()) {
         html << "<div class=\"no-content\">\n";
         html << "<h3>暂无文章</h3>\n";
@@ -240,7 +599,9 @@ string BlogHandler::render_blog_index(int page) {
     }
     
     html << "</div>\n"; // content
+    flush_html(html, sink);
     
+    vector<Category> categories = get_categories();
     html << "<aside class=\"sidebar\">\n";
     html << "<div class=\"widget\">\n";
     html << "<h3>文章分类</h3>\n";
@@ -266,17 +627,16 @@ string BlogHandler::render_blog_index(int page) {
     return build_html_response(html.str());
 }
 
-string BlogHandler::render_article_detail(int article_id) {
+Response BlogHandler::render_article_detail(int article_id, ResponseSink* sink) {
     Article article = get_article_by_id(article_id);
     if (article.article_id == 0) {
+        // 文章不存在时丢弃记下的浏览；查询失败时留到下次
+        if (!t_query_failed) {
+            take_pending_views(article_id);
+        }
         return build_error_response(404, "Article not found");
     }
     
-    // 增加浏览计数
-    increment_view_count(article_id);
-    
-    vector<Comment> comments = get_article_comments(article_id);
-    
     stringstream html;
     html << "<!DOCTYPE html>\n";
     html << "<html lang=\"zh-CN\">\n<head>\n";
@@ -324,6 +684,15 @@ string BlogHandler::render_article_detail(int article_id) {
     html << "评论: " << article.comment_count << "\n";
     html << "</div>\n";
     html << "<div class=\"article-content\">" << render_content(article.content, article.content_type) << "</div>\n";
+    flush_html(html, sink);
+    
+    // 写入记下的浏览计数(包括本次请求)，失败时放回
+    int views = take_pending_views(article_id);
+    if (views > 0 && !increment_view_count(article_id, views)) {
+        note_view(article_id, views);
+    }
+    
+    vector<Comment> comments = get_article_comments(article_id);
     
     // 评论区
     html << "<div class=\"comments\">\n";
@@ -429,7 +798,7 @@ string BlogHandler::render_article_detail(int article_id) {
     return build_html_response(html.str());
 }
 
-string BlogHandler::render_admin_dashboard() {
+Response BlogHandler::render_admin_dashboard() {
     vector<Article> articles = get_articles_list(1, 50, 0, ""); // 获取所有状态的文章
     
     // 统计数据
@@ -624,8 +993,8 @@ vector<Article> BlogHandler::get_articles_list(int page, int limit, int category
     query << "ORDER BY a.created_at DESC ";
     query << "LIMIT " << ((page - 1) * limit) << ", " << limit;
     
-    if (mysql_query(mysql, query.str().c_str()) == 0) {
-        MYSQL_RES* result = mysql_store_result(mysql);
+    if (run_query(mysql, query.str().c_str())) {
+        MYSQL_RES* result = store_result(mysql);
         if (result) {
             MYSQL_ROW row;
             while ((row = mysql_fetch_row(result))) {
@@ -665,8 +1034,8 @@ Article BlogHandler::get_article_by_id(int article_id) {
     query << "FROM articles a LEFT JOIN categories c ON a.category_id = c.category_id ";
     query << "WHERE a.article_id = " << article_id;
     
-    if (mysql_query(mysql, query.str().c_str()) == 0) {
-        MYSQL_RES* result = mysql_store_result(mysql);
+    if (run_query(mysql, query.str().c_str())) {
+        MYSQL_RES* result = store_result(mysql);
         if (result) {
             MYSQL_ROW row = mysql_fetch_row(result);
             if (row) {
@@ -704,8 +1073,8 @@ vector<Comment> BlogHandler::get_article_comments(int article_id) {
     query << "like_count, created_at FROM comments WHERE article_id = " << article_id;
     query << " ORDER BY created_at ASC";
     
-    if (mysql_query(mysql, query.str().c_str()) == 0) {
-        MYSQL_RES* result = mysql_store_result(mysql);
+    if (run_query(mysql, query.str().c_str())) {
+        MYSQL_RES* result = store_result(mysql);
         if (result) {
             MYSQL_ROW row;
             while ((row = mysql_fetch_row(result))) {
@@ -742,8 +1111,8 @@ vector<Category> BlogHandler::get_categories() {
     
     string query = "SELECT category_id, name, description, article_count FROM categories ORDER BY name";
     
-    if (mysql_query(mysql, query.c_str()) == 0) {
-        MYSQL_RES* result = mysql_store_result(mysql);
+    if (run_query(mysql, query.c_str())) {
+        MYSQL_RES* result = store_result(mysql);
         if (result) {
             MYSQL_ROW row;
             while ((row = mysql_fetch_row(result))) {
@@ -773,8 +1142,8 @@ Category BlogHandler::get_category_by_id(int category_id) {
     stringstream query;
     query << "SELECT category_id, name, description, article_count FROM categories WHERE category_id = " << category_id;
     
-    if (mysql_query(mysql, query.str().c_str()) == 0) {
-        MYSQL_RES* result = mysql_store_result(mysql);
+    if (run_query(mysql, query.str().c_str())) {
+        MYSQL_RES* result = store_result(mysql);
         if (result) {
             MYSQL_ROW row = mysql_fetch_row(result);
             if (row) {
@@ -799,8 +1168,8 @@ int BlogHandler::get_category_article_count(int category_id) {
     stringstream query;
     query << "SELECT COUNT(*) FROM articles WHERE category_id = " << category_id << " AND status = 'published'";
     
-    if (mysql_query(mysql, query.str().c_str()) == 0) {
-        MYSQL_RES* result = mysql_store_result(mysql);
+    if (run_query(mysql, query.str().c_str())) {
+        MYSQL_RES* result = store_result(mysql);
         if (result) {
             MYSQL_ROW row = mysql_fetch_row(result);
             if (row && row[0]) {
@@ -816,18 +1185,39 @@ int BlogHandler::get_category_article_count(int category_id) {
 }
 
 
-bool BlogHandler::increment_view_count(int article_id) {
+bool BlogHandler::increment_view_count(int article_id, int count) {
     if (!m_conn_pool) return false;
     
     MYSQL* mysql = nullptr;
     connectionRAII mysqlcon(&mysql, m_conn_pool);
     
     stringstream query;
-    query << "UPDATE articles SET view_count = view_count + 1 WHERE article_id = " << article_id;
+    query << "UPDATE articles SET view_count = view_count + " << count << " WHERE article_id = " << article_id;
     
     return mysql_query(mysql, query.str().c_str()) == 0;
 }
 
+// 文章修改前的分类与状态，用于确定哪些缓存页面失效；分类为空时category_id为0
+bool BlogHandler::get_article_state(MYSQL* mysql, int article_id, int& category_id, string& status) {
+    stringstream query;
+    query << "SELECT category_id, status FROM articles WHERE article_id = " << article_id;
+    if (mysql_query(mysql, query.str().c_str()) != 0) {
+        return false;
+    }
+    MYSQL_RES* result = mysql_store_result(mysql);
+    if (!result) {
+        return false;
+    }
+    MYSQL_ROW row = mysql_fetch_row(result);
+    bool found = row != nullptr;
+    if (found) {
+        category_id = row[0] ? atoi(row[0]) : 0;
+        status = row[1] ? row[1] : "";
+    }
+    mysql_free_result(result);
+    return found;
+}
+
 // 辅助方法实现
 string BlogHandler::html_escape(const string& str) {
     string result = str;
@@ -854,48 +1244,46 @@ string BlogHandler::html_escape(const string& str) {
     return result;
 }
 
-string BlogHandler::build_html_response(const string& html_content, int status_code) {
-    // 只返回HTML内容，HTTP头部由主服务器处理
-    return html_content;
+void BlogHandler::flush_html(stringstream& html, ResponseSink* sink) {
+    if (!sink) {
+        return;
+    }
+    sink->write(html.str());
+    html.str("");
+}
+
+// 正常页面每次都要用ETag重新验证，错误页不缓存
+Response BlogHandler::build_html_response(const string& html_content, int status_code) {
+    Response response(status_code, "text/html");
+    response.cache_control = 200 == status_code ? "no-cache" : "no-store";
+    response.append(html_content);
+    return response;
 }
 
-string BlogHandler::build_error_response(int status_code, const string& message) {
+// 错误页的固定首尾借用静态字符串，只有中间的状态码和消息是新生成的
+Response BlogHandler::build_error_response(int status_code, const string& message) {
     stringstream html;
-    html << "<!DOCTYPE html><html><head><meta charset=\"utf-8\"><title>错误</title></head>";
     html << "<body><h1>错误 " << status_code << "</h1><p>" << html_escape(message) << "</p>";
-    html << "<a href=\"/welcome.html\">返回首页</a></body></html>";
-    return build_html_response(html.str(), status_code);
-}
-
-bool BlogHandler::is_blog_route(const string& url) {
-    return url.find("/blog") == 0;
+    Response response = build_html_response("", status_code);
+    response.borrow("<!DOCTYPE html><html><head><meta charset=\"utf-8\"><title>错误</title></head>");
+    response.append(html.str());
+    response.borrow("<a href=\"/welcome.html\">返回首页</a></body></html>");
+    return response;
 }
 
-string BlogHandler::extract_route_param(const string& url, const string& pattern) {
-    if (url.find(pattern) == 0) {
-        string param = url.substr(pattern.length());
-        size_t pos = param.find('/');
-        if (pos != string::npos) {
-            param = param.substr(0, pos);
-        }
-        return param;
-    }
-    return "";
+bool BlogHandler::is_blog_route(StrView path) {
+    return path.starts_with("/blog");
 }
 
 // 占位符实现，用于编译通过
-string BlogHandler::render_category_page(int category_id, int page) {
-    // 获取分类信息
+Response BlogHandler::render_category_page(int category_id, int page, ResponseSink* sink) {
+    // 获取分类信息，分类不存在时在任何输出之前返回404
     Category category = get_category_by_id(category_id);
     if (category.category_id == 0) {
         return build_error_response(404, "分类不存在");
     }
     
-    // 获取该分类下的文章
-    vector<Article> articles = get_articles_list(page, 10, category_id, "published");
-    vector<Category> all_categories = get_categories();
-    
-    // 计算分页信息
+    // 计算分页信息，头部显示文章总数
     int total_articles = get_category_article_count(category_id);
     int total_pages = (total_articles + 9) / 10; // 每页10篇文章
     
@@ -947,8 +1335,10 @@ string BlogHandler::render_category_page(int category_id, int page) {
     
     html << "<div class=\"main-content\">\n";
     html << "<div class=\"content\">\n";
+    flush_html(html, sink);
     
     // 文章列表
+    vector<Article> articles = get_articles_list(page, 10, category_id, "published");
     if (articles.empty()) {
         html << "<div class=\"no-content\">\n";
         html << "<h3>暂无文章</h3>\n";
@@ -1005,8 +1395,10 @@ string BlogHandler::render_category_page(int category_id, int page) {
     }
     
     html << "</div>\n"; // content
+    flush_html(html, sink);
     
     // 侧边栏
+    vector<Category> all_categories = get_categories();
     html << "<aside class=\"sidebar\">\n";
     html << "<div class=\"category-sidebar\">\n";
     html << "<h3 class=\"sidebar-title\">所有分类</h3>\n";
@@ -1035,7 +1427,7 @@ string BlogHandler::render_category_page(int category_id, int page) {
     
     return build_html_response(html.str());
 }
-string BlogHandler::render_admin_editor(int article_id) {
+Response BlogHandler::render_admin_editor(int article_id) {
     Article article;
     bool is_edit = false;
     
@@ -1702,11 +2094,11 @@ string BlogHandler::render_admin_editor(int article_id) {
     
     return build_html_response(html.str());
 }
-string BlogHandler::api_get_articles(int page, int category_id) { return ""; }
-string BlogHandler::api_get_article(int article_id) { return ""; }
-string BlogHandler::api_create_article(const string& post_data) {
+Response BlogHandler::api_get_articles(int, int) { return Response(); }
+Response BlogHandler::api_get_article(int) { return Response(); }
+Response BlogHandler::api_create_article(StrView post_data) {
     printf("Debug: api_create_article called\n");
-    printf("Debug: post_data length: %zu\n", post_data.length());
+    printf("Debug: post_data length: %zu\n", post_data.size());
     
     if (!m_conn_pool) {
         printf("Debug: 数据库连接池为空\n");
@@ -1827,14 +2219,15 @@ string BlogHandler::api_create_article(const string& post_data) {
         update_query << "UPDATE articles SET published_at = NOW() WHERE article_id = " << article_id;
         mysql_query(mysql, update_query.str().c_str());
     }
+    invalidate_pages(0, 0, false, category_id, status == "published");
     
     stringstream response;
     response << "{\"success\":true,\"message\":\"文章创建成功\",\"article_id\":" << article_id << "}";
     return build_json_response(response.str());
 }
-string BlogHandler::api_update_article(int article_id, const string& post_data) {
+Response BlogHandler::api_update_article(int article_id, StrView post_data) {
     printf("Debug: api_update_article called, article_id: %d\n", article_id);
-    printf("Debug: post_data: %s\n", post_data.c_str());
+    printf("Debug: post_data: %.*s\n", (int)post_data.size(), post_data.data());
     
     if (!m_conn_pool) {
         printf("Debug: 数据库连接池为空\n");
@@ -1854,6 +2247,11 @@ string BlogHandler::api_update_article(int article_id, const string& post_data)
     MYSQL* mysql = nullptr;
     connectionRAII mysqlcon(&mysql, m_conn_pool);
     
+    // 修改前的分类与状态决定哪些缓存页面失效，查不到时按已发布且分类未知处理
+    int old_category = -1;
+    string old_status = "published";
+    get_article_state(mysql, article_id, old_category, old_status);
+    
     // 暂时使用简单SQL
     stringstream query;
     query << "UPDATE articles SET ";
@@ -1886,6 +2284,8 @@ string BlogHandler::api_update_article(int article_id, const string& post_data)
         
         if (affected_rows > 0) {
             printf("Debug: 文章更新成功\n");
+            int new_category = form_data["category_id"].empty() ? 0 : atoi(form_data["category_id"].c_str());
+            invalidate_pages(article_id, old_category, old_status == "published", new_category, status == "published");
             return build_json_response("{\"success\":true,\"message\":\"文章更新成功\"}");
         } else {
             printf("Debug: 没有找到要更新的文章\n");
@@ -1896,7 +2296,7 @@ string BlogHandler::api_update_article(int article_id, const string& post_data)
         return build_json_response("{\"success\":false,\"message\":\"数据库操作失败\"}", 500);
     }
 }
-string BlogHandler::api_delete_article(int article_id) {
+Response BlogHandler::api_delete_article(int article_id) {
     if (!m_conn_pool) {
         return build_json_response("{\"success\":false,\"message\":\"数据库连接失败\"}", 500);
     }
@@ -1904,6 +2304,10 @@ string BlogHandler::api_delete_article(int article_id) {
     MYSQL* mysql = nullptr;
     connectionRAII mysqlcon(&mysql, m_conn_pool);
     
+    int old_category = -1;
+    string old_status = "published";
+    get_article_state(mysql, article_id, old_category, old_status);
+    
     // 删除文章（级联删除评论和点赞记录）
     stringstream query;
     query << "DELETE FROM articles WHERE article_id = " << article_id;
@@ -1913,6 +2317,7 @@ string BlogHandler::api_delete_article(int article_id) {
         int affected_rows = mysql_affected_rows(mysql);
         
         if (affected_rows > 0) {
+            invalidate_pages(article_id, old_category, old_status == "published", 0, false);
             return build_json_response("{\"success\":true,\"message\":\"文章删除成功\"}");
         } else {
             return build_json_response("{\"success\":false,\"message\":\"文章不存在\"}", 404);
@@ -1922,7 +2327,7 @@ string BlogHandler::api_delete_article(int article_id) {
         return build_json_response("{\"success\":false,\"message\":\"数据库操作失败\"}", 500);
     }
 }
-string BlogHandler::api_add_comment(const string& post_data) {
+Response BlogHandler::api_add_comment(StrView post_data) {
     if (!m_conn_pool) {
         return build_json_response("{\"success\":false,\"message\":\"数据库连接失败\"}", 500);
     }
@@ -1938,20 +2343,23 @@ string BlogHandler::api_add_comment(const string& post_data) {
     MYSQL* mysql = nullptr;
     connectionRAII mysqlcon(&mysql, m_conn_pool);
     
-    // 验证文章是否存在
+    // 验证文章是否存在，同时取得分类与状态用于缓存失效
     int article_id = atoi(form_data["article_id"].c_str());
     stringstream check_query;
-    check_query << "SELECT article_id FROM articles WHERE article_id = " << article_id;
+    check_query << "SELECT category_id, status FROM articles WHERE article_id = " << article_id;
     
     if (mysql_query(mysql, check_query.str().c_str()) != 0) {
         return build_json_response("{\"success\":false,\"message\":\"数据库查询失败\"}", 500);
     }
     
     MYSQL_RES* result = mysql_store_result(mysql);
-    if (!result || mysql_num_rows(result) == 0) {
+    MYSQL_ROW row = result ? mysql_fetch_row(result) : nullptr;
+    if (!row) {
         if (result) mysql_free_result(result);
         return build_json_response("{\"success\":false,\"message\":\"文章不存在\"}", 404);
     }
+    int category_id = row[0] ? atoi(row[0]) : 0;
+    bool published = row[1] && strcmp(row[1], "published") == 0;
     mysql_free_result(result);
     
     // 插入评论
@@ -1966,6 +2374,8 @@ string BlogHandler::api_add_comment(const string& post_data) {
     
     if (mysql_query(mysql, query.str().c_str()) == 0) {
         int comment_id = mysql_insert_id(mysql);
+        // 评论数显示在文章页以及首页、分类页的列表中
+        invalidate_pages(article_id, category_id, published, category_id, published);
         stringstream response;
         response << "{\"success\":true,\"message\":\"评论发布成功\",\"comment_id\":" << comment_id << "}";
         return build_json_response(response.str());
@@ -1974,37 +2384,31 @@ string BlogHandler::api_add_comment(const string& post_data) {
         return build_json_response("{\"success\":false,\"message\":\"评论发布失败\"}", 500);
     }
 }
-string BlogHandler::api_toggle_like(const string& post_data) { return ""; }
+Response BlogHandler::api_toggle_like(StrView) { return Response(); }
 vector<Tag> BlogHandler::get_tags() { return vector<Tag>(); }
-string BlogHandler::parse_url_param(const string& url, const string& param) {
-    size_t question_pos = url.find('?');
-    if (question_pos == string::npos) {
-        return "";
-    }
-    
-    string query_string = url.substr(question_pos + 1);
+string BlogHandler::parse_url_param(StrView query, const string& param) {
     string search_param = param + "=";
     
-    size_t param_pos = query_string.find(search_param);
-    if (param_pos == string::npos) {
+    size_t param_pos = query.find(search_param);
+    if (param_pos == StrView::npos) {
         return "";
     }
     
     size_t value_start = param_pos + search_param.length();
-    size_t value_end = query_string.find('&', value_start);
+    size_t value_end = query.find('&', value_start);
     
-    if (value_end == string::npos) {
-        return query_string.substr(value_start);
+    if (value_end == StrView::npos) {
+        return query.substr(value_start).str();
     } else {
-        return query_string.substr(value_start, value_end - value_start);
+        return query.substr(value_start, value_end - value_start).str();
     }
 }
-string BlogHandler::url_decode(const string& str) {
+string BlogHandler::url_decode(StrView str) {
     string result;
-    result.reserve(str.length());
+    result.reserve(str.size());
     
-    for (size_t i = 0; i < str.length(); ++i) {
-        if (str[i] == '%' && i + 2 < str.length()) {
+    for (size_t i = 0; i < str.size(); ++i) {
+        if (str[i] == '%' && i + 2 < str.size()) {
             // 解码十六进制
             char hex[3] = {str[i+1], str[i+2], '\0'};
             char* endptr;
@@ -2025,44 +2429,48 @@ string BlogHandler::url_decode(const string& str) {
     return result;
 }
 string BlogHandler::json_escape(const string& str) { return str; }
-map<string, string> BlogHandler::parse_post_data(const string& data) {
+map<string, string> BlogHandler::parse_post_data(StrView data) {
     map<string, string> result;
     
-    if (data.empty()) {
-        return result;
-    }
-    
-    // 分割参数 key1=value1&key2=value2
+    // 分割参数 key1=value1&key2=value2，各段只是视图，解码时才分配
     size_t start = 0;
-    size_t end = 0;
-    
-    while ((end = data.find('&', start)) != string::npos) {
-        string pair = data.substr(start, end - start);
+    while (start < data.size()) {
+        size_t end = data.find('&', start);
+        if (end == StrView::npos) {
+            end = data.size();
+        }
+        StrView pair = data.substr(start, end - start);
         size_t equal_pos = pair.find('=');
-        if (equal_pos != string::npos) {
-            string key = url_decode(pair.substr(0, equal_pos));
-            string value = url_decode(pair.substr(equal_pos + 1));
-            result[key] = value;
+        if (equal_pos != StrView::npos) {
+            result[url_decode(pair.substr(0, equal_pos))] = url_decode(pair.substr(equal_pos + 1));
         }
         start = end + 1;
     }
     
-    // 处理最后一个参数
-    if (start < data.length()) {
-        string pair = data.substr(start);
+    return result;
+}
+
+string BlogHandler::form_value(StrView data, StrView key) {
+    size_t start = 0;
+    while (start < data.size()) {
+        size_t end = data.find('&', start);
+        if (end == StrView::npos) {
+            end = data.size();
+        }
+        StrView pair = data.substr(start, end - start);
         size_t equal_pos = pair.find('=');
-        if (equal_pos != string::npos) {
-            string key = url_decode(pair.substr(0, equal_pos));
-            string value = url_decode(pair.substr(equal_pos + 1));
-            result[key] = value;
+        if (equal_pos != StrView::npos && pair.substr(0, equal_pos) == key) {
+            return url_decode(pair.substr(equal_pos + 1));
         }
+        start = end + 1;
     }
-    
-    return result;
+    return "";
 }
-string BlogHandler::build_json_response(const string& json_data, int status_code) {
-    string result = json_data;
-    return result;
+Response BlogHandler::build_json_response(const string& json_data, int status_code) {
+    Response response(status_code, "application/json");
+    response.cache_control = "no-store";
+    response.append(json_data);
+    return response;
 }
 string BlogHandler::generate_session_id() { return ""; }
 
@@ -2076,48 +2484,48 @@ void BlogHandler::set_session_functions(bool (*validate_func)(const string&),
     get_role_func = role_func;
 }
 
-string BlogHandler::extract_session_id(const string& cookie_header) {
+string BlogHandler::extract_session_id(StrView cookie_header) {
     if (cookie_header.empty()) return "";
     
     // 查找 session_id=xxx 格式
     size_t pos = cookie_header.find("session_id=");
-    if (pos == string::npos) return "";
+    if (pos == StrView::npos) return "";
     
     pos += 11; // strlen("session_id=")
-    size_t end_pos = cookie_header.find(";", pos);
-    if (end_pos == string::npos) {
-        end_pos = cookie_header.length();
+    size_t end_pos = cookie_header.find(';', pos);
+    if (end_pos == StrView::npos) {
+        end_pos = cookie_header.size();
     }
     
-    return cookie_header.substr(pos, end_pos - pos);
+    return cookie_header.substr(pos, end_pos - pos).str();
 }
 
-bool BlogHandler::is_logged_in(const string& cookie_header) {
+bool BlogHandler::is_logged_in(StrView cookie_header) {
     if (!validate_session_func) return false;
     
     string session_id = extract_session_id(cookie_header);
     return validate_session_func(session_id);
 }
 
-string BlogHandler::get_current_user(const string& cookie_header) {
+string BlogHandler::get_current_user(StrView cookie_header) {
     if (!get_username_func) return "";
     
     string session_id = extract_session_id(cookie_header);
     return get_username_func(session_id);
 }
 
-string BlogHandler::get_user_role(const string& cookie_header) {
+string BlogHandler::get_user_role(StrView cookie_header) {
     if (!get_role_func) return "guest";
     
     string session_id = extract_session_id(cookie_header);
     return get_role_func(session_id);
 }
 
-bool BlogHandler::is_admin_user(const string& cookie_header) {
+bool BlogHandler::is_admin_user(StrView cookie_header) {
     return get_user_role(cookie_header) == "admin";
 }
 
-bool BlogHandler::check_user_permission(const string& cookie_header, const string& required_role) {
+bool BlogHandler::check_user_permission(StrView cookie_header, const string& required_role) {
     if (required_role == "guest") {
         return true; // guest权限不需要登录
     }
@@ -2136,8 +2544,9 @@ bool BlogHandler::check_user_permission(const string& cookie_header, const strin
 }
 
 // Markdown和图片处理方法
-string BlogHandler::api_upload_image(const string& content_type, const string& post_data) {
-    UploadResult result = image_uploader->uploadImage(content_type, post_data);
+Response BlogHandler::api_upload_image(const string& content_type, StrView post_data) {
+    // 上传内容要按multipart切分并写入文件，在这里才复制成string
+    UploadResult result = image_uploader->uploadImage(content_type, post_data.str());
     
     stringstream json;
     json << "{"
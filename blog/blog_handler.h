@@ -4,11 +4,17 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <sstream>
+#include <list>
+#include <pthread.h>
 #include <mysql/mysql.h>
 #include "../CGImysql/sql_connection_pool.h"
 #include "../log/log.h"
 #include "markdown_parser.h"
 #include "image_uploader.h"
+#include "request.h"
+#include "response.h"
+#include "../cache/page_cache.h"
 
 using namespace std;
 
@@ -55,6 +61,15 @@ struct Tag {
     int article_count;
 };
 
+// 流式输出：页面分段渲染，每段完成后立即交给连接发送
+class ResponseSink {
+public:
+    virtual ~ResponseSink() {}
+    virtual void write(const string& data) = 0;
+    // 渲染前已知的校验值，在流式响应的响应头中发出
+    virtual void set_etag(const string&) {}
+};
+
 class BlogHandler {
 public:
     BlogHandler();
@@ -62,40 +77,44 @@ public:
     
     // 初始化数据库连接
     void init(connection_pool* conn_pool);
+    // 页面缓存总量(字节)，0为不缓存
+    void set_page_cache(size_t max_bytes);
     
     // 路由处理方法
-    string handle_request(const string& method, const string& url, const string& post_data, const string& client_ip, const string& cookie_header = "");
+    // 返回状态码、头部与分段的响应体，由http_conn序列化
+    // sink非空时支持流式输出的页面边渲染边写出，返回的响应体为尚未写出的剩余部分
+    Response handle_request(const Request& request, ResponseSink* sink = nullptr);
     
     // 页面渲染方法
-    string render_blog_index(int page = 1);
-    string render_article_detail(int article_id);
-    string render_category_page(int category_id, int page = 1);
-    string render_admin_dashboard();
-    string render_admin_editor(int article_id = 0);
+    Response render_blog_index(int page = 1, ResponseSink* sink = nullptr);
+    Response render_article_detail(int article_id, ResponseSink* sink = nullptr);
+    Response render_category_page(int category_id, int page = 1, ResponseSink* sink = nullptr);
+    Response render_admin_dashboard();
+    Response render_admin_editor(int article_id = 0);
     
     // API接口方法
-    string api_get_articles(int page = 1, int category_id = 0);
-    string api_get_article(int article_id);
-    string api_create_article(const string& post_data);
-    string api_update_article(int article_id, const string& post_data);
-    string api_delete_article(int article_id);
-    string api_add_comment(const string& post_data);
-    string api_toggle_like(const string& post_data);
+    Response api_get_articles(int page = 1, int category_id = 0);
+    Response api_get_article(int article_id);
+    Response api_create_article(StrView post_data);
+    Response api_update_article(int article_id, StrView post_data);
+    Response api_delete_article(int article_id);
+    Response api_add_comment(StrView post_data);
+    Response api_toggle_like(StrView post_data);
     
     // Markdown和图片处理
-    string api_upload_image(const string& content_type, const string& post_data);
+    Response api_upload_image(const string& content_type, StrView post_data);
     string render_content(const string& content, const string& content_type);
     
     
     // 用户权限验证  
-    bool check_user_permission(const string& cookie_header, const string& required_role = "guest");
-    string get_current_user(const string& cookie_header);
-    string get_user_role(const string& cookie_header);
-    bool is_admin_user(const string& cookie_header);
-    bool is_logged_in(const string& cookie_header);
+    bool check_user_permission(StrView cookie_header, const string& required_role = "guest");
+    string get_current_user(StrView cookie_header);
+    string get_user_role(StrView cookie_header);
+    bool is_admin_user(StrView cookie_header);
+    bool is_logged_in(StrView cookie_header);
     
     // 辅助函数
-    string extract_session_id(const string& cookie_header);
+    string extract_session_id(StrView cookie_header);
     
     // Session验证函数指针 (由http_conn设置)
     static bool (*validate_session_func)(const string& session_id);
@@ -120,23 +139,81 @@ private:
     Category get_category_by_id(int category_id);
     int get_category_article_count(int category_id);
     vector<Tag> get_tags();
-    bool increment_view_count(int article_id);
+    bool increment_view_count(int article_id, int count = 1);
+    bool get_article_state(MYSQL* mysql, int article_id, int& category_id, string& status);
     
     // 辅助方法
-    string parse_url_param(const string& url, const string& param);
-    string url_decode(const string& str);
+    string parse_url_param(StrView query, const string& param);
+    string url_decode(StrView str);
     string html_escape(const string& str);
     string json_escape(const string& str);
-    map<string, string> parse_post_data(const string& data);
-    
-    // 响应构建方法
-    string build_json_response(const string& json_data, int status_code = 200);
-    string build_html_response(const string& html_content, int status_code = 200);
-    string build_error_response(int status_code, const string& message);
-    
-    // 路由解析
-    bool is_blog_route(const string& url);
-    string extract_route_param(const string& url, const string& pattern);
+    map<string, string> parse_post_data(StrView data);
+    // 只取表单中的一个字段，不为其余字段分配内存
+    string form_value(StrView data, StrView key);
+    
+    // 把已渲染的部分交给sink并清空
+    void flush_html(stringstream& html, ResponseSink* sink);
+    
+    // 响应构建方法：HTML为text/html，JSON为application/json，状态码写入Response
+    Response build_json_response(const string& json_data, int status_code = 200);
+    Response build_html_response(const string& html_content, int status_code = 200);
+    Response build_error_response(int status_code, const string& message);
+    
+    // 路由：构造时注册到基数树，路径参数不合法时各路由自行返回404
+    typedef Response (BlogHandler::*Route)(const Request& request, ResponseSink* sink);
+    route_trie<Route> m_routes;
+    void register_routes();
+    bool is_blog_route(StrView path);
+    Response route_index(const Request& request, ResponseSink* sink);
+    Response route_article(const Request& request, ResponseSink* sink);
+    Response route_category(const Request& request, ResponseSink* sink);
+    Response route_admin_dashboard(const Request& request, ResponseSink* sink);
+    Response route_admin_new(const Request& request, ResponseSink* sink);
+    Response route_admin_edit(const Request& request, ResponseSink* sink);
+    Response route_api_list_articles(const Request& request, ResponseSink* sink);
+    Response route_api_create_article(const Request& request, ResponseSink* sink);
+    Response route_api_get_article(const Request& request, ResponseSink* sink);
+    Response route_api_update_article(const Request& request, ResponseSink* sink);
+    Response route_api_delete_article(const Request& request, ResponseSink* sink);
+    Response route_api_add_comment(const Request& request, ResponseSink* sink);
+    Response route_api_toggle_like(const Request& request, ResponseSink* sink);
+    Response route_api_upload_image(const Request& request, ResponseSink* sink);
+    
+    // 页面缓存：首页、文章页、分类页按路由与参数缓存整页，命中时不访问数据库
+    // 同一页面同时只有一个线程渲染；过期的页面照常返回，由后台线程刷新，数据库不可用时继续返回旧页面
+    enum PageKind { PAGE_INDEX, PAGE_ARTICLE, PAGE_CATEGORY };
+    page_cache m_pages;
+    // 条件GET先按渲染前的校验值回答304，其余由page_response从缓存取得或渲染
+    Response cached_page(const Request& request, PageKind kind, int id, int page, ResponseSink* sink);
+    Response page_response(PageKind kind, int id, int page, ResponseSink* sink);
+    string page_etag();
+    Response render_page(PageKind kind, int id, int page, ResponseSink* sink);
+    static void page_key(PageKind kind, int id, int page, string& key, vector<string>& tags);
+    Response cached_response(const page_cache::page_ptr& page);
+    
+    // 后台刷新过期页面的任务队列，第一次需要刷新时启动线程
+    struct PageJob {
+        PageKind kind;
+        int id;
+        int page;
+    };
+    list<PageJob> m_refresh_jobs;
+    locker m_refresh_lock;
+    sem m_refresh_stat;
+    pthread_t m_refresh_thread;
+    bool m_refresh_started;
+    volatile bool m_refresh_stop;
+    void schedule_refresh(PageKind kind, int id, int page);
+    static void* refresh_worker(void* arg);
+    void refresh_page(const PageJob& job);
+    // 文章从旧的分类与发布状态变为新的之后，按依赖使缓存页面失效
+    void invalidate_pages(int article_id, int old_category, bool old_published, int new_category, bool new_published);
+    
+    // 缓存命中时浏览计数先记在内存，下次渲染该文章时一并写入数据库
+    map<int, int> m_pending_views;
+    locker m_views_lock;
+    void note_view(int article_id, int count = 1);
+    int take_pending_views(int article_id);
     
     // Session管理（简单实现）
     map<string, string> admin_sessions;
@@ -0,0 +1,72 @@
+#ifndef BLOG_REQUEST_H
+#define BLOG_REQUEST_H
+
+#include <string.h>
+#include <string>
+#include "../router/route_trie.h"
+
+using namespace std;
+
+// 只读字符串视图(C++11没有std::string_view)：不持有内存，指向的数据在使用期间必须有效
+class StrView {
+public:
+    static const size_t npos = (size_t)-1;
+
+    StrView() : m_data(""), m_size(0) {}
+    StrView(const char* s) : m_data(s ? s : ""), m_size(s ? strlen(s) : 0) {}
+    StrView(const char* s, size_t n) : m_data(s), m_size(n) {}
+    StrView(const string& s) : m_data(s.data()), m_size(s.size()) {}
+
+    const char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    bool empty() const { return 0 == m_size; }
+    char operator[](size_t i) const { return m_data[i]; }
+    string str() const { return string(m_data, m_size); }
+
+    size_t find(char c, size_t pos = 0) const {
+        if (pos >= m_size) return npos;
+        const void* p = memchr(m_data + pos, c, m_size - pos);
+        return p ? (const char*)p - m_data : npos;
+    }
+
+    size_t find(StrView s, size_t pos = 0) const {
+        if (pos > m_size) return npos;
+        const void* p = memmem(m_data + pos, m_size - pos, s.m_data, s.m_size);
+        return p ? (const char*)p - m_data : npos;
+    }
+
+    StrView substr(size_t pos, size_t n = npos) const {
+        if (pos > m_size) pos = m_size;
+        if (n > m_size - pos) n = m_size - pos;
+        return StrView(m_data + pos, n);
+    }
+
+    bool starts_with(StrView s) const {
+        return m_size >= s.m_size && memcmp(m_data, s.m_data, s.m_size) == 0;
+    }
+
+    bool operator==(StrView s) const {
+        return m_size == s.m_size && memcmp(m_data, s.m_data, m_size) == 0;
+    }
+    bool operator!=(StrView s) const { return !(*this == s); }
+
+private:
+    const char* m_data;
+    size_t m_size;
+};
+
+// 一次请求的只读视图：各字段指向连接的读缓冲区，由http_conn填写，只在处理该请求期间有效
+// 交给博客模块时不再为方法、路径、Cookie、请求体等逐个分配string
+struct Request {
+    StrView method;
+    StrView path;         // 不含查询串
+    StrView query;        // '?'之后的部分
+    StrView host;
+    StrView cookie;
+    StrView body;
+    StrView client_ip;
+    StrView if_none_match;  // 条件GET的If-None-Match，其余请求为空
+    route_params params;  // 路由匹配得到的路径参数，指向path
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef BLOG_RESPONSE_H
+#define BLOG_RESPONSE_H
+
+#include <string.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// 响应体的一段：自有的数据保存在段内；借用的数据只记指针和长度，
+// hold持有数据所在的对象(如缓存的页面片段)直到响应发送完毕，借用静态数据时hold为空
+class BodySegment {
+public:
+    explicit BodySegment(string data) : m_owned(move(data)), m_data(nullptr), m_size(0) {}
+    BodySegment(const char* data, size_t size, shared_ptr<const string> hold)
+        : m_hold(move(hold)), m_data(data), m_size(size) {}
+
+    // 自有数据随vector移动时地址会变，每次从m_owned取
+    const char* data() const { return m_data ? m_data : m_owned.data(); }
+    size_t size() const { return m_data ? m_size : m_owned.size(); }
+
+private:
+    string m_owned;
+    shared_ptr<const string> m_hold;
+    const char* m_data;
+    size_t m_size;
+};
+
+// 博客处理器的响应：状态码、Content-Type、Cache-Control、ETag与分段的响应体
+// 由http_conn拼出响应头，各段作为writev的iovec直接发送，不再拼成一个string
+struct Response {
+    int status;
+    const char* content_type;   // 静态字符串
+    const char* cache_control;  // 为空时不发送Cache-Control
+    string etag;                // 处理器在渲染前给出的校验值，为空时由http_conn按响应体生成
+    vector<BodySegment> body;
+
+    explicit Response(int status = 200, const char* content_type = "text/html")
+        : status(status), content_type(content_type), cache_control(nullptr) {}
+
+    Response& append(string data) {
+        if (!data.empty())
+            body.push_back(BodySegment(move(data)));
+        return *this;
+    }
+    // 借用的数据在响应发送完之前必须有效：静态数据不需要hold，其余由hold保活
+    Response& borrow(const char* data, size_t size, shared_ptr<const string> hold = shared_ptr<const string>()) {
+        if (size > 0)
+            body.push_back(BodySegment(data, size, move(hold)));
+        return *this;
+    }
+    Response& borrow(const char* literal) { return borrow(literal, strlen(literal)); }
+
+    size_t body_size() const {
+        size_t size = 0;
+        for (size_t i = 0; i < body.size(); ++i)
+            size += body[i].size();
+        return size;
+    }
+    bool empty() const { return body.empty(); }
+
+    // 压缩或转交HTTP/2会话时需要连续的响应体
+    string flatten() const {
+        string out;
+        out.reserve(body_size());
+        for (size_t i = 0; i < body.size(); ++i)
+            out.append(body[i].data(), body[i].size());
+        return out;
+    }
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "buffer_pool.h"
+
+#include <stdlib.h>
+
+const size_t buffer_pool::CLASS_SIZE[buffer_pool::CLASS_NUM] = {256, 1024, 4096, 16384};
+
+buffer_pool *buffer_pool::get_instance()
+{
+    static buffer_pool instance;
+    return &instance;
+}
+
+buffer_pool::~buffer_pool()
+{
+    for (int i = 0; i < CLASS_NUM; ++i)
+    {
+        for (size_t j = 0; j < m_free[i].size(); ++j)
+            free(m_free[i][j]);
+    }
+}
+
+//线程退出时把本地缓存整体交回全局链表
+buffer_pool::local_cache::~local_cache()
+{
+    buffer_pool *pool = buffer_pool::get_instance();
+    for (int i = 0; i < CLASS_NUM; ++i)
+        pool->flush(i, free[i], 0);
+}
+
+buffer_pool::local_cache &buffer_pool::local()
+{
+    static thread_local local_cache cache;
+    return cache;
+}
+
+int buffer_pool::size_class(size_t size)
+{
+    for (int i = 0; i < CLASS_NUM; ++i)
+    {
+        if (size <= CLASS_SIZE[i])
+            return i;
+    }
+    return -1;
+}
+
+char *buffer_pool::acquire(size_t size)
+{
+    int cls = size_class(size);
+    if (cls < 0)
+        return NULL;
+
+    vector<char *> &cache = local().free[cls];
+    if (cache.empty())
+        refill(cls, cache);
+    if (cache.empty())
+        return (char *)malloc(CLASS_SIZE[cls]);
+
+    char *buf = cache.back();
+    cache.pop_back();
+    return buf;
+}
+
+void buffer_pool::release(char *buf, size_t size)
+{
+    if (!buf)
+        return;
+    int cls = size_class(size);
+    if (cls < 0)
+    {
+        free(buf);
+        return;
+    }
+
+    vector<char *> &cache = local().free[cls];
+    cache.push_back(buf);
+    if (cache.size() >= LOCAL_CACHE)
+        flush(cls, cache, LOCAL_CACHE / 2);
+}
+
+//从全局链表批量取回半个本地缓存的块
+void buffer_pool::refill(int cls, vector<char *> &cache)
+{
+    m_lock[cls].lock();
+    size_t n = m_free[cls].size() < LOCAL_CACHE / 2 ? m_free[cls].size() : LOCAL_CACHE / 2;
+    cache.insert(cache.end(), m_free[cls].end() - n, m_free[cls].end());
+    m_free[cls].resize(m_free[cls].size() - n);
+    m_lock[cls].unlock();
+}
+
+//本地缓存只保留keep块，其余交回全局链表，全局链表已满时直接释放
+void buffer_pool::flush(int cls, vector<char *> &cache, size_t keep)
+{
+    m_lock[cls].lock();
+    while (cache.size() > keep)
+    {
+        char *buf = cache.back();
+        cache.pop_back();
+        if (m_free[cls].size() < GLOBAL_IDLE)
+            m_free[cls].push_back(buf);
+        else
+            free(buf);
+    }
+    m_lock[cls].unlock();
+}
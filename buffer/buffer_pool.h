@@ -0,0 +1,48 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+#include <vector>
+
+#include "../lock/locker.h"
+
+using namespace std;
+
+//按大小分级的缓冲区池：连接只在处理请求期间持有读写缓冲区，空闲后归还
+//每个线程先在本地缓存中取还，本地缓存满或空时才与全局空闲链表批量交换
+class buffer_pool
+{
+public:
+    static const int CLASS_NUM = 4;
+    static const size_t CLASS_SIZE[CLASS_NUM];
+    static const size_t LOCAL_CACHE = 64;    //每线程每级最多缓存的块数
+    static const size_t GLOBAL_IDLE = 4096;  //全局每级最多保留的空闲块，超出部分还给系统
+
+    static buffer_pool *get_instance();
+
+    //取得至少size字节的缓冲区，内容未初始化；size超过最大级时返回NULL
+    char *acquire(size_t size);
+    //size须与acquire时一致
+    void release(char *buf, size_t size);
+
+    static int size_class(size_t size);
+
+private:
+    struct local_cache
+    {
+        vector<char *> free[CLASS_NUM];
+        ~local_cache();
+    };
+
+    buffer_pool() {}
+    ~buffer_pool();
+    local_cache &local();
+    void refill(int cls, vector<char *> &cache);
+    void flush(int cls, vector<char *> &cache, size_t keep);
+
+private:
+    locker m_lock[CLASS_NUM];
+    vector<char *> m_free[CLASS_NUM];
+};
+
+#endif
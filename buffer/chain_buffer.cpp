@@ -0,0 +1,84 @@
+#include "chain_buffer.h"
+
+#include <string.h>
+
+char *chain_buffer::prepare(size_t &space)
+{
+    size_t used = m_size % SEGMENT_SIZE;
+    if (m_size == m_segs.size() * SEGMENT_SIZE)
+    {
+        char *seg = buffer_pool::get_instance()->acquire(SEGMENT_SIZE);
+        if (!seg)
+            return NULL;
+        m_segs.push_back(seg);
+    }
+    space = SEGMENT_SIZE - used;
+    return m_segs.back() + used;
+}
+
+void chain_buffer::commit(size_t len)
+{
+    m_size += len;
+}
+
+bool chain_buffer::append(const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        size_t space;
+        char *dst = prepare(space);
+        if (!dst)
+            return false;
+        size_t n = len < space ? len : space;
+        memcpy(dst, data, n);
+        commit(n);
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+const char *chain_buffer::segment(int i, size_t &len) const
+{
+    size_t begin = (size_t)i * SEGMENT_SIZE;
+    len = m_size - begin < SEGMENT_SIZE ? m_size - begin : SEGMENT_SIZE;
+    return m_segs[i];
+}
+
+size_t chain_buffer::read(size_t offset, char *dst, size_t len) const
+{
+    size_t total = 0;
+    while (len > 0 && offset < m_size)
+    {
+        size_t seg_len;
+        const char *seg = segment((int)(offset / SEGMENT_SIZE), seg_len);
+        size_t pos = offset % SEGMENT_SIZE;
+        size_t n = seg_len - pos < len ? seg_len - pos : len;
+        memcpy(dst, seg + pos, n);
+        dst += n;
+        offset += n;
+        len -= n;
+        total += n;
+    }
+    return total;
+}
+
+void chain_buffer::append_to(string &out) const
+{
+    out.reserve(out.size() + m_size);
+    for (int i = 0; i < segment_count(); ++i)
+    {
+        size_t len;
+        const char *seg = segment(i, len);
+        out.append(seg, len);
+    }
+}
+
+void chain_buffer::clear()
+{
+    buffer_pool *pool = buffer_pool::get_instance();
+    for (size_t i = 0; i < m_segs.size(); ++i)
+        pool->release(m_segs[i], SEGMENT_SIZE);
+    m_segs.clear();
+    m_size = 0;
+}
@@ -0,0 +1,48 @@
+#ifndef CHAIN_BUFFER_H
+#define CHAIN_BUFFER_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "buffer_pool.h"
+
+using namespace std;
+
+//由buffer_pool中16KB段串成的可增长缓冲区，只追加，整体清空
+//数据可以按段遍历，也可以按偏移读取或拼接成一个string
+class chain_buffer
+{
+public:
+    static const size_t SEGMENT_SIZE = 16384;
+
+    chain_buffer() : m_size(0) {}
+    ~chain_buffer() { clear(); }
+
+    size_t size() const { return m_size; }
+    bool empty() const { return 0 == m_size; }
+
+    //返回尾部可写的连续空间，尾段写满时新挂一段；写入后用commit确认，取段失败返回NULL
+    char *prepare(size_t &space);
+    void commit(size_t len);
+    bool append(const char *data, size_t len);
+
+    int segment_count() const { return (int)m_segs.size(); }
+    const char *segment(int i, size_t &len) const;
+    //从offset处读取至多len字节，返回实际读取的字节数
+    size_t read(size_t offset, char *dst, size_t len) const;
+    void append_to(string &out) const;
+
+    //所有段归还给buffer_pool
+    void clear();
+
+private:
+    chain_buffer(const chain_buffer &);
+    chain_buffer &operator=(const chain_buffer &);
+
+private:
+    vector<char *> m_segs;
+    size_t m_size;
+};
+
+#endif
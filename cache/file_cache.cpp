@@ -0,0 +1,414 @@
+#include "file_cache.h"
+#include "../compress/gzip_encoder.h"
+
+#include <algorithm>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+
+file_entry::~file_entry()
+{
+    if (address)
+        munmap(address, st.st_size);
+    if (fd >= 0)
+        close(fd);
+    if (gzip && 0 == --gzip->refs)
+        delete gzip;
+}
+
+//条目及其gzip变体占用的映射字节数
+static size_t mapped_size(const file_entry *entry)
+{
+    size_t size = entry->address ? entry->st.st_size : 0;
+    if (entry->gzip && entry->gzip->address)
+        size += entry->gzip->st.st_size;
+    return size;
+}
+
+struct mime_entry
+{
+    const char *ext;
+    const char *type;
+};
+static const mime_entry mime_types[] = {
+    {".html", "text/html"},
+    {".pdf", "application/pdf"},
+    {".jpg", "image/jpeg"},
+    {".jpeg", "image/jpeg"},
+    {".png", "image/png"},
+    {".gif", "image/gif"},
+    {".css", "text/css; charset=utf-8"},
+    {".js", "application/javascript; charset=utf-8"},
+    {".mp4", "video/mp4"},
+};
+
+const char *file_cache::content_type(const char *path)
+{
+    const char *ext = strrchr(path, '.');
+    if (ext)
+    {
+        for (size_t i = 0; i < sizeof(mime_types) / sizeof(mime_types[0]); ++i)
+        {
+            if (strcmp(ext, mime_types[i].ext) == 0)
+                return mime_types[i].type;
+        }
+    }
+    return "text/html";
+}
+
+file_cache *file_cache::get_instance()
+{
+    static file_cache instance;
+    return &instance;
+}
+
+file_cache::~file_cache()
+{
+    if (m_sidecar_started)
+    {
+        m_sidecar_stop = true;
+        m_sidecar_stat.post();
+        pthread_join(m_sidecar_thread, NULL);
+    }
+    clear();
+    if (m_inotify_fd >= 0)
+        close(m_inotify_fd);
+}
+
+static const uint32_t WATCH_MASK = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+                                   IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+
+int file_cache::init(const char *root)
+{
+    m_root = root;
+    while (m_root.size() > 1 && m_root[m_root.size() - 1] == '/')
+        m_root.erase(m_root.size() - 1);
+
+    m_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotify_fd < 0)
+        return -1;
+    add_watch(m_root);
+    return m_inotify_fd;
+}
+
+//inotify不递归，逐个目录添加监视
+void file_cache::add_watch(const string &dir)
+{
+    int wd = inotify_add_watch(m_inotify_fd, dir.c_str(), WATCH_MASK | IN_ONLYDIR);
+    if (wd < 0)
+        return;
+    m_watches[wd] = dir;
+
+    DIR *dp = opendir(dir.c_str());
+    if (!dp)
+        return;
+    struct dirent *ent;
+    while ((ent = readdir(dp)) != NULL)
+    {
+        if (ent->d_name[0] == '.')
+            continue;
+        string sub = dir + "/" + ent->d_name;
+        struct stat st;
+        if (stat(sub.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+            add_watch(sub);
+    }
+    closedir(dp);
+}
+
+void file_cache::enable_precompress()
+{
+    m_precompress = true;
+    precompress(m_root);
+}
+
+void file_cache::precompress(const string &dir)
+{
+    DIR *dp = opendir(dir.c_str());
+    if (!dp)
+        return;
+    struct dirent *ent;
+    while ((ent = readdir(dp)) != NULL)
+    {
+        if (ent->d_name[0] == '.')
+            continue;
+        string sub = dir + "/" + ent->d_name;
+        struct stat st;
+        if (stat(sub.c_str(), &st) < 0)
+            continue;
+        if (S_ISDIR(st.st_mode))
+            precompress(sub);
+        else if (gzip_compressible(sub.c_str()))
+            gzip_sidecar(sub.c_str());
+    }
+    closedir(dp);
+}
+
+void file_cache::process_events()
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (true)
+    {
+        ssize_t len = read(m_inotify_fd, buf, sizeof(buf));
+        if (len <= 0)
+            break;
+
+        for (char *p = buf; p < buf + len;)
+        {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + ev->len;
+
+            //事件丢失或目录本身被删除、移走时无法确定影响范围，整体清空
+            if (ev->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+            {
+                if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+                    m_watches.erase(ev->wd);
+                clear();
+                continue;
+            }
+
+            map<int, string>::iterator it = m_watches.find(ev->wd);
+            if (it == m_watches.end() || 0 == ev->len)
+                continue;
+            string path = it->second + "/" + ev->name;
+            if ((ev->mask & IN_ISDIR) && (ev->mask & (IN_CREATE | IN_MOVED_TO)))
+                add_watch(path);
+            else if (ev->mask & IN_ISDIR)
+                clear();
+            else
+            {
+                invalidate(path);
+                //.gz副本变化时，持有它的源文件条目也要失效
+                if (path.size() > 3 && path.compare(path.size() - 3, 3, ".gz") == 0)
+                    invalidate(path.substr(0, path.size() - 3));
+                //源文件写入完成后在后台重新生成副本，副本rename产生的事件再使上面的条目失效
+                if (m_precompress && (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) && gzip_compressible(path.c_str()))
+                    schedule_sidecar(path);
+            }
+        }
+    }
+}
+
+void file_cache::schedule_sidecar(const string &path)
+{
+    m_sidecar_lock.lock();
+    if (!m_sidecar_started)
+        m_sidecar_started = pthread_create(&m_sidecar_thread, NULL, sidecar_worker, this) == 0;
+    //已在排队的文件不重复加入；没有后台线程时放弃重新生成，源文件条目不会使用时间不符的旧副本
+    if (!m_sidecar_started || find(m_sidecar_jobs.begin(), m_sidecar_jobs.end(), path) != m_sidecar_jobs.end())
+    {
+        m_sidecar_lock.unlock();
+        return;
+    }
+    m_sidecar_jobs.push_back(path);
+    m_sidecar_lock.unlock();
+    m_sidecar_stat.post();
+}
+
+//源文件在同一时钟粒度内多次写入时修改时间可能不变，写入事件触发的重新生成总是覆盖已有副本
+void *file_cache::sidecar_worker(void *arg)
+{
+    file_cache *cache = (file_cache *)arg;
+    while (true)
+    {
+        cache->m_sidecar_stat.wait();
+        if (cache->m_sidecar_stop)
+            break;
+        cache->m_sidecar_lock.lock();
+        if (cache->m_sidecar_jobs.empty())
+        {
+            cache->m_sidecar_lock.unlock();
+            continue;
+        }
+        string path = cache->m_sidecar_jobs.front();
+        cache->m_sidecar_jobs.pop_front();
+        cache->m_sidecar_lock.unlock();
+        gzip_sidecar(path.c_str(), true);
+    }
+    return NULL;
+}
+
+//stat并打开path，小文件映射后关闭fd，不生成响应头
+file_entry *file_cache::open_entry(const char *path, int &err)
+{
+    file_entry *entry = new file_entry;
+    entry->path = path;
+    if (stat(path, &entry->st) < 0)
+        err = ENOENT;
+    else if (!(entry->st.st_mode & S_IROTH))
+        err = EACCES;
+    else if (S_ISDIR(entry->st.st_mode))
+        err = EISDIR;
+    else if ((entry->fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+        err = errno;
+    else
+        err = 0;
+    if (err)
+    {
+        delete entry;
+        return NULL;
+    }
+
+    if (entry->st.st_size > 0 && entry->st.st_size <= MMAP_LIMIT)
+    {
+        void *addr = mmap(0, entry->st.st_size, PROT_READ, MAP_PRIVATE, entry->fd, 0);
+        if (addr != MAP_FAILED)
+        {
+            entry->address = (char *)addr;
+            close(entry->fd);
+            entry->fd = -1;
+        }
+    }
+    return entry;
+}
+
+//origin为源文件的stat，gzip变体的Last-Modified与源文件一致，ETag加上-gz与源文件区分
+void file_cache::build_headers(file_entry *entry, const struct stat &origin, const char *type, bool vary, bool gzip)
+{
+    entry->type_line = string("Content-Type:") + type + "\r\n";
+    entry->mtime = origin.st_mtime;
+    char date[64];
+    struct tm tm;
+    gmtime_r(&origin.st_mtime, &tm);
+    strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    entry->last_modified = date;
+    char etag[80];
+    snprintf(etag, sizeof(etag), "\"%lx-%lx-%lx%s\"", (unsigned long)origin.st_ino, (unsigned long)origin.st_mtime,
+             (unsigned long)origin.st_size, gzip ? "-gz" : "");
+    entry->etag = etag;
+    entry->validators = "ETag:" + entry->etag + "\r\nLast-Modified:" + entry->last_modified + "\r\n";
+    if (vary)
+        entry->validators.append("Vary:Accept-Encoding\r\n");
+    entry->meta_lines = entry->validators + "Accept-Ranges:bytes\r\n";
+    if (gzip)
+        entry->meta_lines.append("Content-Encoding:gzip\r\n");
+    char length[48];
+    snprintf(length, sizeof(length), "Content-Length:%ld\r\n", (long)entry->st.st_size);
+    entry->headers = entry->type_line + entry->meta_lines + length;
+}
+
+file_entry *file_cache::load(const char *path, int &err)
+{
+    file_entry *entry = open_entry(path, err);
+    if (!entry)
+        return NULL;
+    if (!gzip_compressible(path))
+    {
+        build_headers(entry, entry->st, content_type(path), false, false);
+        return entry;
+    }
+
+    //可压缩的文件无论是否已有.gz副本都带Vary，避免中间缓存把某一种编码交给所有客户端
+    const char *type = content_type(path);
+    build_headers(entry, entry->st, type, true, false);
+    string gz = string(path) + ".gz";
+    int gz_err;
+    file_entry *variant = open_entry(gz.c_str(), gz_err);
+    if (variant && gzip_sidecar_fresh(variant->st, entry->st) && variant->st.st_size < entry->st.st_size)
+    {
+        build_headers(variant, entry->st, type, true, true);
+        entry->gzip = variant;
+    }
+    else
+    {
+        delete variant;
+    }
+    return entry;
+}
+
+int file_cache::acquire(const char *path, file_entry *&entry)
+{
+    string key(path);
+    m_lock.lock();
+    unordered_map<string, file_entry *>::iterator it = m_entries.find(key);
+    if (it != m_entries.end())
+    {
+        entry = it->second;
+        entry->refs++;
+        m_lru.splice(m_lru.begin(), m_lru, entry->lru);
+        m_lock.unlock();
+        return 0;
+    }
+    m_lock.unlock();
+
+    int err;
+    entry = load(path, err);
+    if (!entry)
+        return err;
+
+    //未启用inotify时无法得知文件变化，不缓存
+    //只缓存根目录下的规范路径，含"/."或"//"的路径可能与其他键指向同一文件而漏掉失效
+    if (m_inotify_fd < 0 || key.compare(0, m_root.size(), m_root) != 0)
+        return 0;
+    const char *rel = path + m_root.size();
+    if (*rel != '/' || strstr(rel, "/.") || strstr(rel, "//"))
+        return 0;
+
+    size_t mapped = mapped_size(entry);
+    m_lock.lock();
+    if (m_entries.count(key))
+    {
+        //其他线程已同时加载，本条目只供本次使用
+        m_lock.unlock();
+        return 0;
+    }
+    while (!m_lru.empty() && (m_entries.size() >= MAX_ENTRIES || m_mapped_bytes + mapped > MAX_MAPPED_BYTES))
+        unlink_entry(m_lru.back());
+    if (m_mapped_bytes + mapped <= MAX_MAPPED_BYTES)
+    {
+        entry->refs++;
+        m_lru.push_front(entry);
+        entry->lru = m_lru.begin();
+        m_entries[key] = entry;
+        m_mapped_bytes += mapped;
+    }
+    m_lock.unlock();
+    return 0;
+}
+
+//从缓存表中移除并释放缓存持有的引用，调用者需持有m_lock
+void file_cache::unlink_entry(file_entry *entry)
+{
+    m_entries.erase(entry->path);
+    m_lru.erase(entry->lru);
+    m_mapped_bytes -= mapped_size(entry);
+    release(entry);
+}
+
+void file_cache::release(file_entry *entry)
+{
+    if (entry && 0 == --entry->refs)
+        delete entry;
+}
+
+file_entry *file_cache::use_gzip(file_entry *entry)
+{
+    file_entry *variant = entry->gzip;
+    if (!variant)
+        return entry;
+    variant->refs++;
+    release(entry);
+    return variant;
+}
+
+void file_cache::invalidate(const string &path)
+{
+    m_lock.lock();
+    unordered_map<string, file_entry *>::iterator it = m_entries.find(path);
+    if (it != m_entries.end())
+        unlink_entry(it->second);
+    m_lock.unlock();
+}
+
+void file_cache::clear()
+{
+    m_lock.lock();
+    while (!m_lru.empty())
+        unlink_entry(m_lru.back());
+    m_lock.unlock();
+}
@@ -0,0 +1,102 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <sys/stat.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <atomic>
+#include <list>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+#include "../lock/locker.h"
+
+using namespace std;
+
+//缓存中的一个静态文件，由引用计数管理生命周期：缓存本身持有一个引用，每个正在发送它的连接各持有一个
+struct file_entry
+{
+    string path;
+    struct stat st;
+    int fd;                //未映射的大文件保留fd，小文件映射后即关闭
+    char *address;         //小文件的只读映射，空文件或大文件为NULL
+    string type_line;      //"Content-Type:...\r\n"
+    time_t mtime;          //源文件的修改时间，gzip变体与源文件相同
+    string last_modified;  //HTTP日期格式的修改时间
+    string etag;           //由inode、修改时间和大小生成的强校验值，gzip变体另加-gz
+    string validators;     //"ETag:...\r\nLast-Modified:...\r\n"，可压缩文件及其变体另有Vary，304响应只发送这些
+    string meta_lines;     //validators + "Accept-Ranges:bytes\r\n"，gzip变体另有Content-Encoding
+    string headers;        //完整响应的type_line + meta_lines + "Content-Length:...\r\n"
+    file_entry *gzip;      //与本文件修改时间相同的path.gz变体，由本条目持有其一个引用
+    atomic<int> refs;
+    list<file_entry *>::iterator lru;
+
+    file_entry() : fd(-1), address(NULL), mtime(0), gzip(NULL), refs(1) {}
+    ~file_entry();
+};
+
+//按路径缓存静态文件的fd/映射、stat、MIME类型和响应头，避免每个请求重复stat + open + mmap + munmap
+//条目数与映射字节数都有上限，按LRU淘汰；文件变化通过inotify监视网站根目录使对应条目失效
+class file_cache
+{
+public:
+    static const size_t MAX_ENTRIES = 1024;
+    static const size_t MAX_MAPPED_BYTES = 64 * 1024 * 1024;
+    static const off_t MMAP_LIMIT = 1024 * 1024;  //超过该大小的文件只缓存fd，由连接按需映射
+
+    static file_cache *get_instance();
+
+    //监视root及其子目录，返回inotify fd，失败返回-1，此时只做逐次打开不缓存
+    int init(const char *root);
+    int get_fd() const { return m_inotify_fd; }
+    //读取inotify事件并使变化的文件失效，由主循环在fd可读时调用
+    void process_events();
+
+    //取得path对应的文件并增加引用，成功返回0，否则返回ENOENT、EACCES、EISDIR等错误码
+    int acquire(const char *path, file_entry *&entry);
+    void release(file_entry *entry);
+    void invalidate(const string &path);
+    void clear();
+
+    //为根目录下的文本资源生成.gz副本，之后文件写入完成时由后台线程重新生成
+    void enable_precompress();
+    //把entry换成其gzip变体：增加变体的引用并释放entry，没有变体时原样返回
+    file_entry *use_gzip(file_entry *entry);
+
+    //根据扩展名得到Content-Type的值
+    static const char *content_type(const char *path);
+
+private:
+    file_cache() : m_inotify_fd(-1), m_mapped_bytes(0), m_precompress(false), m_sidecar_started(false), m_sidecar_stop(false) {}
+    ~file_cache();
+    file_entry *load(const char *path, int &err);
+    file_entry *open_entry(const char *path, int &err);
+    void build_headers(file_entry *entry, const struct stat &origin, const char *type, bool vary, bool gzip);
+    void add_watch(const string &dir);
+    void precompress(const string &dir);
+    void unlink_entry(file_entry *entry);
+    //压缩大文件耗时，不在主循环中进行：交给后台线程，第一次需要时启动
+    void schedule_sidecar(const string &path);
+    static void *sidecar_worker(void *arg);
+
+private:
+    locker m_lock;
+    unordered_map<string, file_entry *> m_entries;
+    list<file_entry *> m_lru;  //表头为最近使用
+    int m_inotify_fd;
+    string m_root;
+    map<int, string> m_watches;  //watch描述符到目录的映射
+    size_t m_mapped_bytes;
+    bool m_precompress;
+
+    //待重新生成.gz副本的源文件，同一文件只排队一次
+    list<string> m_sidecar_jobs;
+    locker m_sidecar_lock;
+    sem m_sidecar_stat;
+    pthread_t m_sidecar_thread;
+    bool m_sidecar_started;
+    volatile bool m_sidecar_stop;
+};
+
+#endif
@@ -0,0 +1,222 @@
+#include "page_cache.h"
+
+page_cache::page_cache(size_t max_bytes, int max_age)
+    : m_bytes(0), m_max_bytes(max_bytes), m_max_age(max_age), m_generation(0)
+{
+}
+
+void page_cache::set_limits(size_t max_bytes, int max_age)
+{
+    m_lock.lock();
+    m_max_bytes = max_bytes;
+    m_max_age = max_age;
+    while (m_bytes > m_max_bytes && !m_lru.empty())
+        unlink(--m_lru.end());
+    m_lock.unlock();
+}
+
+page_cache::page_ptr page_cache::get(const string &key)
+{
+    page_ptr page;
+    m_lock.lock();
+    unordered_map<string, entry_iter>::iterator found = m_entries.find(key);
+    //过期的条目留给acquire作为旧页面提供
+    if (found != m_entries.end() && time(NULL) - found->second->created < m_max_age)
+    {
+        m_lru.splice(m_lru.begin(), m_lru, found->second);
+        page = found->second->page;
+    }
+    m_lock.unlock();
+    return page;
+}
+
+page_cache::page_ptr page_cache::acquire(const string &key, bool &lead)
+{
+    lead = false;
+    page_ptr page;
+    m_lock.lock();
+    unordered_map<string, entry_iter>::iterator found = m_entries.find(key);
+    if (found != m_entries.end())
+    {
+        entry_iter it = found->second;
+        m_lru.splice(m_lru.begin(), m_lru, it);
+        page = it->page;
+        //过期的页面照常返回，同一时间只有一个调用者负责刷新
+        time_t now = time(NULL);
+        if (now - it->created >= m_max_age && now >= it->retry_at && 0 == m_flights.count(key))
+        {
+            m_flights[key] = make_shared<flight>();
+            lead = true;
+        }
+        m_lock.unlock();
+        return page;
+    }
+
+    unordered_map<string, shared_ptr<flight> >::iterator running = m_flights.find(key);
+    if (running == m_flights.end())
+    {
+        m_flights[key] = make_shared<flight>();
+        lead = true;
+        m_lock.unlock();
+        return page;
+    }
+
+    //等待进行中的渲染；所有flight共用一个条件变量，被唤醒后检查自己等待的那个是否完成
+    shared_ptr<flight> waiting = running->second;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += WAIT_TIMEOUT;
+    while (!waiting->done)
+    {
+        if (!m_done.timewait(m_lock.get(), deadline))
+            break;
+    }
+    page = waiting->page;
+    m_lock.unlock();
+    return page;
+}
+
+page_cache::page_ptr page_cache::finish(const string &key, page_ptr page, const vector<string> &tags, uint64_t generation)
+{
+    m_lock.lock();
+    bool stored = false;
+    if (page)
+    {
+        stored = store(key, page, tags, generation);
+    }
+    else
+    {
+        unordered_map<string, entry_iter>::iterator found = m_entries.find(key);
+        if (found != m_entries.end())
+            found->second->retry_at = time(NULL) + RETRY_DELAY;
+    }
+
+    unordered_map<string, shared_ptr<flight> >::iterator running = m_flights.find(key);
+    if (running != m_flights.end())
+    {
+        //没有保存的页面(失败或期间发生过失效)不交给等待者，它们自行渲染
+        running->second->done = true;
+        if (stored)
+            running->second->page = page;
+        m_flights.erase(running);
+        m_done.broadcast();
+    }
+    m_lock.unlock();
+    return page;
+}
+
+uint64_t page_cache::generation()
+{
+    m_lock.lock();
+    uint64_t generation = m_generation;
+    m_lock.unlock();
+    return generation;
+}
+
+page_cache::page_ptr page_cache::put(const string &key, string page, const vector<string> &tags, uint64_t generation)
+{
+    page_ptr shared = make_shared<const string>(move(page));
+    m_lock.lock();
+    store(key, shared, tags, generation);
+    m_lock.unlock();
+    return shared;
+}
+
+//保存页面，替换同一键上的旧条目，调用者需持有m_lock
+bool page_cache::store(const string &key, const page_ptr &page, const vector<string> &tags, uint64_t generation)
+{
+    //单个页面不超过总量的1/8，避免一个大页面挤掉其余条目
+    if (generation != m_generation || page->size() > m_max_bytes / 8)
+        return false;
+
+    unordered_map<string, entry_iter>::iterator found = m_entries.find(key);
+    if (found != m_entries.end())
+        unlink(found->second);
+    while (m_bytes + page->size() > m_max_bytes && !m_lru.empty())
+        unlink(--m_lru.end());
+
+    entry e;
+    e.key = key;
+    e.page = page;
+    e.tags = tags;
+    e.created = time(NULL);
+    e.retry_at = 0;
+    m_lru.push_front(e);
+    m_entries[key] = m_lru.begin();
+    for (size_t i = 0; i < tags.size(); ++i)
+        m_tags[tags[i]].insert(key);
+    m_bytes += page->size();
+    return true;
+}
+
+void page_cache::invalidate(const string &tag)
+{
+    m_lock.lock();
+    ++m_generation;
+    unordered_map<string, unordered_set<string> >::iterator found = m_tags.find(tag);
+    if (found != m_tags.end())
+    {
+        //unlink会修改m_tags，先取出键
+        vector<string> keys(found->second.begin(), found->second.end());
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            unordered_map<string, entry_iter>::iterator it = m_entries.find(keys[i]);
+            if (it != m_entries.end())
+                unlink(it->second);
+        }
+    }
+    m_lock.unlock();
+}
+
+void page_cache::remove(const string &key)
+{
+    m_lock.lock();
+    unordered_map<string, entry_iter>::iterator found = m_entries.find(key);
+    if (found != m_entries.end())
+        unlink(found->second);
+    m_lock.unlock();
+}
+
+void page_cache::clear()
+{
+    m_lock.lock();
+    ++m_generation;
+    m_lru.clear();
+    m_entries.clear();
+    m_tags.clear();
+    m_bytes = 0;
+    m_lock.unlock();
+}
+
+size_t page_cache::bytes()
+{
+    m_lock.lock();
+    size_t bytes = m_bytes;
+    m_lock.unlock();
+    return bytes;
+}
+
+size_t page_cache::count()
+{
+    m_lock.lock();
+    size_t count = m_entries.size();
+    m_lock.unlock();
+    return count;
+}
+
+//从各索引中移除条目，调用者需持有m_lock
+void page_cache::unlink(entry_iter it)
+{
+    for (size_t i = 0; i < it->tags.size(); ++i)
+    {
+        unordered_map<string, unordered_set<string> >::iterator tag = m_tags.find(it->tags[i]);
+        if (tag == m_tags.end())
+            continue;
+        tag->second.erase(it->key);
+        if (tag->second.empty())
+            m_tags.erase(tag);
+    }
+    m_bytes -= it->page->size();
+    m_entries.erase(it->key);
+    m_lru.erase(it);
+}
@@ -0,0 +1,93 @@
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include <stdint.h>
+#include <time.h>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "../lock/locker.h"
+
+using namespace std;
+
+//渲染好的整页缓存：按键(路由与参数)保存页面，每个条目记下它依赖的标签，写操作按标签精确失效
+//总字节数有上限，按LRU淘汰；条目超过max_age秒视为过期，过期的页面仍可提供，同时由一个调用者刷新
+//同一个键上并发的未命中只由一个调用者渲染，其余等待它的结果
+//页面以shared_ptr交出，条目被淘汰或失效时，正在发送它的连接仍持有引用
+class page_cache
+{
+public:
+    typedef shared_ptr<const string> page_ptr;
+
+    static const size_t DEFAULT_MAX_BYTES = 32 * 1024 * 1024;
+    static const int DEFAULT_MAX_AGE = 60;
+    static const int WAIT_TIMEOUT = 5;  //等待同一页面渲染的秒数，超时后调用者自行渲染
+    static const int RETRY_DELAY = 5;   //刷新失败后至少间隔的秒数
+
+    explicit page_cache(size_t max_bytes = DEFAULT_MAX_BYTES, int max_age = DEFAULT_MAX_AGE);
+
+    //max_bytes为0时不缓存
+    void set_limits(size_t max_bytes, int max_age);
+    bool enabled() const { return m_max_bytes > 0; }
+
+    //只取新鲜的页面，未命中或已过期时返回空指针
+    page_ptr get(const string &key);
+    //取页面并合并并发的渲染：
+    //有页面(包括过期的)时直接返回；已过期且没有进行中的刷新时lead为true，由调用者安排刷新并以finish结束
+    //没有页面时第一个调用者lead为true，负责渲染并以finish结束；其余调用者等待，取得它保存的页面，
+    //那次渲染失败或等待超时则返回空指针
+    page_ptr acquire(const string &key, bool &lead);
+    //结束acquire交给调用者的渲染或刷新：page非空时按put保存并交给等待者；
+    //为空表示失败，过期的页面保留，RETRY_DELAY秒内不再刷新
+    page_ptr finish(const string &key, page_ptr page, const vector<string> &tags, uint64_t generation);
+    //渲染前取得当前代数，放入时若期间发生过失效则不保存，避免把失效前读到的数据放回缓存
+    uint64_t generation();
+    //保存page并返回其共享指针；代数已变化或页面过大时只返回指针，不保存
+    page_ptr put(const string &key, string page, const vector<string> &tags, uint64_t generation);
+    //使依赖tag的条目全部失效
+    void invalidate(const string &tag);
+    void remove(const string &key);
+    void clear();
+
+    size_t bytes();
+    size_t count();
+
+private:
+    struct entry
+    {
+        string key;
+        page_ptr page;
+        vector<string> tags;
+        time_t created;
+        time_t retry_at;  //刷新失败后下次可以刷新的时间
+    };
+    typedef list<entry>::iterator entry_iter;
+    //一次进行中的渲染或刷新
+    struct flight
+    {
+        bool done;
+        page_ptr page;
+        flight() : done(false) {}
+    };
+
+    bool store(const string &key, const page_ptr &page, const vector<string> &tags, uint64_t generation);
+    void unlink(entry_iter it);
+
+private:
+    locker m_lock;
+    list<entry> m_lru;  //表头为最近使用
+    unordered_map<string, entry_iter> m_entries;
+    unordered_map<string, unordered_set<string> > m_tags;  //标签到依赖它的键
+    unordered_map<string, shared_ptr<flight> > m_flights;  //进行中的渲染与刷新
+    cond m_done;
+    size_t m_bytes;
+    size_t m_max_bytes;
+    int m_max_age;
+    uint64_t m_generation;
+};
+
+#endif
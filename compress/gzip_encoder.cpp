@@ -0,0 +1,152 @@
+#include "gzip_encoder.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//太小的文件压缩后省下的字节抵不过Content-Encoding带来的开销
+static const off_t SIDECAR_MIN_SIZE = 256;
+
+gzip_encoder::~gzip_encoder()
+{
+    if (m_ready)
+        deflateEnd(&m_stream);
+}
+
+gzip_encoder *gzip_encoder::local()
+{
+    static thread_local gzip_encoder encoder;
+    return &encoder;
+}
+
+bool gzip_encoder::reset(int level)
+{
+    if (m_ready && level == m_level)
+        return deflateReset(&m_stream) == Z_OK;
+    if (m_ready)
+    {
+        deflateEnd(&m_stream);
+        m_ready = false;
+    }
+
+    memset(&m_stream, 0, sizeof(m_stream));
+    //windowBits加16输出gzip格式而不是zlib格式
+    if (deflateInit2(&m_stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+    m_ready = true;
+    m_level = level;
+    return true;
+}
+
+bool gzip_encoder::compress(const char *data, size_t len, string &out, int level)
+{
+    if (len > UINT_MAX || !reset(level))
+        return false;
+
+    size_t old = out.size();
+    size_t bound = deflateBound(&m_stream, len);
+    out.resize(old + bound);
+    m_stream.next_in = (Bytef *)data;
+    m_stream.avail_in = (uInt)len;
+    m_stream.next_out = (Bytef *)&out[old];
+    m_stream.avail_out = (uInt)bound;
+    //输出空间不小于deflateBound时一次Z_FINISH即可完成
+    if (deflate(&m_stream, Z_FINISH) != Z_STREAM_END)
+    {
+        out.resize(old);
+        return false;
+    }
+    out.resize(old + m_stream.total_out);
+    return true;
+}
+
+bool gzip_encoder::begin(int level)
+{
+    return reset(level);
+}
+
+bool gzip_encoder::append(const char *data, size_t len, string &out, bool finish)
+{
+    if (!m_ready || len > UINT_MAX)
+        return false;
+
+    m_stream.next_in = (Bytef *)data;
+    m_stream.avail_in = (uInt)len;
+    char buf[16384];
+    int ret;
+    do
+    {
+        m_stream.next_out = (Bytef *)buf;
+        m_stream.avail_out = sizeof(buf);
+        ret = deflate(&m_stream, finish ? Z_FINISH : Z_SYNC_FLUSH);
+        if (Z_STREAM_ERROR == ret)
+            return false;
+        out.append(buf, sizeof(buf) - m_stream.avail_out);
+    } while (0 == m_stream.avail_out);
+    return !finish || Z_STREAM_END == ret;
+}
+
+static const char *compressible_exts[] = {".html", ".css", ".js", ".json", ".svg", ".txt", ".xml"};
+
+bool gzip_compressible(const char *path)
+{
+    const char *ext = strrchr(path, '.');
+    if (!ext || strchr(ext, '/'))
+        return false;
+    for (size_t i = 0; i < sizeof(compressible_exts) / sizeof(compressible_exts[0]); ++i)
+    {
+        if (strcmp(ext, compressible_exts[i]) == 0)
+            return true;
+    }
+    return false;
+}
+
+bool gzip_sidecar_fresh(const struct stat &gz, const struct stat &origin)
+{
+    return gz.st_mtim.tv_sec == origin.st_mtim.tv_sec && gz.st_mtim.tv_nsec == origin.st_mtim.tv_nsec;
+}
+
+bool gzip_sidecar(const char *path, bool force)
+{
+    string gz = string(path) + ".gz";
+    struct stat st, gz_st;
+    if (stat(path, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size < SIDECAR_MIN_SIZE)
+        return false;
+    if (!force && stat(gz.c_str(), &gz_st) == 0 && gzip_sidecar_fresh(gz_st, st))
+        return true;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    void *addr = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == addr)
+        return false;
+
+    //静态资源只压缩一次，用最高压缩级别
+    string out;
+    bool ok = gzip_encoder::local()->compress((const char *)addr, st.st_size, out, Z_BEST_COMPRESSION) &&
+              out.size() < (size_t)st.st_size;
+    munmap(addr, st.st_size);
+    if (!ok)
+        return false;
+
+    string tmp = gz + ".tmp";
+    fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+    //压缩期间源文件又被修改时两者时间不同，副本不会被使用，随后的写入事件再次生成
+    struct timespec times[2] = {st.st_atim, st.st_mtim};
+    ok = write(fd, out.data(), out.size()) == (ssize_t)out.size() && futimens(fd, times) == 0;
+    close(fd);
+    if (!ok || rename(tmp.c_str(), gz.c_str()) < 0)
+    {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
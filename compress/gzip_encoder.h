@@ -0,0 +1,51 @@
+#ifndef GZIP_ENCODER_H
+#define GZIP_ENCODER_H
+
+#include <stddef.h>
+#include <sys/stat.h>
+#include <string>
+#include <zlib.h>
+
+using namespace std;
+
+//gzip压缩器，z_stream只在第一次使用时分配，之后每次压缩用deflateReset复用
+//每个线程通过local()取得自己的实例，不加锁
+class gzip_encoder
+{
+public:
+    static const int DEFAULT_LEVEL = 6;
+
+    gzip_encoder() : m_ready(false), m_level(-1) {}
+    ~gzip_encoder();
+
+    static gzip_encoder *local();
+
+    //把len字节压缩成完整的gzip数据追加到out，失败时out保持原样并返回false
+    bool compress(const char *data, size_t len, string &out, int level = DEFAULT_LEVEL);
+
+    //流式压缩：begin之后逐段append，每段以Z_SYNC_FLUSH结束使客户端能立即解压，finish为true时写出gzip尾部
+    //流式压缩期间不能在同一线程上调用compress
+    bool begin(int level = DEFAULT_LEVEL);
+    bool append(const char *data, size_t len, string &out, bool finish);
+
+private:
+    gzip_encoder(const gzip_encoder &);
+    gzip_encoder &operator=(const gzip_encoder &);
+    bool reset(int level);
+
+private:
+    z_stream m_stream;
+    bool m_ready;
+    int m_level;
+};
+
+//按扩展名判断文件是否值得压缩(文本类资源)
+bool gzip_compressible(const char *path);
+
+//为path生成path.gz：文件太小或压缩后不变小时不生成，已有最新的.gz时除非force否则不重新生成
+//先写入临时文件再rename，正在发送旧.gz的连接不受影响；副本的修改时间设为压缩前源文件的修改时间
+bool gzip_sidecar(const char *path, bool force = false);
+//.gz副本是否对应源文件当前的内容：修改时间按纳秒精度相同(gzip -k生成的副本同样保留源文件时间)
+bool gzip_sidecar_fresh(const struct stat &gz, const struct stat &origin);
+
+#endif
@@ -28,13 +28,40 @@ Config::Config(){
     //关闭日志,默认不关闭
     close_log = 0;
 
-    //并发模型,默认是proactor
+    //并发模型,默认是proactor,1为reactor,2为io_uring
     actor_model = 0;
+
+    //子反应堆数量,默认0,即单epoll + 线程池
+    reactor_num = 0;
+
+    //SO_REUSEPORT分片监听,默认不使用,仅在子反应堆模式下生效
+    reuseport = 0;
+
+    //listen队列长度,默认1024,实际上限受net.core.somaxconn限制
+    backlog = 1024;
+
+    //非活动连接超时时间,默认15000毫秒
+    idle_timeout = 15000;
+
+    //请求体上限,默认8192KB,需容纳5MB的图片上传
+    max_body_kb = 8192;
+
+    //预压缩静态文本资源,默认开启
+    precompress = 1;
+
+    //动态响应的gzip压缩级别,默认6,0为不压缩
+    gzip_level = 6;
+
+    //每个连接最多处理的请求数,默认1000,0为不限制
+    max_requests = 1000;
+
+    //博客页面缓存,默认32MB,0为不缓存
+    page_cache_mb = 32;
 }
 
 void Config::parse_arg(int argc, char*argv[]){
     int opt;
-    const char *str = "p:l:m:o:s:t:c:a:";
+    const char *str = "p:l:m:o:s:t:c:a:r:R:b:T:B:z:g:n:C:";
     while ((opt = getopt(argc, argv, str)) != -1)
     {
         switch (opt)
@@ -79,6 +106,51 @@ void Config::parse_arg(int argc, char*argv[]){
             actor_model = atoi(optarg);
             break;
         }
+        case 'r':
+        {
+            reactor_num = atoi(optarg);
+            break;
+        }
+        case 'R':
+        {
+            reuseport = atoi(optarg);
+            break;
+        }
+        case 'b':
+        {
+            backlog = atoi(optarg);
+            break;
+        }
+        case 'T':
+        {
+            idle_timeout = atoi(optarg);
+            break;
+        }
+        case 'B':
+        {
+            max_body_kb = atoi(optarg);
+            break;
+        }
+        case 'z':
+        {
+            precompress = atoi(optarg);
+            break;
+        }
+        case 'g':
+        {
+            gzip_level = atoi(optarg);
+            break;
+        }
+        case 'n':
+        {
+            max_requests = atoi(optarg);
+            break;
+        }
+        case 'C':
+        {
+            page_cache_mb = atoi(optarg);
+            break;
+        }
         default:
             break;
         }
@@ -42,6 +42,33 @@ public:
 
     //并发模型选择
     int actor_model;
+
+    //子反应堆数量
+    int reactor_num;
+
+    //是否启用SO_REUSEPORT分片监听
+    int reuseport;
+
+    //listen队列长度
+    int backlog;
+
+    //非活动连接超时时间(毫秒)
+    int idle_timeout;
+
+    //请求体上限(KB)
+    int max_body_kb;
+
+    //是否为静态文本资源预生成.gz
+    int precompress;
+
+    //动态响应的gzip压缩级别
+    int gzip_level;
+
+    //每个连接最多处理的请求数
+    int max_requests;
+
+    //博客页面缓存大小(MB)
+    int page_cache_mb;
 };
 
 #endif
\ No newline at end of file
@@ -5,12 +5,17 @@
 
 //定义http响应的一些状态信息
 const char *ok_200_title = "OK";
+const char *ok_206_title = "Partial Content";
+const char *ok_304_title = "Not Modified";
 const char *error_400_title = "Bad Request";
 const char *error_400_form = "Your request has bad syntax or is inherently impossible to staisfy.\n";
 const char *error_403_title = "Forbidden";
 const char *error_403_form = "You do not have permission to get file form this server.\n";
 const char *error_404_title = "Not Found";
 const char *error_404_form = "The requested file was not found on this server.\n";
+const char *error_413_title = "Payload Too Large";
+const char *error_413_form = "The request body exceeds the limit of this server.\n";
+const char *error_416_title = "Range Not Satisfiable";
 const char *error_500_title = "Internal Error";
 const char *error_500_form = "There was an unusual problem serving the request file.\n";
 
@@ -18,6 +23,9 @@ locker m_lock;
 map<string, string> users; // 保持原有的用户名密码映射
 map<string, string> user_roles; // 新增：用户名到角色的映射
 BlogHandler* http_conn::blog_handler = nullptr;
+long http_conn::m_max_body = 8 * 1024 * 1024;
+int http_conn::m_gzip_level = gzip_encoder::DEFAULT_LEVEL;
+int http_conn::m_max_requests = 0;
 
 // Session管理静态成员定义
 unordered_map<string, UserSession> http_conn::sessions;
@@ -55,12 +63,13 @@ void http_conn::initmysql_result(connection_pool *connPool)
     }
 }
 
-void http_conn::init_blog_handler(connection_pool *connPool)
+void http_conn::init_blog_handler(connection_pool *connPool, size_t page_cache_bytes)
 {
     if (blog_handler == nullptr)
     {
         blog_handler = new BlogHandler();
         blog_handler->init(connPool);
+        blog_handler->set_page_cache(page_cache_bytes);
         // 设置session验证函数
         BlogHandler::set_session_functions(validate_session, get_session_username, get_session_role);
         printf("Blog handler initialized\n");
@@ -100,22 +109,44 @@ void removefd(int epollfd, int fd)
     close(fd);
 }
 
+std::atomic<int> http_conn::m_user_count(0);
+int http_conn::m_epollfd = -1;
+
 //将事件重置为EPOLLONESHOT
-void modfd(int epollfd, int fd, int ev, int TRIGMode)
+//由所属循环线程直接驱动时不使用EPOLLONESHOT，事件未变化则无需epoll_ctl
+void http_conn::arm(int ev)
 {
+    //由io_uring驱动的连接不在任何epoll中
+    if (m_ring_driven)
+        return;
+    if (!m_one_shot && ev == m_armed_ev)
+        return;
+
     epoll_event event;
-    event.data.fd = fd;
+    event.data.u64 = event_data(m_sockfd, m_serial);
+    event.events = ev | EPOLLRDHUP;
+    if (1 == m_TRIGMode)
+        event.events |= EPOLLET;
+    if (m_one_shot)
+        event.events |= EPOLLONESHOT;
 
-    if (1 == TRIGMode)
-        event.events = ev | EPOLLET | EPOLLONESHOT | EPOLLRDHUP;
-    else
-        event.events = ev | EPOLLONESHOT | EPOLLRDHUP;
+    epoll_ctl(loop_epollfd(), EPOLL_CTL_MOD, m_sockfd, &event);
+    m_armed_ev = ev;
+}
 
-    epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &event);
+void http_conn::bind_loop(int epollfd, bool one_shot)
+{
+    m_loop_epollfd = epollfd;
+    m_one_shot = one_shot;
+    m_ring_driven = false;
 }
 
-int http_conn::m_user_count = 0;
-int http_conn::m_epollfd = -1;
+void http_conn::bind_ring()
+{
+    m_loop_epollfd = -1;
+    m_one_shot = false;
+    m_ring_driven = true;
+}
 
 //关闭连接，关闭一个连接，客户总量减一
 void http_conn::close_conn(bool real_close)
@@ -123,31 +154,52 @@ void http_conn::close_conn(bool real_close)
     if (real_close && (m_sockfd != -1))
     {
         printf("close %d\n", m_sockfd);
-        removefd(m_epollfd, m_sockfd);
+        //先清除状态、归还缓冲区再关闭fd：fd一旦关闭就可能被其他线程accept复用并init本对象
+        int sockfd = m_sockfd;
         m_sockfd = -1;
+        ++m_serial;
         m_user_count--;
+        //io_uring上仍有未完成的multishot recv引用该socket，先shutdown才能让对端收到FIN
+        if (m_ring_driven)
+            shutdown(sockfd, SHUT_RDWR);
+        release_buffers();
+        delete m_h2;
+        m_h2 = NULL;
+        if (m_ring_driven)
+            close(sockfd);
+        else
+            removefd(loop_epollfd(), sockfd);
     }
 }
 
 //初始化连接,外部调用初始化套接字地址
-void http_conn::init(int sockfd, const sockaddr_in &addr, char *root, int TRIGMode,
-                     int close_log, string user, string passwd, string sqlname)
+void http_conn::init(int sockfd, const sockaddr_in &addr, char *root, int TRIGMode, int close_log)
 {
     m_sockfd = sockfd;
+    ++m_serial;
     m_address = addr;
+    m_requests = 0;
+    m_TRIGMode = TRIGMode;
 
-    addfd(m_epollfd, sockfd, true, m_TRIGMode);
+    if (!m_ring_driven)
+    {
+        epoll_event event;
+        event.data.u64 = event_data(sockfd, m_serial);
+        event.events = EPOLLIN | EPOLLRDHUP;
+        if (1 == m_TRIGMode)
+            event.events |= EPOLLET;
+        if (m_one_shot)
+            event.events |= EPOLLONESHOT;
+        epoll_ctl(loop_epollfd(), EPOLL_CTL_ADD, sockfd, &event);
+        setnonblocking(sockfd);
+    }
+    m_armed_ev = EPOLLIN;
     m_user_count++;
 
     //当浏览器出现连接重置时，可能是网站根目录出错或http响应格式出错或者访问的文件中内容完全为空
     doc_root = root;
-    m_TRIGMode = TRIGMode;
     m_close_log = close_log;
 
-    strcpy(sql_user, user.c_str());
-    strcpy(sql_passwd, passwd.c_str());
-    strcpy(sql_name, sqlname.c_str());
-
     init();
 }
 
@@ -166,6 +218,21 @@ void http_conn::init()
     m_content_length = 0;
     m_host = 0;
     m_cookie = 0;
+    m_range = 0;
+    m_if_range = 0;
+    m_if_none_match = 0;
+    m_if_modified_since = 0;
+    m_etag.clear();
+    //释放上一个响应借用的数据
+    m_response.body.clear();
+    m_streaming = false;
+    m_stream_gzip = false;
+    m_stream_failed = false;
+    m_accept_gzip = false;
+    m_upgrade_h2c = false;
+    m_http2_settings = 0;
+    m_ranges.clear();
+    m_string = 0;
     m_start_line = 0;
     m_checked_idx = 0;
     m_read_idx = 0;
@@ -174,51 +241,147 @@ void http_conn::init()
     m_state = 0;
     timer_flag = 0;
     improv = 0;
+    m_pipelined = false;
 
-    memset(m_read_buf, '\0', READ_BUFFER_SIZE);
-    memset(m_write_buf, '\0', WRITE_BUFFER_SIZE);
-    memset(m_real_file, '\0', FILENAME_LEN);
+    //一个请求处理完毕，连接进入空闲，缓冲区归还给池
+    release_buffers();
+}
+
+//保持连接时为下一个请求复位：只重置解析状态，已收到的后续请求数据前移到读缓冲区开头
+//返回true表示缓冲区中已有后续请求的数据
+bool http_conn::next_request()
+{
+    long end = m_checked_idx;
+    if (CHECK_STATE_CONTENT == m_check_state)
+        end += m_content_length;
+    long received = m_read_idx + (long)m_body_chain.size();
+    if (end >= received)
+    {
+        init();
+        return false;
+    }
+    if (m_string)
+        m_string[m_content_length] = m_body_end_byte;
+
+    if (m_body_chain.empty())
+    {
+        //常见情况：后续请求都在读缓冲区内，前移后保留该缓冲区
+        long left = m_read_idx - end;
+        memmove(m_read_buf, m_read_buf + end, left);
+        char *read_buf = m_read_buf;
+        m_read_buf = NULL;
+        init();
+        m_read_buf = read_buf;
+        m_read_idx = left;
+    }
+    else
+    {
+        //上一个请求体延伸到链式缓冲区，后续数据先拼出来再重新追加
+        string pending;
+        if (end < m_read_idx)
+            pending.append(m_read_buf + end, m_read_idx - end);
+        size_t offset = end > m_read_idx ? end - m_read_idx : 0;
+        size_t old = pending.size();
+        pending.resize(old + m_body_chain.size() - offset);
+        m_body_chain.read(offset, &pending[old], pending.size() - old);
+        init();
+        append_read(pending.data(), pending.size());
+    }
+    m_pipelined = true;
+    return true;
+}
+
+bool http_conn::attach_buffer(char *&buf, int size)
+{
+    if (!buf)
+        buf = buffer_pool::get_instance()->acquire(size);
+    return buf != NULL;
+}
+
+void http_conn::release_buffers()
+{
+    buffer_pool *pool = buffer_pool::get_instance();
+    pool->release(m_read_buf, READ_BUFFER_SIZE);
+    pool->release(m_write_buf, m_write_cap);
+    pool->release(m_real_file, FILENAME_LEN);
+    m_body_chain.clear();
+    //blog响应体不复用，空闲时连同内存一起释放
+    string().swap(m_response_body);
+    vector<BodySegment>().swap(m_response.body);
+    //响应未发完就关闭连接时仍持有文件缓存引用，所有关闭路径都经close_conn在此归还
+    unmap();
+    m_read_buf = NULL;
+    m_write_buf = NULL;
+    m_write_cap = WRITE_BUFFER_SIZE;
+    m_real_file = NULL;
 }
 
 //从状态机，用于分析出一行内容
 //返回值为行的读取状态，有LINE_OK,LINE_BAD,LINE_OPEN
+//按块查找下一个'\r'或'\n'，不再逐字节判断
 http_conn::LINE_STATUS http_conn::parse_line()
 {
-    char temp;
-    for (; m_checked_idx < m_read_idx; ++m_checked_idx)
+    m_checked_idx += scan_find2(m_read_buf + m_checked_idx, m_read_idx - m_checked_idx, '\r', '\n');
+    if (m_checked_idx >= m_read_idx)
+        return LINE_OPEN;
+
+    if (m_read_buf[m_checked_idx] == '\r')
     {
-        temp = m_read_buf[m_checked_idx];
-        if (temp == '\r')
-        {
-            if ((m_checked_idx + 1) == m_read_idx)
-                return LINE_OPEN;
-            else if (m_read_buf[m_checked_idx + 1] == '\n')
-            {
-                m_read_buf[m_checked_idx++] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
-        }
-        else if (temp == '\n')
+        if ((m_checked_idx + 1) == m_read_idx)
+            return LINE_OPEN;
+        else if (m_read_buf[m_checked_idx + 1] == '\n')
         {
-            if (m_checked_idx > 1 && m_read_buf[m_checked_idx - 1] == '\r')
-            {
-                m_read_buf[m_checked_idx - 1] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
+            m_read_buf[m_checked_idx++] = '\0';
+            m_read_buf[m_checked_idx++] = '\0';
+            return LINE_OK;
         }
+        return LINE_BAD;
+    }
+    if (m_checked_idx > 1 && m_read_buf[m_checked_idx - 1] == '\r')
+    {
+        m_read_buf[m_checked_idx - 1] = '\0';
+        m_read_buf[m_checked_idx++] = '\0';
+        return LINE_OK;
+    }
+    return LINE_BAD;
+}
+
+//取得下一段可写入的空间：先填满读缓冲区，之后的数据(请求体)追加到m_body_chain
+//已收数据达到READ_BUFFER_SIZE + m_max_body时返回NULL
+char *http_conn::read_space(size_t &space)
+{
+    if (!attach_buffer(m_read_buf, READ_BUFFER_SIZE))
+        return NULL;
+    if (m_read_idx < READ_BUFFER_SIZE)
+    {
+        space = READ_BUFFER_SIZE - m_read_idx;
+        return m_read_buf + m_read_idx;
     }
-    return LINE_OPEN;
+
+    size_t left = (size_t)m_max_body - m_body_chain.size();
+    if (0 == left)
+        return NULL;
+    char *buf = m_body_chain.prepare(space);
+    if (space > left)
+        space = left;
+    return buf;
+}
+
+void http_conn::commit_read(size_t len)
+{
+    if (m_read_idx < READ_BUFFER_SIZE)
+        m_read_idx += len;
+    else
+        m_body_chain.commit(len);
 }
 
 //循环读取客户数据，直到无数据可读或对方关闭连接
 //非阻塞ET工作模式下，需要一次性将数据读完
 bool http_conn::read_once()
 {
-    if (m_read_idx >= READ_BUFFER_SIZE)
+    size_t space = 0;
+    char *buf = read_space(space);
+    if (!buf)
     {
         return false;
     }
@@ -227,13 +390,13 @@ bool http_conn::read_once()
     //LT读取数据
     if (0 == m_TRIGMode)
     {
-        bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);
-        m_read_idx += bytes_read;
+        bytes_read = recv(m_sockfd, buf, space, 0);
 
         if (bytes_read <= 0)
         {
             return false;
         }
+        commit_read(bytes_read);
 
         return true;
     }
@@ -242,7 +405,7 @@ bool http_conn::read_once()
     {
         while (true)
         {
-            bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);
+            bytes_read = recv(m_sockfd, buf, space, 0);
             if (bytes_read == -1)
             {
                 if (errno == EAGAIN || errno == EWOULDBLOCK)
@@ -253,12 +416,34 @@ bool http_conn::read_once()
             {
                 return false;
             }
-            m_read_idx += bytes_read;
+            commit_read(bytes_read);
+            //达到请求大小上限时停止读取，交给process_read判定(413或请求完整)
+            buf = read_space(space);
+            if (!buf)
+                break;
         }
         return true;
     }
 }
 
+//io_uring驱动时由循环线程把recv到的数据交给连接，超过请求大小上限返回false
+bool http_conn::append_read(const char *data, int len)
+{
+    while (len > 0)
+    {
+        size_t space;
+        char *buf = read_space(space);
+        if (!buf)
+            return false;
+        size_t n = (size_t)len < space ? (size_t)len : space;
+        memcpy(buf, data, n);
+        commit_read(n);
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
 //解析http请求行，获得请求方法，目标url及http版本号
 http_conn::HTTP_CODE http_conn::parse_request_line(char *text)
 {
@@ -296,6 +481,8 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text)
     m_version += strspn(m_version, " \t");
     if (strcasecmp(m_version, "HTTP/1.1") != 0)
         return BAD_REQUEST;
+    //HTTP/1.1默认保持连接
+    m_linger = true;
     if (strncasecmp(m_url, "http://", 7) == 0)
     {
         m_url += 7;
@@ -317,11 +504,73 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text)
     return NO_REQUEST;
 }
 
+//If-None-Match按弱比较：忽略W/前缀，*匹配任何存在的资源
+static bool etag_listed(const char *list, const string &etag)
+{
+    while (*list)
+    {
+        list += strspn(list, " \t,");
+        if ('*' == *list)
+            return true;
+        if (strncmp(list, "W/", 2) == 0)
+            list += 2;
+        if ('"' != *list)
+            break;
+        const char *end = strchr(list + 1, '"');
+        if (!end)
+            break;
+        if ((size_t)(end + 1 - list) == etag.size() && strncmp(list, etag.data(), etag.size()) == 0)
+            return true;
+        list = end + 1;
+    }
+    return false;
+}
+
+//解析HTTP日期(IMF-fixdate)，其他格式视为无效
+static bool parse_http_date(const char *text, time_t &t)
+{
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if (!strptime(text, "%a, %d %b %Y %H:%M:%S GMT", &tm))
+        return false;
+    t = timegm(&tm);
+    return true;
+}
+
+//Accept-Encoding中gzip是否可接受：显式的gzip优先于*，q=0表示拒绝
+static bool accepts_gzip(const char *value)
+{
+    double gzip_q = -1, any_q = -1;
+    while (*value)
+    {
+        value += strspn(value, " \t,");
+        size_t len = strcspn(value, " \t,;");
+        if (0 == len)
+            break;
+        double q = 1;
+        const char *params = value + len;
+        const char *end = params + strcspn(params, ",");
+        const char *qp = strstr(params, "q=");
+        if (qp && qp < end)
+            q = atof(qp + 2);
+        if (4 == len && strncasecmp(value, "gzip", 4) == 0)
+            gzip_q = q;
+        else if (1 == len && '*' == value[0])
+            any_q = q;
+        value = end;
+    }
+    return gzip_q >= 0 ? gzip_q > 0 : any_q > 0;
+}
+
 //解析http请求的一个头部信息
 http_conn::HTTP_CODE http_conn::parse_headers(char *text)
 {
     if (text[0] == '\0')
     {
+        if (m_content_length < 0)
+            return BAD_REQUEST;
+        if (m_content_length > m_max_body)
+            return BODY_TOO_LARGE;
         if (m_content_length != 0)
         {
             m_check_state = CHECK_STATE_CONTENT;
@@ -329,53 +578,111 @@ http_conn::HTTP_CODE http_conn::parse_headers(char *text)
         }
         return GET_REQUEST;
     }
-    else if (strncasecmp(text, "Connection:", 11) == 0)
+
+    //名称与取值一次切开，已知的头部经完美哈希直接得到编号，其余忽略
+    size_t len = strlen(text);
+    size_t colon = scan_find2(text, len, ':', ':');
+    if (colon == len)
+        return NO_REQUEST;
+    char *value = text + colon + 1;
+    value += strspn(value, " \t");
+
+    switch (lookup_header(text, colon))
     {
-        text += 11;
-        text += strspn(text, " \t");
-        if (strcasecmp(text, "keep-alive") == 0)
-        {
+    case HEADER_CONNECTION:
+        //Connection可以是逗号分隔的多个选项，其中有close时本次响应后关闭
+        if (strcasestr(value, "close"))
+            m_linger = false;
+        else if (strcasestr(value, "keep-alive"))
             m_linger = true;
-        }
-    }
-    else if (strncasecmp(text, "Content-length:", 15) == 0)
-    {
-        text += 15;
-        text += strspn(text, " \t");
-        m_content_length = atol(text);
-    }
-    else if (strncasecmp(text, "Host:", 5) == 0)
-    {
-        text += 5;
-        text += strspn(text, " \t");
-        m_host = text;
-    }
-    else if (strncasecmp(text, "Cookie:", 7) == 0)
-    {
-        text += 7;
-        text += strspn(text, " \t");
-        m_cookie = text;
-    }
-    else
-    {
-        LOG_INFO("oop!unknow header: %s", text);
+        break;
+    case HEADER_CONTENT_LENGTH:
+        m_content_length = atol(value);
+        break;
+    case HEADER_HOST:
+        m_host = value;
+        break;
+    case HEADER_COOKIE:
+        m_cookie = value;
+        break;
+    case HEADER_RANGE:
+        m_range = value;
+        break;
+    case HEADER_IF_RANGE:
+        m_if_range = value;
+        break;
+    case HEADER_IF_NONE_MATCH:
+        m_if_none_match = value;
+        break;
+    case HEADER_IF_MODIFIED_SINCE:
+        m_if_modified_since = value;
+        break;
+    case HEADER_ACCEPT_ENCODING:
+        m_accept_gzip = accepts_gzip(value);
+        break;
+    case HEADER_UPGRADE:
+        m_upgrade_h2c = strcasestr(value, "h2c") != NULL;
+        break;
+    case HEADER_HTTP2_SETTINGS:
+        m_http2_settings = value;
+        break;
+    default:
+        break;
     }
     return NO_REQUEST;
 }
 
-//判断http请求是否被完整读入
+//判断http请求是否被完整读入，请求体从m_checked_idx开始，超出读缓冲区的部分在m_body_chain中
 http_conn::HTTP_CODE http_conn::parse_content(char *text)
 {
-    if (m_read_idx >= (m_content_length + m_checked_idx))
+    if ((m_read_idx - m_checked_idx) + (long)m_body_chain.size() >= m_content_length)
     {
-        text[m_content_length] = '\0';
-        //POST请求中最后为输入的用户名和密码
-        m_string = text;
+        //整个请求体都在读缓冲区内时原地加'\0'，直接作为字符串使用
+        if (m_checked_idx + m_content_length < READ_BUFFER_SIZE)
+        {
+            m_body_end_byte = text[m_content_length];
+            text[m_content_length] = '\0';
+            //POST请求中最后为输入的用户名和密码
+            m_string = text;
+        }
         return GET_REQUEST;
     }
     return NO_REQUEST;
 }
 
+size_t http_conn::read_body(size_t offset, char *dst, size_t len) const
+{
+    if (offset >= (size_t)m_content_length)
+        return 0;
+    if (len > (size_t)m_content_length - offset)
+        len = (size_t)m_content_length - offset;
+
+    size_t total = 0;
+    size_t head = (size_t)(m_read_idx - m_checked_idx);
+    if (offset < head)
+    {
+        total = len < head - offset ? len : head - offset;
+        memcpy(dst, m_read_buf + m_checked_idx + offset, total);
+    }
+    if (total < len)
+        total += m_body_chain.read(offset + total - head, dst + total, len - total);
+    return total;
+}
+
+string http_conn::body_string() const
+{
+    if (m_string)
+        return string(m_string, m_content_length);
+
+    string body;
+    if (m_content_length > 0)
+    {
+        body.resize(m_content_length);
+        body.resize(read_body(0, &body[0], m_content_length));
+    }
+    return body;
+}
+
 http_conn::HTTP_CODE http_conn::process_read()
 {
     LINE_STATUS line_status = LINE_OK;
@@ -399,8 +706,8 @@ http_conn::HTTP_CODE http_conn::process_read()
         case CHECK_STATE_HEADER:
         {
             ret = parse_headers(text);
-            if (ret == BAD_REQUEST)
-                return BAD_REQUEST;
+            if (ret == BAD_REQUEST || ret == BODY_TOO_LARGE)
+                return ret;
             else if (ret == GET_REQUEST)
             {
                 return do_request();
@@ -412,237 +719,263 @@ http_conn::HTTP_CODE http_conn::process_read()
             ret = parse_content(text);
             if (ret == GET_REQUEST)
                 return do_request();
-            line_status = LINE_OPEN;
-            break;
+            //请求体未收全时不能再调用parse_line，否则会把请求体当作行扫描并移动m_checked_idx
+            return NO_REQUEST;
         }
         default:
             return INTERNAL_ERROR;
         }
     }
+    //读缓冲区已满仍未读完请求头
+    if (m_check_state != CHECK_STATE_CONTENT && m_read_idx >= READ_BUFFER_SIZE)
+        return BAD_REQUEST;
     return NO_REQUEST;
 }
 
+//路由表只建立一次(C++11保证局部静态变量的初始化线程安全)，之后只读，各线程共享
+const route_trie<http_conn::http_route> &http_conn::routes()
+{
+    static const route_trie<http_route> table = build_routes();
+    return table;
+}
+
+route_trie<http_conn::http_route> http_conn::build_routes()
+{
+    route_trie<http_route> table;
+    const int any = route_trie<http_route>::ANY_METHOD;
+    http_route blog = {&http_conn::do_blog, NULL};
+    table.add(any, "/blog*rest", blog);
+    http_route assets = {&http_conn::do_static, NULL};
+    table.add(any, "/static/*path", assets);
+
+    //登录与注册表单：只处理带请求体的方法
+    http_route login = {&http_conn::do_login, NULL};
+    http_route signup = {&http_conn::do_register, NULL};
+    const METHOD forms[] = {POST, PUT, DELETE};
+    for (size_t i = 0; i < sizeof(forms) / sizeof(forms[0]); ++i)
+    {
+        table.add(forms[i], "/2*rest", login);
+        table.add(forms[i], "/3*rest", signup);
+    }
+
+    //页面跳转：/0注册页，/1登录页，/5图片页，/6视频页，/7原关注页已改为弹窗，回到welcome页面
+    const char *const pages[][2] = {{"/0*rest", "/register.html"}, {"/1*rest", "/log.html"}, {"/5*rest", "/picture.html"},
+                                    {"/6*rest", "/video.html"}, {"/7*rest", "/welcome.html"}};
+    for (size_t i = 0; i < sizeof(pages) / sizeof(pages[0]); ++i)
+    {
+        http_route page = {&http_conn::do_page, pages[i][1]};
+        table.add(any, pages[i][0], page);
+    }
+    return table;
+}
+
 http_conn::HTTP_CODE http_conn::do_request()
 {
+    if (!attach_buffer(m_real_file, FILENAME_LEN))
+        return INTERNAL_ERROR;
+    //下面按长度拼接路径时依赖结尾的'\0'
+    memset(m_real_file, '\0', FILENAME_LEN);
     strcpy(m_real_file, doc_root);
+
+    //查询串不参与路由
+    route_params params;
+    const http_route *route = routes().match(m_method, m_url, strcspn(m_url, "?"), params);
+    if (route)
+        return (this->*route->handler)(*route, params);
+
     int len = strlen(doc_root);
-    //printf("m_url:%s\n", m_url);
-    const char *p = strrchr(m_url, '/');
+    strncpy(m_real_file + len, m_url, FILENAME_LEN - len - 1);
+    return serve_file();
+}
 
-    // 处理博客路由
-    if (blog_handler && strncmp(m_url, "/blog", 5) == 0)
+http_conn::HTTP_CODE http_conn::do_blog(const http_route &, const route_params &)
+{
+    if (!blog_handler)
     {
-        string method_str;
-        switch (m_method)
-        {
-        case GET:
-            method_str = "GET";
-            break;
-        case POST:
-            method_str = "POST";
-            break;
-        case PUT:
-            method_str = "PUT";
-            break;
-        case DELETE:
-            method_str = "DELETE";
-            break;
-        default:
-            method_str = "GET";
-            break;
-        }
-        
-        string url_str(m_url);
-        string post_data_str = m_string ? string(m_string) : "";
-        string client_ip = inet_ntoa(m_address.sin_addr);
-        
-        string cookie_str = m_cookie ? string(m_cookie) : "";
-        string blog_response = blog_handler->handle_request(method_str, url_str, post_data_str, client_ip, cookie_str);
-        
-        if (!blog_response.empty())
-        {
-            // 将博客响应写入临时文件并使用mmap
-            char temp_file[] = "/tmp/blog_response_XXXXXX";
-            int temp_fd = mkstemp(temp_file);
-            if (temp_fd != -1)
-            {
-                ssize_t written = ::write(temp_fd, blog_response.c_str(), blog_response.length());
-                close(temp_fd);
-                
-                if (written > 0 && stat(temp_file, &m_file_stat) >= 0)
-                {
-                    int fd = open(temp_file, O_RDONLY);
-                    if (fd >= 0)
-                    {
-                        m_file_address = (char *)mmap(0, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-                        close(fd);
-                        // 注意：不立即删除临时文件，让unmap时处理
-                        return FILE_REQUEST;
-                    }
-                }
-                unlink(temp_file);
-            }
-            return INTERNAL_ERROR;
-        }
-        return NO_RESOURCE;
+        int len = strlen(doc_root);
+        strncpy(m_real_file + len, m_url, FILENAME_LEN - len - 1);
+        return serve_file();
     }
 
-    // 处理静态文件请求
-    if (strncmp(m_url, "/static", 7) == 0) {
-        // 构建静态文件路径
-        string static_path = string(doc_root) + string(m_url);
-        strncpy(m_real_file, static_path.c_str(), FILENAME_LEN - 1);
-        
-        // 检查文件是否存在
-        if (stat(m_real_file, &m_file_stat) < 0) {
-            return NO_RESOURCE;
-        }
-        
-        if (!(m_file_stat.st_mode & S_IROTH)) {
-            return FORBIDDEN_REQUEST;
-        }
-        
-        if (S_ISDIR(m_file_stat.st_mode)) {
-            return BAD_REQUEST;
-        }
-        
-        int fd = open(m_real_file, O_RDONLY);
-        m_file_address = (char *)mmap(0, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-        close(fd);
-        return FILE_REQUEST;
+    //请求的各部分直接引用读缓冲区，不复制成string
+    Request request;
+    switch (m_method)
+    {
+    case POST:
+        request.method = "POST";
+        break;
+    case PUT:
+        request.method = "PUT";
+        break;
+    case DELETE:
+        request.method = "DELETE";
+        break;
+    default:
+        request.method = "GET";
+        break;
     }
 
-    //处理cgi
-    if (cgi == 1 && (*(p + 1) == '2' || *(p + 1) == '3'))
+    size_t path_len = strcspn(m_url, "?");
+    request.path = StrView(m_url, path_len);
+    if ('?' == m_url[path_len])
+        request.query = StrView(m_url + path_len + 1);
+    request.host = m_host;
+    request.cookie = m_cookie;
+
+    //请求体超出读缓冲区时其余部分在m_body_chain中，只有这时才拼成一个string
+    string spilled;
+    if (m_string)
+        request.body = StrView(m_string, m_content_length);
+    else if (m_content_length > 0)
     {
+        spilled = body_string();
+        request.body = spilled;
+    }
 
-        //根据标志判断是登录检测还是注册检测
-        char flag = m_url[1];
-
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/");
-        strcat(m_url_real, m_url + 2);
-        strncpy(m_real_file + len, m_url_real, FILENAME_LEN - len - 1);
-        free(m_url_real);
-
-        //将用户名和密码提取出来
-        //user=123&passwd=123
-        char name[100], password[100];
-        int i;
-        for (i = 5; m_string[i] != '&'; ++i)
-            name[i - 5] = m_string[i];
-        name[i - 5] = '\0';
-
-        int j = 0;
-        for (i = i + 10; m_string[i] != '\0'; ++i, ++j)
-            password[j] = m_string[i];
-        password[j] = '\0';
+    char client_ip[INET_ADDRSTRLEN] = "";
+    inet_ntop(AF_INET, &m_address.sin_addr, client_ip, sizeof(client_ip));
+    request.client_ip = client_ip;
+    if (GET == m_method && m_if_none_match)
+        request.if_none_match = m_if_none_match;
 
-        if (*(p + 1) == '3')
+    chunk_writer sink(this);
+    Response response = blog_handler->handle_request(request, stream_wanted() ? &sink : nullptr);
+    
+    if (m_streaming)
+    {
+        end_stream(response);
+        return STREAM_REQUEST;
+    }
+    //处理器在渲染前按校验值判定客户端的页面仍有效
+    if (304 == response.status)
+    {
+        m_response = move(response);
+        m_etag = m_response.etag;
+        return NOT_MODIFIED;
+    }
+    if (!response.empty())
+    {
+        //响应留在连接上，各段由writev直接发送
+        m_response = move(response);
+        //页面的ETag由处理器给出；其余响应没有校验值，取渲染结果的摘要，未变化时省去压缩和发送
+        //错误页不参与条件请求
+        if (GET == m_method && 200 == m_response.status)
         {
-            //如果是注册，先检测数据库中是否有重名的
-            //没有重名的，进行增加数据，使用加密密码
-            string salt = generate_salt();
-            string hashed_password = hash_password(password, salt);
-            
-            char *sql_insert = (char *)malloc(sizeof(char) * 300);
-            strcpy(sql_insert, "INSERT INTO user(username, passwd) VALUES(");
-            strcat(sql_insert, "'");
-            strcat(sql_insert, name);
-            strcat(sql_insert, "', '");
-            strcat(sql_insert, hashed_password.c_str());
-            strcat(sql_insert, "')");
-
-            if (users.find(name) == users.end())
-            {
-                m_lock.lock();
-                int res = mysql_query(mysql, sql_insert);
-                users.insert(pair<string, string>(name, hashed_password));
-                user_roles[name] = "guest"; // 新注册用户默认为guest
-                m_lock.unlock();
-
-                if (!res)
-                    strcpy(m_url, "/log.html");
-                else
-                    strcpy(m_url, "/registerError.html");
-            }
+            if (!m_response.etag.empty())
+                m_etag = m_response.etag;
             else
-                strcpy(m_url, "/registerError.html");
-        }
-        //如果是登录，直接判断
-        //若浏览器端输入的用户名和密码在表中可以查找到，返回1，否则返回0
-        else if (*(p + 1) == '2')
-        {
-            if (users.find(name) != users.end() && verify_password(password, users[name]))
             {
-                // 登录成功，存储用户信息并返回特殊状态码
-                login_username = string(name);
-                login_role = user_roles[name];
-                strcpy(m_url, "/welcome.html");
-                // 不在这里直接设置m_url，而是返回特殊状态码让process_write处理
+                m_etag = content_etag(gzip_wanted());
+                if (not_modified(m_etag, -1))
+                    return NOT_MODIFIED;
             }
-            else
-                strcpy(m_url, "/logError.html");
         }
+        return CONTENT_REQUEST;
     }
+    return NO_RESOURCE;
+}
 
-    if (*(p + 1) == '0')
-    {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/register.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+http_conn::HTTP_CODE http_conn::do_static(const http_route &, const route_params &)
+{
+    string static_path = string(doc_root) + string(m_url);
+    strncpy(m_real_file, static_path.c_str(), FILENAME_LEN - 1);
+    return open_file();
+}
 
-        free(m_url_real);
-    }
-    else if (*(p + 1) == '1')
-    {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/log.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+//表单格式为user=123&passwd=123，字段缺失或超长时返回false
+bool http_conn::parse_credentials(char *name, char *password)
+{
+    //登录表单很小，请求体超出读缓冲区时视为错误请求
+    if (!m_string || strncmp(m_string, "user=", 5) != 0)
+        return false;
+    const char *amp = strchr(m_string + 5, '&');
+    if (!amp || amp - (m_string + 5) >= 100)
+        return false;
+    memcpy(name, m_string + 5, amp - (m_string + 5));
+    name[amp - (m_string + 5)] = '\0';
 
-        free(m_url_real);
-    }
-    else if (*(p + 1) == '5')
-    {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/picture.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+    const char *value = strchr(amp, '=');
+    if (!value || strlen(value + 1) >= 100)
+        return false;
+    strcpy(password, value + 1);
+    return true;
+}
 
-        free(m_url_real);
-    }
-    else if (*(p + 1) == '6')
-    {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/video.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+//登录：若浏览器端输入的用户名和密码在表中可以查找到，转到welcome页面，否则转到错误页面
+http_conn::HTTP_CODE http_conn::do_login(const http_route &, const route_params &)
+{
+    char name[100], password[100];
+    if (!parse_credentials(name, password))
+        return BAD_REQUEST;
 
-        free(m_url_real);
-    }
-    else if (*(p + 1) == '7')
+    if (users.find(name) != users.end() && verify_password(password, users[name]))
     {
-        // 原fans.html已改为弹出窗口，重定向到welcome页面
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/welcome.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
-
-        free(m_url_real);
+        // 登录成功，存储用户信息，由serve_file返回特殊状态码让process_write处理
+        login_username = string(name);
+        login_role = user_roles[name];
+        strcpy(m_url, "/welcome.html");
     }
     else
-        strncpy(m_real_file + len, m_url, FILENAME_LEN - len - 1);
-
-    if (stat(m_real_file, &m_file_stat) < 0)
-        return NO_RESOURCE;
+        strcpy(m_url, "/logError.html");
 
-    if (!(m_file_stat.st_mode & S_IROTH))
-        return FORBIDDEN_REQUEST;
+    int len = strlen(doc_root);
+    strncpy(m_real_file + len, m_url, FILENAME_LEN - len - 1);
+    return serve_file();
+}
 
-    if (S_ISDIR(m_file_stat.st_mode))
+//注册：先检测数据库中是否有重名的，没有重名的，进行增加数据，使用加密密码
+http_conn::HTTP_CODE http_conn::do_register(const http_route &, const route_params &)
+{
+    char name[100], password[100];
+    if (!parse_credentials(name, password))
         return BAD_REQUEST;
 
-    int fd = open(m_real_file, O_RDONLY);
-    m_file_address = (char *)mmap(0, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    close(fd);
+    string salt = generate_salt();
+    string hashed_password = hash_password(password, salt);
     
+    char *sql_insert = (char *)malloc(sizeof(char) * 300);
+    strcpy(sql_insert, "INSERT INTO user(username, passwd) VALUES(");
+    strcat(sql_insert, "'");
+    strcat(sql_insert, name);
+    strcat(sql_insert, "', '");
+    strcat(sql_insert, hashed_password.c_str());
+    strcat(sql_insert, "')");
+
+    if (users.find(name) == users.end())
+    {
+        m_lock.lock();
+        int res = mysql_query(mysql, sql_insert);
+        users.insert(pair<string, string>(name, hashed_password));
+        user_roles[name] = "guest"; // 新注册用户默认为guest
+        m_lock.unlock();
+
+        if (!res)
+            strcpy(m_url, "/log.html");
+        else
+            strcpy(m_url, "/registerError.html");
+    }
+    else
+        strcpy(m_url, "/registerError.html");
+    free(sql_insert);
+
+    int len = strlen(doc_root);
+    strncpy(m_real_file + len, m_url, FILENAME_LEN - len - 1);
+    return serve_file();
+}
+
+http_conn::HTTP_CODE http_conn::do_page(const http_route &route, const route_params &)
+{
+    int len = strlen(doc_root);
+    strncpy(m_real_file + len, route.page, FILENAME_LEN - len - 1);
+    return serve_file();
+}
+
+http_conn::HTTP_CODE http_conn::serve_file()
+{
+    HTTP_CODE ret = open_file();
+    if (ret != FILE_REQUEST)
+        return ret;
+
     // 检查是否是登录成功情况
     if (!login_username.empty() && strcmp(m_url, "/welcome.html") == 0) {
         return LOGIN_SUCCESS;
@@ -650,34 +983,294 @@ http_conn::HTTP_CODE http_conn::do_request()
     
     return FILE_REQUEST;
 }
-void http_conn::unmap()
+//通过file_cache取得m_real_file，小文件直接使用缓存中的映射，大文件使用缓存的fd
+http_conn::HTTP_CODE http_conn::open_file()
 {
-    if (m_file_address)
+    int err = file_cache::get_instance()->acquire(m_real_file, m_file);
+    if (ENOENT == err)
+        return NO_RESOURCE;
+    if (EACCES == err)
+        return FORBIDDEN_REQUEST;
+    if (EISDIR == err)
+        return BAD_REQUEST;
+    if (err)
+        return INTERNAL_ERROR;
+    if (m_accept_gzip)
+        m_file = file_cache::get_instance()->use_gzip(m_file);
+    //未修改时不映射也不发送文件
+    if (not_modified(m_file->etag, m_file->mtime))
+        return NOT_MODIFIED;
+
+    m_file_stat = m_file->st;
+    if (m_file->address)
     {
-        munmap(m_file_address, m_file_stat.st_size);
-        m_file_address = 0;
+        m_file_address = m_file->address;
     }
-}
-bool http_conn::write()
-{
-    int temp = 0;
-
-    if (bytes_to_send == 0)
+    else if (m_file_stat.st_size > 0 && !m_ring_driven)
     {
-        modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
-        init();
-        return true;
+        //大文件不映射，由write()从缓存的fd直接sendfile
+        m_sendfile = true;
+        m_file_offset = 0;
     }
+    else if (m_file_stat.st_size > 0)
+    {
+        //io_uring循环只提交writev，大文件仍按需映射
+        void *addr = mmap(0, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, m_file->fd, 0);
+        if (MAP_FAILED == addr)
+        {
+            unmap();
+            return INTERNAL_ERROR;
+        }
+        m_file_address = (char *)addr;
+        m_file_mapped = true;
+    }
+    if (m_range && GET == m_method)
+        return parse_range();
+    return FILE_REQUEST;
+}
+
+//解析Range头，得到按请求顺序排列的字节区间
+//语法错误、If-Range不匹配或多区间代价过高时忽略Range，返回整个文件
+http_conn::HTTP_CODE http_conn::parse_range()
+{
+    //If-Range须与ETag或Last-Modified完全相同
+    if (m_if_range && m_file->etag != m_if_range && m_file->last_modified != m_if_range)
+        return FILE_REQUEST;
+    if (strncasecmp(m_range, "bytes=", 6) != 0)
+        return FILE_REQUEST;
+
+    off_t size = m_file_stat.st_size;
+    off_t total = 0;
+    int specs = 0;
+    const char *p = m_range + 6;
+    while (*p)
+    {
+        p += strspn(p, " \t");
+        off_t start, end;
+        char *next;
+        if ('-' == *p)
+        {
+            //后缀区间：最后n个字节
+            if (!isdigit((unsigned char)p[1]))
+                break;
+            off_t n = strtoll(p + 1, &next, 10);
+            start = n >= size ? 0 : size - n;
+            end = n > 0 ? size - 1 : -1;
+        }
+        else
+        {
+            if (!isdigit((unsigned char)*p))
+                break;
+            start = strtoll(p, &next, 10);
+            if (*next != '-')
+                break;
+            p = next + 1;
+            end = size - 1;
+            if (isdigit((unsigned char)*p))
+            {
+                end = strtoll(p, &next, 10);
+                if (end < start)
+                    break;
+                if (end >= size)
+                    end = size - 1;
+            }
+            else
+                next = (char *)p;
+        }
+        p = next + strspn(next, " \t");
+        if (',' == *p)
+            ++p;
+        else if (*p)
+            break;
+
+        ++specs;
+        //起点超出文件的区间不可满足，跳过
+        if (start < size && start <= end)
+        {
+            m_ranges.push_back(make_pair(start, end));
+            total += end - start + 1;
+        }
+    }
+    if (*p || 0 == specs || m_ranges.size() > MAX_RANGES)
+    {
+        m_ranges.clear();
+        return FILE_REQUEST;
+    }
+    if (m_ranges.empty())
+        return RANGE_NOT_SATISFIABLE;
+    //多区间的响应体需拼接到内存中，只对已映射的文件且总量不超过文件两倍时支持
+    if (m_ranges.size() > 1 && (!m_file_address || total > 2 * size))
+    {
+        m_ranges.clear();
+        return FILE_REQUEST;
+    }
+    return PARTIAL_CONTENT;
+}
+//响应头之后发送文件中[offset, offset + length)的内容：映射的文件作为writev的第二段，sendfile时writev只发送响应头
+void http_conn::set_file_body(off_t offset, off_t length)
+{
+    m_iv[0].iov_base = m_write_buf;
+    m_iv[0].iov_len = m_write_idx;
+    m_iv_count = 1;
+    if (!m_sendfile)
+    {
+        m_iv[1].iov_base = m_file_address + offset;
+        m_iv[1].iov_len = length;
+        m_iv_count = 2;
+    }
+    m_file_offset = offset;
+    bytes_to_send = m_write_idx + length;
+}
+bool http_conn::gzip_wanted() const
+{
+    return m_gzip_level > 0 && m_accept_gzip && m_response.body_size() >= GZIP_MIN_BODY;
+}
+//把m_response_body原地换成gzip压缩后的数据，压缩器由每个线程复用
+bool http_conn::gzip_response_body()
+{
+    string compressed;
+    if (!gzip_encoder::local()->compress(m_response_body.data(), m_response_body.size(), compressed, m_gzip_level))
+        return false;
+    m_response_body.swap(compressed);
+    return true;
+}
+//m_response各段依次计算的64位FNV-1a摘要，与拼接后计算相同；gzip编码的表示另加-gz
+string http_conn::content_etag(bool gzip) const
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < m_response.body.size(); ++i)
+    {
+        const unsigned char *p = (const unsigned char *)m_response.body[i].data();
+        for (size_t j = 0; j < m_response.body[i].size(); ++j)
+        {
+            hash ^= p[j];
+            hash *= 1099511628211ULL;
+        }
+    }
+    char etag[40];
+    snprintf(etag, sizeof(etag), "\"%016llx%s\"", (unsigned long long)hash, gzip ? "-gz" : "");
+    return etag;
+}
+//条件GET：有If-None-Match时只看它，否则比较If-Modified-Since；mtime小于0表示没有修改时间
+bool http_conn::not_modified(const string &etag, time_t mtime) const
+{
+    if (GET != m_method)
+        return false;
+    if (m_if_none_match)
+        return etag_listed(m_if_none_match, etag);
+    time_t since;
+    if (m_if_modified_since && mtime >= 0 && parse_http_date(m_if_modified_since, since))
+        return mtime <= since;
+    return false;
+}
+//响应头之后发送m_response_body
+void http_conn::set_response_body()
+{
+    m_iv[0].iov_base = m_write_buf;
+    m_iv[0].iov_len = m_write_idx;
+    m_iv[1].iov_base = &m_response_body[0];
+    m_iv[1].iov_len = m_response_body.size();
+    m_iv_count = 2;
+    bytes_to_send = m_write_idx + m_response_body.size();
+}
+//响应头之后依次发送m_response的各段，每段一个iovec，借用的数据不复制
+void http_conn::set_segment_body()
+{
+    m_iv[0].iov_base = m_write_buf;
+    m_iv[0].iov_len = m_write_idx;
+    m_iv_count = 1;
+    for (size_t i = 0; i < m_response.body.size(); ++i)
+    {
+        m_iv[m_iv_count].iov_base = const_cast<char *>(m_response.body[i].data());
+        m_iv[m_iv_count].iov_len = m_response.body[i].size();
+        ++m_iv_count;
+    }
+    bytes_to_send = m_write_idx + m_response.body_size();
+}
+void http_conn::unmap()
+{
+    if (m_file_mapped)
+    {
+        munmap(m_file_address, m_file_stat.st_size);
+        m_file_mapped = false;
+    }
+    m_file_address = 0;
+    m_sendfile = false;
+    if (m_file)
+    {
+        file_cache::get_instance()->release(m_file);
+        m_file = NULL;
+    }
+}
+//io_uring的writev完成后推进发送进度
+//返回1表示仍有数据待发送，0表示发送完毕且保持连接，-1表示发送完毕需关闭连接
+int http_conn::written(int bytes)
+{
+    bytes_have_send += bytes;
+    bytes_to_send -= bytes;
+    if (bytes_to_send > 0)
+    {
+        advance_iov(bytes);
+        return 1;
+    }
+    if (m_h2)
+    {
+        if (h2_refill())
+            return 1;
+        return m_h2->closing() ? -1 : 0;
+    }
+
+    unmap();
+    if (m_linger)
+    {
+        next_request();
+        return 0;
+    }
+    return -1;
+}
+
+//按本次写出的字节数推进iovec：写完的段长度变为0，写了一部分的段前移
+//sendfile写出的文件内容不在iovec中，此时各段长度已为0，不受影响
+void http_conn::advance_iov(int bytes)
+{
+    for (int i = 0; i < m_iv_count && bytes > 0; ++i)
+    {
+        size_t n = m_iv[i].iov_len < (size_t)bytes ? m_iv[i].iov_len : (size_t)bytes;
+        m_iv[i].iov_base = (char *)m_iv[i].iov_base + n;
+        m_iv[i].iov_len -= n;
+        bytes -= n;
+    }
+}
+
+bool http_conn::write()
+{
+    int temp = 0;
+
+    //流式响应可能在处理时已全部写出
+    if (bytes_to_send == 0)
+        return finish_response();
 
     while (1)
     {
-        temp = writev(m_sockfd, m_iv, m_iv_count);
+        //响应头发完后，文件内容由内核从页缓存直接送入socket
+        if (m_sendfile && bytes_have_send >= m_write_idx)
+        {
+            temp = sendfile(m_sockfd, m_file->fd, &m_file_offset, bytes_to_send);
+            //文件在发送期间被截短
+            if (0 == temp)
+            {
+                unmap();
+                return false;
+            }
+        }
+        else
+            temp = writev(m_sockfd, m_iv, m_iv_count);
 
         if (temp < 0)
         {
             if (errno == EAGAIN)
             {
-                modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
+                arm(EPOLLOUT);
                 return true;
             }
             unmap();
@@ -686,116 +1279,408 @@ bool http_conn::write()
 
         bytes_have_send += temp;
         bytes_to_send -= temp;
-        if (bytes_have_send >= m_iv[0].iov_len)
-        {
-            m_iv[0].iov_len = 0;
-            m_iv[1].iov_base = m_file_address + (bytes_have_send - m_write_idx);
-            m_iv[1].iov_len = bytes_to_send;
-        }
-        else
-        {
-            m_iv[0].iov_base = m_write_buf + bytes_have_send;
-            m_iv[0].iov_len = m_iv[0].iov_len - bytes_have_send;
-        }
+        advance_iov(temp);
 
         if (bytes_to_send <= 0)
         {
-            unmap();
-            modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
-
-            if (m_linger)
-            {
-                init();
-                return true;
-            }
-            else
-            {
-                return false;
-            }
+            //HTTP/2连接写完一批后接着发送受窗口限制而未发出的DATA帧
+            if (m_h2 && h2_refill())
+                continue;
+            return finish_response();
         }
     }
 }
-bool http_conn::add_response(const char *format, ...)
+//响应发送完毕：不保持连接时返回false；缓冲区中已有下一个请求时由调用者接着处理，暂不注册读事件，避免与处理线程并发读取
+bool http_conn::finish_response()
 {
-    if (m_write_idx >= WRITE_BUFFER_SIZE)
-        return false;
-    va_list arg_list;
-    va_start(arg_list, format);
-    int len = vsnprintf(m_write_buf + m_write_idx, WRITE_BUFFER_SIZE - 1 - m_write_idx, format, arg_list);
-    if (len >= (WRITE_BUFFER_SIZE - 1 - m_write_idx))
+    unmap();
+    //HTTP/2连接没有流水线请求，写完后等待对端的帧
+    if (m_h2)
+    {
+        arm(EPOLLIN);
+        return !m_h2->closing();
+    }
+    if (!m_linger)
     {
-        va_end(arg_list);
+        arm(EPOLLIN);
         return false;
     }
-    m_write_idx += len;
-    va_end(arg_list);
+    if (next_request())
+        return true;
+    arm(EPOLLIN);
+    return true;
+}
+//响应头中的固定内容预先拼好，生成响应时只做memcpy
+#define HEADER_LINE(str) {str, sizeof(str) - 1}
+struct header_line
+{
+    const char *data;
+    int len;
+};
+
+struct status_entry
+{
+    int status;
+    header_line line;
+};
+static const status_entry status_lines[] = {
+    {200, HEADER_LINE("HTTP/1.1 200 OK\r\n")},
+    {206, HEADER_LINE("HTTP/1.1 206 Partial Content\r\n")},
+    {304, HEADER_LINE("HTTP/1.1 304 Not Modified\r\n")},
+    {400, HEADER_LINE("HTTP/1.1 400 Bad Request\r\n")},
+    {403, HEADER_LINE("HTTP/1.1 403 Forbidden\r\n")},
+    {404, HEADER_LINE("HTTP/1.1 404 Not Found\r\n")},
+    {413, HEADER_LINE("HTTP/1.1 413 Payload Too Large\r\n")},
+    {416, HEADER_LINE("HTTP/1.1 416 Range Not Satisfiable\r\n")},
+    {500, HEADER_LINE("HTTP/1.1 500 Internal Error\r\n")},
+};
+//博客处理器给出的其他状态码的原因短语，表中的状态码由add_status_line直接取整行
+//原因短语可以为空，客户端只看状态码
+static const char *status_title(int status)
+{
+    switch (status)
+    {
+    case 201:
+        return "Created";
+    case 204:
+        return "No Content";
+    case 401:
+        return "Unauthorized";
+    case 405:
+        return "Method Not Allowed";
+    case 409:
+        return "Conflict";
+    case 503:
+        return "Service Unavailable";
+    default:
+        return "";
+    }
+}
+
+static const header_line content_type_html = HEADER_LINE("Content-Type:text/html\r\n");
+static const header_line connection_keep_alive = HEADER_LINE("Connection:keep-alive\r\n");
+static const header_line connection_close = HEADER_LINE("Connection:close\r\n");
+static const header_line content_length_prefix = HEADER_LINE("Content-Length:");
+static const header_line vary_accept_encoding = HEADER_LINE("Vary:Accept-Encoding\r\n");
+static const header_line content_encoding_gzip = HEADER_LINE("Content-Encoding:gzip\r\n");
+static const header_line transfer_encoding_chunked = HEADER_LINE("Transfer-Encoding:chunked\r\n");
+
+//非负整数转十进制，返回写入的字节数，dst至少需要20字节
+static int format_uint(char *dst, unsigned long value)
+{
+    char tmp[20];
+    int n = 0;
+    do
+    {
+        tmp[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    for (int i = 0; i < n; ++i)
+        dst[i] = tmp[n - 1 - i];
+    return n;
+}
+
+static void append_uint(string &out, unsigned long value)
+{
+    char num[20];
+    out.append(num, format_uint(num, value));
+}
 
-    LOG_INFO("request:%s", m_write_buf);
+static void append_content_range(string &out, off_t start, off_t end, off_t size)
+{
+    out.append("Content-Range:bytes ");
+    append_uint(out, start);
+    out.push_back('-');
+    append_uint(out, end);
+    out.push_back('/');
+    append_uint(out, size);
+    out.append("\r\n");
+}
+
+//写缓冲区剩余空间不足len时换成buffer_pool中足够大的一级，超过最大一级返回false
+bool http_conn::reserve_write(int len)
+{
+    if (!attach_buffer(m_write_buf, m_write_cap))
+        return false;
+    if (m_write_idx + len <= m_write_cap)
+        return true;
 
+    int cls = buffer_pool::size_class(m_write_idx + len);
+    if (cls < 0)
+        return false;
+    buffer_pool *pool = buffer_pool::get_instance();
+    char *buf = pool->acquire(buffer_pool::CLASS_SIZE[cls]);
+    if (!buf)
+        return false;
+    memcpy(buf, m_write_buf, m_write_idx);
+    pool->release(m_write_buf, m_write_cap);
+    m_write_buf = buf;
+    m_write_cap = buffer_pool::CLASS_SIZE[cls];
+    return true;
+}
+bool http_conn::add_bytes(const char *data, int len)
+{
+    if (!reserve_write(len))
+        return false;
+    memcpy(m_write_buf + m_write_idx, data, len);
+    m_write_idx += len;
     return true;
 }
 bool http_conn::add_status_line(int status, const char *title)
 {
-    return add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
+    for (size_t i = 0; i < sizeof(status_lines) / sizeof(status_lines[0]); ++i)
+    {
+        if (status_lines[i].status == status)
+            return add_bytes(status_lines[i].line.data, status_lines[i].line.len);
+    }
+
+    //不在表中的状态码现场拼接
+    int title_len = strlen(title);
+    if (!reserve_write(9 + 20 + 1 + title_len + 2))
+        return false;
+    char *p = m_write_buf + m_write_idx;
+    memcpy(p, "HTTP/1.1 ", 9);
+    p += 9;
+    p += format_uint(p, status);
+    *p++ = ' ';
+    memcpy(p, title, title_len);
+    p += title_len;
+    *p++ = '\r';
+    *p++ = '\n';
+    m_write_idx = p - m_write_buf;
+    return true;
 }
-bool http_conn::add_headers(int content_len)
+bool http_conn::add_headers(long content_len)
 {
     return add_content_length(content_len) && add_linger() &&
            add_blank_line();
 }
-bool http_conn::add_content_length(int content_len)
+bool http_conn::add_content_length(long content_len)
 {
-    return add_response("Content-Length:%d\r\n", content_len);
+    if (!reserve_write(content_length_prefix.len + 20 + 2))
+        return false;
+    char *p = m_write_buf + m_write_idx;
+    memcpy(p, content_length_prefix.data, content_length_prefix.len);
+    p += content_length_prefix.len;
+    p += format_uint(p, content_len < 0 ? 0 : content_len);
+    *p++ = '\r';
+    *p++ = '\n';
+    m_write_idx = p - m_write_buf;
+    return true;
+}
+bool http_conn::add_etag()
+{
+    string line = "ETag:" + m_etag + "\r\n";
+    return add_bytes(line.data(), line.size());
 }
 bool http_conn::add_content_type()
 {
-    // 根据文件扩展名设置正确的Content-Type
-    const char* ext = strrchr(m_real_file, '.');
-    const char* content_type = "text/html";
-    
-    if (ext) {
-        if (strcmp(ext, ".pdf") == 0) {
-            content_type = "application/pdf";
-        }
-        else if (strcmp(ext, ".jpg") == 0 || strcmp(ext, ".jpeg") == 0) {
-            content_type = "image/jpeg";
-        }
-        else if (strcmp(ext, ".png") == 0) {
-            content_type = "image/png";
-        }
-        else if (strcmp(ext, ".gif") == 0) {
-            content_type = "image/gif";
-        }
-        else if (strcmp(ext, ".css") == 0) {
-            content_type = "text/css; charset=utf-8";
-        }
-        else if (strcmp(ext, ".js") == 0) {
-            content_type = "application/javascript; charset=utf-8";
-        }
-        else if (strcmp(ext, ".mp4") == 0) {
-            content_type = "video/mp4";
-        }
+    //文件的Content-Type在file_cache中按扩展名预先生成，动态内容为html
+    if (m_file)
+        return add_bytes(m_file->type_line.data(), m_file->type_line.size());
+    return add_bytes(content_type_html.data, content_type_html.len);
+}
+//博客响应的Content-Type与Cache-Control，html沿用预先拼好的行
+bool http_conn::add_response_type()
+{
+    string lines;
+    if (strcmp(m_response.content_type, "text/html") == 0)
+        lines.assign(content_type_html.data, content_type_html.len);
+    else
+        lines.append("Content-Type:").append(m_response.content_type).append("\r\n");
+    if (m_response.cache_control)
+        lines.append("Cache-Control:").append(m_response.cache_control).append("\r\n");
+    return add_bytes(lines.data(), lines.size());
+}
+//206响应头；多区间时把各区间连同分隔行拼成multipart/byteranges响应体
+bool http_conn::add_partial_headers()
+{
+    off_t size = m_file_stat.st_size;
+    string lines;
+    if (1 == m_ranges.size())
+    {
+        off_t start = m_ranges[0].first, end = m_ranges[0].second;
+        lines = m_file->type_line + m_file->meta_lines;
+        append_content_range(lines, start, end, size);
+        return add_bytes(lines.data(), lines.size()) && add_headers(end - start + 1);
     }
-    
-    return add_response("Content-Type:%s\r\n", content_type);
+
+    string boundary("byteranges_");
+    append_uint(boundary, (unsigned long)m_file_stat.st_ino);
+    boundary.push_back('_');
+    append_uint(boundary, (unsigned long)m_file_stat.st_mtime);
+
+    m_response_body.clear();
+    for (size_t i = 0; i < m_ranges.size(); ++i)
+    {
+        off_t start = m_ranges[i].first, end = m_ranges[i].second;
+        m_response_body.append("\r\n--").append(boundary).append("\r\n");
+        m_response_body.append(m_file->type_line);
+        append_content_range(m_response_body, start, end, size);
+        m_response_body.append("\r\n");
+        m_response_body.append(m_file_address + start, end - start + 1);
+    }
+    m_response_body.append("\r\n--").append(boundary).append("--\r\n");
+
+    lines = "Content-Type:multipart/byteranges; boundary=" + boundary + "\r\n" + m_file->meta_lines;
+    return add_bytes(lines.data(), lines.size()) && add_headers(m_response_body.size());
+}
+//文件的Content-Type与Content-Length在file_cache中预先拼好
+bool http_conn::add_file_headers()
+{
+    return add_bytes(m_file->headers.data(), m_file->headers.size()) && add_linger() && add_blank_line();
 }
 bool http_conn::add_linger()
 {
-    return add_response("Connection:%s\r\n", (m_linger == true) ? "keep-alive" : "close");
+    const header_line &line = m_linger ? connection_keep_alive : connection_close;
+    return add_bytes(line.data, line.len);
 }
 bool http_conn::add_blank_line()
 {
-    return add_response("%s", "\r\n");
+    return add_bytes("\r\n", 2);
 }
 
+//Set-Cookie可能较长，超出写缓冲区时由reserve_write换用更大的缓冲区
 bool http_conn::add_cookie(const string& name, const string& value, int max_age)
 {
-    return add_response("Set-Cookie: %s=%s; Max-Age=%d; Path=/\r\n", 
-                       name.c_str(), value.c_str(), max_age);
+    string line;
+    line.reserve(name.size() + value.size() + 48);
+    line.append("Set-Cookie: ").append(name).append("=").append(value).append("; Max-Age=");
+    char num[20];
+    line.append(num, format_uint(num, max_age < 0 ? 0 : max_age));
+    line.append("; Path=/\r\n");
+    return add_bytes(line.data(), line.size());
 }
 bool http_conn::add_content(const char *content)
 {
-    return add_response("%s", content);
+    return add_bytes(content, strlen(content));
+}
+//GET时流式发送：支持流式输出的页面在渲染前已给出ETag并处理了条件请求
+//io_uring驱动的连接由循环提交writev，HTTP/2的响应由会话分帧，都不在处理过程中直接写socket
+bool http_conn::stream_wanted() const
+{
+    return GET == m_method && !m_ring_driven && !m_h2;
+}
+void chunk_writer::write(const string &data)
+{
+    m_conn->stream_chunk(data.data(), data.size());
+}
+void chunk_writer::set_etag(const string &etag)
+{
+    m_conn->m_etag = etag;
+}
+//首个chunk到来时才发出响应头，渲染出错时处理器仍可返回完整的错误页
+void http_conn::start_stream()
+{
+    //请求数上限在process_read之后才检查，响应头先于它发出，这里提前判断
+    if (m_max_requests > 0 && m_requests + 1 >= m_max_requests)
+        m_linger = false;
+    m_stream_gzip = m_gzip_level > 0 && m_accept_gzip && gzip_encoder::local()->begin(m_gzip_level);
+
+    add_status_line(200, ok_200_title);
+    add_content_type();
+    if (m_gzip_level > 0)
+        add_bytes(vary_accept_encoding.data, vary_accept_encoding.len);
+    if (m_stream_gzip)
+        add_bytes(content_encoding_gzip.data, content_encoding_gzip.len);
+    if (!m_etag.empty())
+        add_etag();
+    add_bytes(transfer_encoding_chunked.data, transfer_encoding_chunked.len);
+    add_linger();
+    if (!add_blank_line())
+    {
+        m_stream_failed = true;
+        return;
+    }
+    //m_response_body保存尚未写出的字节，发送完的前缀随即删除
+    m_response_body.assign(m_write_buf, m_write_idx);
+    m_write_idx = 0;
+    m_streaming = true;
+}
+//把一段输出按chunked编码(十六进制长度、CRLF、数据、CRLF)追加到待发送数据，finish时一并写出gzip尾部
+bool http_conn::append_chunk(const char *data, size_t len, bool finish)
+{
+    string compressed;
+    if (m_stream_gzip)
+    {
+        if (!gzip_encoder::local()->append(data, len, compressed, finish))
+            return false;
+        data = compressed.data();
+        len = compressed.size();
+    }
+    if (0 == len)
+        return true;
+    char size_line[20];
+    m_response_body.append(size_line, snprintf(size_line, sizeof(size_line), "%zx\r\n", len));
+    m_response_body.append(data, len);
+    m_response_body.append("\r\n");
+    return true;
+}
+void http_conn::stream_chunk(const char *data, size_t len)
+{
+    if (!m_streaming && !m_stream_failed)
+        start_stream();
+    if (m_stream_failed || 0 == len)
+        return;
+    if (!append_chunk(data, len, false))
+    {
+        m_stream_failed = true;
+        return;
+    }
+    flush_stream();
+}
+//处理器返回的剩余各段作为最后的数据chunk，随后是结束chunk，不单独写socket，由write()照常发出
+//响应头已经发出，剩余部分的状态码与头部不再起作用
+void http_conn::end_stream(const Response &rest)
+{
+    if (m_stream_failed)
+        return;
+    for (size_t i = 0; i < rest.body.size(); ++i)
+    {
+        if (!append_chunk(rest.body[i].data(), rest.body[i].size(), false))
+        {
+            m_stream_failed = true;
+            return;
+        }
+    }
+    if (!append_chunk(NULL, 0, true))
+    {
+        m_stream_failed = true;
+        return;
+    }
+    m_response_body.append("0\r\n\r\n");
+}
+//非阻塞地写出已生成的chunk，写不完的留在m_response_body中
+//线程池中的工作线程积压超过STREAM_BUFFER_LIMIT时等待socket可写，慢客户端因此拖慢渲染而不是让内存无限增长
+//循环线程自驱动时不能阻塞，只积压在内存中
+void http_conn::flush_stream()
+{
+    size_t sent = 0;
+    while (sent < m_response_body.size())
+    {
+        ssize_t n = send(m_sockfd, m_response_body.data() + sent, m_response_body.size() - sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n > 0)
+        {
+            sent += n;
+            continue;
+        }
+        if (n < 0 && EINTR == errno)
+            continue;
+        if (n < 0 && (EAGAIN == errno || EWOULDBLOCK == errno))
+        {
+            if (!m_one_shot || m_response_body.size() - sent < STREAM_BUFFER_LIMIT)
+                break;
+            struct pollfd pfd;
+            pfd.fd = m_sockfd;
+            pfd.events = POLLOUT;
+            pfd.revents = 0;
+            if (poll(&pfd, 1, STREAM_WAIT_MS) > 0)
+                continue;
+        }
+        m_stream_failed = true;
+        break;
+    }
+    m_response_body.erase(0, sent);
 }
 bool http_conn::process_write(HTTP_CODE ret)
 {
@@ -811,12 +1696,24 @@ bool http_conn::process_write(HTTP_CODE ret)
     }
     case BAD_REQUEST:
     {
+        //无法确定请求边界，后续数据不能再按请求解析
+        m_linger = false;
         add_status_line(404, error_404_title);
         add_headers(strlen(error_404_form));
         if (!add_content(error_404_form))
             return false;
         break;
     }
+    case BODY_TOO_LARGE:
+    {
+        //请求体未读取，连接无法继续复用
+        m_linger = false;
+        add_status_line(413, error_413_title);
+        add_headers(strlen(error_413_form));
+        if (!add_content(error_413_form))
+            return false;
+        break;
+    }
     case FORBIDDEN_REQUEST:
     {
         add_status_line(403, error_403_title);
@@ -830,14 +1727,8 @@ bool http_conn::process_write(HTTP_CODE ret)
         add_status_line(200, ok_200_title);
         if (m_file_stat.st_size != 0)
         {
-            add_content_type();
-            add_headers(m_file_stat.st_size);
-            m_iv[0].iov_base = m_write_buf;
-            m_iv[0].iov_len = m_write_idx;
-            m_iv[1].iov_base = m_file_address;
-            m_iv[1].iov_len = m_file_stat.st_size;
-            m_iv_count = 2;
-            bytes_to_send = m_write_idx + m_file_stat.st_size;
+            add_file_headers();
+            set_file_body(0, m_file_stat.st_size);
             return true;
         }
         else
@@ -855,17 +1746,14 @@ bool http_conn::process_write(HTTP_CODE ret)
         
         add_status_line(200, ok_200_title);
         add_content_type();
+        //open_file可能已换成gzip变体，Content-Encoding与Vary随文件发送
+        add_bytes(m_file->meta_lines.data(), m_file->meta_lines.size());
         add_cookie("session_id", session_id, UserSession::SESSION_TIMEOUT);
         
         if (m_file_stat.st_size != 0)
         {
             add_headers(m_file_stat.st_size);
-            m_iv[0].iov_base = m_write_buf;
-            m_iv[0].iov_len = m_write_idx;
-            m_iv[1].iov_base = m_file_address;
-            m_iv[1].iov_len = m_file_stat.st_size;
-            m_iv_count = 2;
-            bytes_to_send = m_write_idx + m_file_stat.st_size;
+            set_file_body(0, m_file_stat.st_size);
             
             // 清理登录信息
             login_username.clear();
@@ -887,6 +1775,88 @@ bool http_conn::process_write(HTTP_CODE ret)
         }
         break;
     }
+    case CONTENT_REQUEST:
+    {
+        add_status_line(m_response.status, status_title(m_response.status));
+        add_response_type();
+        if (m_gzip_level > 0)
+            add_bytes(vary_accept_encoding.data, vary_accept_encoding.len);
+        //压缩需要连续的输入，段数超出iovec时也先拼接，其余情况各段直接发送
+        bool gzip = gzip_wanted();
+        if (!gzip && m_response.body.size() < (size_t)MAX_IOV)
+        {
+            if (!m_etag.empty())
+                add_etag();
+            add_headers(m_response.body_size());
+            set_segment_body();
+            return true;
+        }
+        m_response_body = m_response.flatten();
+        if (gzip)
+        {
+            if (gzip_response_body())
+                add_bytes(content_encoding_gzip.data, content_encoding_gzip.len);
+            else if (m_etag.size() > 4 && m_etag.compare(m_etag.size() - 4, 4, "-gz\"") == 0)
+                m_etag.erase(m_etag.size() - 4, 3);
+        }
+        if (!m_etag.empty())
+            add_etag();
+        add_headers(m_response_body.size());
+        set_response_body();
+        return true;
+    }
+    case STREAM_REQUEST:
+    {
+        if (m_stream_failed)
+            return false;
+        //响应头已发出，只剩m_response_body中未写完的chunk
+        m_write_idx = 0;
+        set_response_body();
+        return true;
+    }
+    case PARTIAL_CONTENT:
+    {
+        add_status_line(206, ok_206_title);
+        if (!add_partial_headers())
+            return false;
+        if (1 == m_ranges.size())
+            set_file_body(m_ranges[0].first, m_ranges[0].second - m_ranges[0].first + 1);
+        else
+            set_response_body();
+        return true;
+    }
+    case NOT_MODIFIED:
+    {
+        add_status_line(304, ok_304_title);
+        if (m_file)
+        {
+            add_bytes(m_file->validators.data(), m_file->validators.size());
+        }
+        else
+        {
+            add_etag();
+            if (m_response.cache_control)
+            {
+                string line = string("Cache-Control:") + m_response.cache_control + "\r\n";
+                add_bytes(line.data(), line.size());
+            }
+            if (m_gzip_level > 0)
+                add_bytes(vary_accept_encoding.data, vary_accept_encoding.len);
+        }
+        add_linger();
+        add_blank_line();
+        break;
+    }
+    case RANGE_NOT_SATISFIABLE:
+    {
+        add_status_line(416, error_416_title);
+        string line("Content-Range:bytes */");
+        append_uint(line, m_file_stat.st_size);
+        line.append("\r\n");
+        add_bytes(line.data(), line.size());
+        add_headers(0);
+        break;
+    }
     default:
         return false;
     }
@@ -896,20 +1866,161 @@ bool http_conn::process_write(HTTP_CODE ret)
     bytes_to_send = m_write_idx;
     return true;
 }
-void http_conn::process()
+//返回true表示已生成响应，等待写出
+bool http_conn::process()
 {
+    if (m_h2)
+        return process_h2();
+    m_pipelined = false;
+    //连接以HTTP/2前言开头时按h2c先验知识处理
+    long preface = m_read_idx < (long)h2_session::PREFACE_LEN ? m_read_idx : (long)h2_session::PREFACE_LEN;
+    if (0 == m_requests && CHECK_STATE_REQUESTLINE == m_check_state && preface > 0 &&
+        memcmp(m_read_buf, h2_session::PREFACE, preface) == 0)
+    {
+        if (m_read_idx < (long)h2_session::PREFACE_LEN)
+        {
+            arm(EPOLLIN);
+            return false;
+        }
+        m_h2 = new h2_session(m_max_body);
+        m_h2->start();
+        return process_h2();
+    }
     HTTP_CODE read_ret = process_read();
     if (read_ret == NO_REQUEST)
     {
-        modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
-        return;
+        arm(EPOLLIN);
+        return false;
     }
+    //请求数总是计数，h2c前言只在首个请求上识别；达到单连接请求数上限时本次响应后关闭
+    ++m_requests;
+    if (m_max_requests > 0 && m_requests >= m_max_requests)
+        m_linger = false;
     bool write_ret = process_write(read_ret);
     if (!write_ret)
     {
         close_conn();
+        return false;
+    }
+    if (m_upgrade_h2c && m_http2_settings && 0 == m_content_length && BAD_REQUEST != read_ret && BODY_TOO_LARGE != read_ret)
+    {
+        if (upgrade_h2c())
+            return process_h2();
+    }
+    //循环线程自驱动时由调用者直接write，仅在写缓冲区满时才注册EPOLLOUT
+    if (m_one_shot)
+        arm(EPOLLOUT);
+    return true;
+}
+
+//Upgrade:h2c：已按HTTP/1.1生成的响应转给流1，请求之后已收到的字节(客户端前言等)留在读缓冲区开头
+//HTTP2-Settings无法解析时不升级，照常返回HTTP/1.1响应
+bool http_conn::upgrade_h2c()
+{
+    h2_session *session = new h2_session(m_max_body);
+    if (!session->upgrade(m_http2_settings))
+    {
+        delete session;
+        return false;
     }
-    modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
+    m_h2 = session;
+    h2_respond(1);
+    MYSQL *sql = mysql;
+    next_request();
+    mysql = sql;
+    return true;
+}
+
+//HTTP/2连接：收到的字节全部交给会话，已收全的请求逐个按HTTP/1.1报文解析处理，再取出待发送的帧
+bool http_conn::process_h2()
+{
+    m_pipelined = false;
+    bool ok = true;
+    if (m_read_idx > 0)
+        ok = m_h2->feed(m_read_buf, m_read_idx);
+    if (ok && !m_body_chain.empty())
+    {
+        string rest;
+        m_body_chain.append_to(rest);
+        ok = m_h2->feed(rest.data(), rest.size());
+    }
+
+    //init会清空mysql，处理期间保留调用者取得的数据库连接
+    MYSQL *sql = mysql;
+    int stream_id;
+    string request;
+    while (ok && m_h2->next_request(stream_id, request))
+    {
+        init();
+        mysql = sql;
+        HTTP_CODE ret = BODY_TOO_LARGE;
+        if (append_read(request.data(), request.size()))
+        {
+            ret = process_read();
+            if (NO_REQUEST == ret)
+                ret = BAD_REQUEST;
+        }
+        if (!process_write(ret))
+        {
+            init();
+            mysql = sql;
+            process_write(INTERNAL_ERROR);
+        }
+        h2_respond(stream_id);
+    }
+    init();
+    mysql = sql;
+
+    if (m_h2->produce(m_response_body))
+    {
+        set_response_body();
+        if (m_one_shot)
+            arm(EPOLLOUT);
+        return true;
+    }
+    if (m_h2->closing())
+    {
+        close_conn();
+        return false;
+    }
+    arm(EPOLLIN);
+    return false;
+}
+
+//process_write生成的HTTP/1.1响应交给会话：写缓冲区中的响应头连同其后的短响应体一起转换
+//m_response_body整体转交，文件响应转交m_file的引用，由会话按发送窗口分帧
+void http_conn::h2_respond(int stream_id)
+{
+    string body;
+    file_entry *file = NULL;
+    off_t offset = 0;
+    size_t length = bytes_to_send - m_write_idx;
+    if (2 == m_iv_count && !m_response_body.empty() && m_iv[1].iov_base == &m_response_body[0])
+    {
+        body.swap(m_response_body);
+    }
+    else if (length > 0 && !m_file && !m_response.empty())
+    {
+        //分段的博客响应拼成一个响应体
+        body = m_response.flatten();
+    }
+    else if (length > 0 && m_file)
+    {
+        file = m_file;
+        m_file = NULL;
+        offset = m_sendfile ? m_file_offset : (char *)m_iv[1].iov_base - m_file_address;
+    }
+    m_h2->respond(stream_id, m_write_buf, m_write_idx, body, file, offset, file ? length : 0);
+}
+
+//上一批帧已写完，取出后续的帧，没有可发送的数据时返回false
+bool http_conn::h2_refill()
+{
+    init();
+    if (!m_h2->produce(m_response_body))
+        return false;
+    set_response_body();
+    return true;
 }
 
 // Session管理功能实现
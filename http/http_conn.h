@@ -19,13 +19,25 @@
 #include <errno.h>
 #include <sys/wait.h>
 #include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <poll.h>
 #include <map>
+#include <vector>
+#include <ctype.h>
+#include <atomic>
 
 #include "../lock/locker.h"
 #include "../CGImysql/sql_connection_pool.h"
 #include "../timer/lst_timer.h"
 #include "../log/log.h"
 #include "../blog/blog_handler.h"
+#include "../buffer/buffer_pool.h"
+#include "../buffer/chain_buffer.h"
+#include "../cache/file_cache.h"
+#include "../compress/gzip_encoder.h"
+#include "../http2/h2_session.h"
+#include "../router/route_trie.h"
+#include "../scan/http_scan.h"
 #include <unordered_map>
 #include <random>
 #include <openssl/sha.h>
@@ -60,13 +72,33 @@ struct UserSession {
     }
 };
 
+class http_conn;
+
+//blog分段渲染时的输出，每段作为一个chunk交给连接发送
+class chunk_writer : public ResponseSink
+{
+public:
+    explicit chunk_writer(http_conn *conn) : m_conn(conn) {}
+    void write(const string &data);
+    void set_etag(const string &etag);
+
+private:
+    http_conn *m_conn;
+};
+
 class http_conn
 {
     friend class HttpConnTestAccessor;  // 测试访问器类，提供对私有成员的访问
+    friend class chunk_writer;
 public:
     static const int FILENAME_LEN = 200;
+    static const size_t GZIP_MIN_BODY = 1024;  //更小的动态响应不压缩
     static const int READ_BUFFER_SIZE = 4096;
     static const int WRITE_BUFFER_SIZE = 1024;
+    static const size_t MAX_RANGES = 16;
+    static const size_t STREAM_BUFFER_LIMIT = 64 * 1024;  //流式响应积压超过该值时工作线程等待socket可写
+    static const int STREAM_WAIT_MS = 5000;                //等待可写的超时，超时视为客户端失去响应
+    static const int MAX_IOV = 16;  //响应头加上响应体各段，段数更多时先拼接
     enum METHOD
     {
         GET = 0,
@@ -93,9 +125,15 @@ public:
         NO_RESOURCE,
         FORBIDDEN_REQUEST,
         FILE_REQUEST,
+        CONTENT_REQUEST,  //博客处理器的响应在m_response中
+        PARTIAL_CONTENT,  //m_ranges中的文件区间
+        RANGE_NOT_SATISFIABLE,
+        NOT_MODIFIED,     //条件GET命中，只发送304与校验头
+        STREAM_REQUEST,   //响应头与部分chunk已在处理时发出，m_response_body为剩余部分
         LOGIN_SUCCESS,
         INTERNAL_ERROR,
-        CLOSED_CONNECTION
+        CLOSED_CONNECTION,
+        BODY_TOO_LARGE
     };
     enum LINE_STATUS
     {
@@ -103,23 +141,85 @@ public:
         LINE_BAD,
         LINE_OPEN
     };
+    //路由表中的一项：处理函数，以及固定页面路由对应的文件
+    struct http_route
+    {
+        HTTP_CODE (http_conn::*handler)(const http_route &route, const route_params &params);
+        const char *page;
+    };
 
 public:
-    http_conn() {}
-    ~http_conn() {}
+    http_conn() : m_sockfd(-1), m_serial(0), m_read_buf(NULL), m_write_buf(NULL), m_write_cap(WRITE_BUFFER_SIZE), m_real_file(NULL),
+                  m_file_address(NULL), m_file(NULL), m_file_mapped(false), m_sendfile(false), m_file_offset(0),
+                  m_loop_epollfd(-1), m_one_shot(true), m_ring_driven(false), m_armed_ev(0), m_h2(NULL) {}
+    ~http_conn()
+    {
+        release_buffers();
+        delete m_h2;
+    }
 
 public:
-    void init(int sockfd, const sockaddr_in &addr, char *, int, int, string user, string passwd, string sqlname);
+    void init(int sockfd, const sockaddr_in &addr, char *, int, int);
+    //绑定连接所属的事件循环，需在init之前调用
+    //epollfd为-1时使用全局m_epollfd；one_shot为false时由所属循环线程直接驱动读写，不再逐次重置EPOLLONESHOT
+    void bind_loop(int epollfd, bool one_shot);
+    //由io_uring循环驱动：不注册epoll，读写由循环线程提交，需在init之前调用
+    void bind_ring();
     void close_conn(bool real_close = true);
-    void process();
+    bool process();
     bool read_once();
     bool write();
+    //io_uring驱动时使用的读写接口
+    bool append_read(const char *data, int len);
+    struct iovec *get_iov(int &count)
+    {
+        count = m_iv_count;
+        return m_iv;
+    }
+    bool is_writing() const
+    {
+        return bytes_to_send > 0;
+    }
+    int written(int bytes);
     sockaddr_in *get_address()
     {
         return &m_address;
     }
+    int get_sockfd() const
+    {
+        return m_sockfd;
+    }
+    unsigned int get_serial() const
+    {
+        return m_serial;
+    }
+    //连接fd在epoll中的data：低32位为fd(与data.fd重合)，高32位为连接序号
+    //各循环共享按fd索引的连接数组，循环线程据此丢弃属于已关闭或已被复用的连接的旧事件
+    static uint64_t event_data(int sockfd, unsigned int serial)
+    {
+        return ((uint64_t)serial << 32) | (uint32_t)sockfd;
+    }
+    static int event_fd(uint64_t data)
+    {
+        return (int)(uint32_t)data;
+    }
+    static unsigned int event_serial(uint64_t data)
+    {
+        return (unsigned int)(data >> 32);
+    }
+    //响应写完后读缓冲区中已有下一个流水线请求，调用者需直接process，不会再有读事件通知
+    bool has_pending() const
+    {
+        return m_pipelined;
+    }
+    //请求体：较小时整体位于读缓冲区，body_view返回以'\0'结尾的连续内存
+    //超出读缓冲区时body_view返回NULL，需用read_body按偏移分段读取或用body_string拼接
+    long body_length() const { return m_content_length; }
+    const char *body_view() const { return m_string; }
+    size_t read_body(size_t offset, char *dst, size_t len) const;
+    string body_string() const;
     void initmysql_result(connection_pool *connPool);
-    static void init_blog_handler(connection_pool *connPool);
+    static void init_blog_handler(connection_pool *connPool, size_t page_cache_bytes);
     
     // Session管理功能
     static string create_session(const string& username, const string& role);
@@ -149,46 +249,111 @@ private:
     HTTP_CODE parse_headers(char *text);
     HTTP_CODE parse_content(char *text);
     HTTP_CODE do_request();
+    static const route_trie<http_route> &routes();
+    static route_trie<http_route> build_routes();
+    HTTP_CODE do_blog(const http_route &route, const route_params &params);
+    HTTP_CODE do_static(const http_route &route, const route_params &params);
+    HTTP_CODE do_login(const http_route &route, const route_params &params);
+    HTTP_CODE do_register(const http_route &route, const route_params &params);
+    HTTP_CODE do_page(const http_route &route, const route_params &params);
+    bool parse_credentials(char *name, char *password);
+    HTTP_CODE serve_file();
     char *get_line() { return m_read_buf + m_start_line; };
     LINE_STATUS parse_line();
+    char *read_space(size_t &space);
+    void commit_read(size_t len);
+    HTTP_CODE open_file();
+    HTTP_CODE parse_range();
+    void set_file_body(off_t offset, off_t length);
+    void set_response_body();
+    void set_segment_body();
+    bool gzip_wanted() const;
+    bool gzip_response_body();
+    string content_etag(bool gzip) const;
+    bool not_modified(const string &etag, time_t mtime) const;
+    bool stream_wanted() const;
+    void start_stream();
+    bool append_chunk(const char *data, size_t len, bool finish);
+    void stream_chunk(const char *data, size_t len);
+    void end_stream(const Response &rest);
+    void flush_stream();
     void unmap();
-    bool add_response(const char *format, ...);
+    void advance_iov(int bytes);
+    bool reserve_write(int len);
+    bool add_bytes(const char *data, int len);
     bool add_content(const char *content);
     bool add_status_line(int status, const char *title);
-    bool add_headers(int content_length);
+    bool add_headers(long content_length);
     bool add_content_type();
-    bool add_content_length(int content_length);
+    bool add_response_type();
+    bool add_etag();
+    bool add_file_headers();
+    bool add_partial_headers();
+    bool add_content_length(long content_length);
     bool add_linger();
     bool add_blank_line();
     bool add_cookie(const string& name, const string& value, int max_age = 3600);
+    int loop_epollfd() const { return m_loop_epollfd >= 0 ? m_loop_epollfd : m_epollfd; }
+    void arm(int ev);
+    //缓冲区在首次使用时从buffer_pool取得，请求处理完毕(init)或连接关闭时归还
+    bool attach_buffer(char *&buf, int size);
+    void release_buffers();
+    bool next_request();
+    bool finish_response();
+    bool upgrade_h2c();
+    bool process_h2();
+    void h2_respond(int stream_id);
+    bool h2_refill();
 
 public:
     static int m_epollfd;
-    static int m_user_count;
+    static std::atomic<int> m_user_count;
+    static long m_max_body;  //请求体上限(字节)
+    static int m_gzip_level; //动态响应的gzip压缩级别，0为不压缩
+    static int m_max_requests; //每个连接最多处理的请求数，0为不限制
     MYSQL *mysql;
     int m_state;  //读为0, 写为1
 
 private:
     int m_sockfd;
+    std::atomic<unsigned int> m_serial;  //每次init与close_conn自增，区分复用同一fd的先后连接
     sockaddr_in m_address;
-    char m_read_buf[READ_BUFFER_SIZE];
+    char *m_read_buf;
     long m_read_idx;
+    chain_buffer m_body_chain;  //读缓冲区之后的请求体
     long m_checked_idx;
     int m_start_line;
-    char m_write_buf[WRITE_BUFFER_SIZE];
+    char *m_write_buf;
     int m_write_idx;
+    int m_write_cap;  //写缓冲区当前容量，响应头超出WRITE_BUFFER_SIZE时换用更大一级
     CHECK_STATE m_check_state;
     METHOD m_method;
-    char m_real_file[FILENAME_LEN];
+    char *m_real_file;
     char *m_url;
     char *m_version;
     char *m_host;
     char *m_cookie;
+    char *m_range;
+    char *m_if_range;
+    char *m_if_none_match;
+    char *m_if_modified_since;
+    bool m_accept_gzip;  //Accept-Encoding中gzip可接受(q不为0)
+    vector<pair<off_t, off_t> > m_ranges;  //Range请求的闭区间
     long m_content_length;
     bool m_linger;
     char *m_file_address;
     struct stat m_file_stat;
-    struct iovec m_iv[2];
+    file_entry *m_file;   //file_cache中的文件，响应发送完毕后释放
+    bool m_file_mapped;   //m_file_address是否为本连接单独映射的大文件
+    bool m_sendfile;      //大文件用sendfile发送，不映射
+    off_t m_file_offset;  //sendfile的下一个文件偏移
+    Response m_response;     //博客处理器的响应，各段在发送完之前保持有效
+    string m_response_body;  //需要连续存放的响应体：压缩后的博客响应、multipart、chunk与HTTP/2帧
+    string m_etag;           //动态响应的ETag，非GET请求为空
+    bool m_streaming;        //响应头已发出，按chunked编码边渲染边发送
+    bool m_stream_gzip;      //流式响应经gzip_encoder逐段压缩
+    bool m_stream_failed;    //流式发送出错，处理完毕后关闭连接
+    struct iovec m_iv[MAX_IOV];
     int m_iv_count;
     int cgi;        //是否启用的POST
     char *m_string; //存储请求头数据
@@ -199,11 +364,17 @@ private:
     map<string, string> m_users;
     int m_TRIGMode;
     int m_close_log;
+    int m_loop_epollfd;  //所属事件循环的epoll
+    bool m_one_shot;     //是否使用EPOLLONESHOT
+    bool m_ring_driven;  //是否由io_uring循环驱动
+    int m_requests;      //本连接已处理的请求数
+    bool m_pipelined;    //读缓冲区中已有下一个请求的数据
+    char m_body_end_byte; //请求体末尾被'\0'覆盖前的字节，可能属于下一个请求
+    int m_armed_ev;      //当前已注册的读写事件
+    h2_session *m_h2;    //h2c连接的协议状态，HTTP/1.1连接为NULL
+    bool m_upgrade_h2c;  //请求带Upgrade:h2c
+    char *m_http2_settings;
 
-    char sql_user[100];
-    char sql_passwd[100];
-    char sql_name[100];
-    
     // 登录成功时的用户信息
     string login_username;
     string login_role;
@@ -0,0 +1,783 @@
+#include "h2_session.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+const char h2_session::PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+enum FRAME_TYPE
+{
+    FRAME_DATA = 0,
+    FRAME_HEADERS,
+    FRAME_PRIORITY,
+    FRAME_RST_STREAM,
+    FRAME_SETTINGS,
+    FRAME_PUSH_PROMISE,
+    FRAME_PING,
+    FRAME_GOAWAY,
+    FRAME_WINDOW_UPDATE,
+    FRAME_CONTINUATION
+};
+
+enum SETTINGS_ID
+{
+    SETTINGS_HEADER_TABLE_SIZE = 1,
+    SETTINGS_ENABLE_PUSH,
+    SETTINGS_MAX_CONCURRENT_STREAMS,
+    SETTINGS_INITIAL_WINDOW_SIZE,
+    SETTINGS_MAX_FRAME_SIZE,
+    SETTINGS_MAX_HEADER_LIST_SIZE
+};
+
+static const uint8_t FLAG_END_STREAM = 0x1;
+static const uint8_t FLAG_ACK = 0x1;
+static const uint8_t FLAG_END_HEADERS = 0x4;
+static const uint8_t FLAG_PADDED = 0x8;
+static const uint8_t FLAG_PRIORITY = 0x20;
+
+static const size_t FRAME_HEADER_LEN = 9;
+static const int64_t DEFAULT_WINDOW = 65535;
+static const int64_t MAX_WINDOW = 0x7fffffff;
+
+static uint32_t read_u32(const unsigned char *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void append_u32(string &out, uint32_t value)
+{
+    out.push_back((char)(value >> 24));
+    out.push_back((char)(value >> 16));
+    out.push_back((char)(value >> 8));
+    out.push_back((char)value);
+}
+
+//HTTP2-Settings的值为base64url编码(可省略填充)
+static bool base64url_decode(const char *in, string &out)
+{
+    unsigned int acc = 0;
+    int bits = 0;
+    for (; *in && '=' != *in && !isspace((unsigned char)*in); ++in)
+    {
+        char c = *in;
+        int v;
+        if (c >= 'A' && c <= 'Z')
+            v = c - 'A';
+        else if (c >= 'a' && c <= 'z')
+            v = c - 'a' + 26;
+        else if (c >= '0' && c <= '9')
+            v = c - '0' + 52;
+        else if ('-' == c || '+' == c)
+            v = 62;
+        else if ('_' == c || '/' == c)
+            v = 63;
+        else
+            return false;
+        acc = (acc << 6) | v;
+        bits += 6;
+        if (bits >= 8)
+        {
+            bits -= 8;
+            out.push_back((char)(acc >> bits));
+        }
+    }
+    return true;
+}
+
+h2_session::h2_session(size_t max_body)
+    : m_max_body(max_body), m_expect_preface(true), m_goaway_sent(false), m_peer_goaway(false), m_last_stream(0),
+      m_continuation(0), m_continuation_end(false), m_send_window(DEFAULT_WINDOW), m_initial_window(DEFAULT_WINDOW),
+      m_peer_max_frame(MAX_FRAME_SIZE)
+{
+}
+
+h2_session::~h2_session()
+{
+    for (map<uint32_t, h2_stream>::iterator it = m_streams.begin(); it != m_streams.end(); ++it)
+    {
+        if (it->second.file)
+            file_cache::get_instance()->release(it->second.file);
+    }
+}
+
+void h2_session::start()
+{
+    write_settings();
+}
+
+bool h2_session::upgrade(const char *settings)
+{
+    string payload;
+    if (!base64url_decode(settings, payload) || payload.size() % 6)
+        return false;
+    //101响应即是对这些设置的确认，不再回SETTINGS ACK
+    if (!apply_settings((const unsigned char *)payload.data(), payload.size()))
+        return false;
+
+    m_out.append("HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n");
+    write_settings();
+    h2_stream &stream = m_streams[1];
+    stream.remote_closed = true;
+    stream.send_window = m_initial_window;
+    m_last_stream = 1;
+    return true;
+}
+
+bool h2_session::feed(const char *data, size_t len)
+{
+    if (m_goaway_sent)
+        return false;
+    m_in.append(data, len);
+
+    size_t pos = 0;
+    if (m_expect_preface)
+    {
+        size_t n = m_in.size() < PREFACE_LEN ? m_in.size() : PREFACE_LEN;
+        if (memcmp(m_in.data(), PREFACE, n) != 0)
+            return connection_error(PROTOCOL_ERROR);
+        if (n < PREFACE_LEN)
+            return true;
+        m_expect_preface = false;
+        pos = PREFACE_LEN;
+    }
+
+    bool ok = true;
+    while (ok && m_in.size() - pos >= FRAME_HEADER_LEN)
+    {
+        const unsigned char *h = (const unsigned char *)m_in.data() + pos;
+        uint32_t len = ((uint32_t)h[0] << 16) | ((uint32_t)h[1] << 8) | h[2];
+        if (len > MAX_FRAME_SIZE)
+        {
+            ok = connection_error(FRAME_SIZE_ERROR);
+            break;
+        }
+        if (m_in.size() - pos - FRAME_HEADER_LEN < len)
+            break;
+        ok = on_frame(h[3], h[4], read_u32(h + 5) & 0x7fffffff, h + FRAME_HEADER_LEN, len);
+        pos += FRAME_HEADER_LEN + len;
+    }
+    m_in.erase(0, pos);
+    return ok;
+}
+
+bool h2_session::on_frame(uint8_t type, uint8_t flags, uint32_t stream_id, const unsigned char *payload, uint32_t len)
+{
+    //头部块必须连续，中间不能插入其它帧
+    if (m_continuation && (FRAME_CONTINUATION != type || stream_id != m_continuation))
+        return connection_error(PROTOCOL_ERROR);
+
+    switch (type)
+    {
+    case FRAME_DATA:
+        return on_data(flags, stream_id, payload, len);
+    case FRAME_HEADERS:
+        return on_headers(flags, stream_id, payload, len);
+    case FRAME_PRIORITY:
+        //不按优先级调度，各流轮流发送
+        if (0 == stream_id)
+            return connection_error(PROTOCOL_ERROR);
+        if (5 != len)
+            reset_stream(stream_id, FRAME_SIZE_ERROR);
+        return true;
+    case FRAME_RST_STREAM:
+        if (0 == stream_id || stream_id > m_last_stream)
+            return connection_error(PROTOCOL_ERROR);
+        if (4 != len)
+            return connection_error(FRAME_SIZE_ERROR);
+        close_stream(stream_id);
+        return true;
+    case FRAME_SETTINGS:
+        return on_settings(flags, stream_id, payload, len);
+    case FRAME_PING:
+        if (0 != stream_id)
+            return connection_error(PROTOCOL_ERROR);
+        if (8 != len)
+            return connection_error(FRAME_SIZE_ERROR);
+        if (!(flags & FLAG_ACK))
+        {
+            write_frame_header(m_out, 8, FRAME_PING, FLAG_ACK, 0);
+            m_out.append((const char *)payload, 8);
+        }
+        return true;
+    case FRAME_GOAWAY:
+        if (0 != stream_id)
+            return connection_error(PROTOCOL_ERROR);
+        m_peer_goaway = true;
+        return true;
+    case FRAME_WINDOW_UPDATE:
+        return on_window_update(stream_id, payload, len);
+    case FRAME_CONTINUATION:
+        if (!m_continuation)
+            return connection_error(PROTOCOL_ERROR);
+        if (m_header_block.size() + len > MAX_HEADER_BLOCK)
+            return connection_error(ENHANCE_YOUR_CALM);
+        m_header_block.append((const char *)payload, len);
+        if (flags & FLAG_END_HEADERS)
+        {
+            m_continuation = 0;
+            return on_header_block(stream_id, m_continuation_end);
+        }
+        return true;
+    case FRAME_PUSH_PROMISE:
+        //客户端不能推送
+        return connection_error(PROTOCOL_ERROR);
+    default:
+        //未知类型的帧按协议忽略
+        return true;
+    }
+}
+
+bool h2_session::on_headers(uint8_t flags, uint32_t stream_id, const unsigned char *payload, uint32_t len)
+{
+    if (0 == stream_id || !(stream_id & 1))
+        return connection_error(PROTOCOL_ERROR);
+
+    const unsigned char *p = payload;
+    const unsigned char *end = payload + len;
+    if (flags & FLAG_PADDED)
+    {
+        if (p >= end)
+            return connection_error(PROTOCOL_ERROR);
+        uint8_t pad = *p++;
+        if (pad > end - p)
+            return connection_error(PROTOCOL_ERROR);
+        end -= pad;
+    }
+    if (flags & FLAG_PRIORITY)
+    {
+        if (end - p < 5)
+            return connection_error(PROTOCOL_ERROR);
+        p += 5;
+    }
+
+    m_header_block.assign((const char *)p, end - p);
+    if (!(flags & FLAG_END_HEADERS))
+    {
+        m_continuation = stream_id;
+        m_continuation_end = flags & FLAG_END_STREAM;
+        return true;
+    }
+    return on_header_block(stream_id, flags & FLAG_END_STREAM);
+}
+
+//头部块收全后解码；即使流随后被拒绝也必须解码，动态表在整个连接上共享
+bool h2_session::on_header_block(uint32_t stream_id, bool end_stream)
+{
+    header_list headers;
+    bool decoded = m_decoder.decode((const unsigned char *)m_header_block.data(), m_header_block.size(), headers);
+    m_header_block.clear();
+    if (!decoded)
+        return connection_error(COMPRESSION_ERROR);
+
+    map<uint32_t, h2_stream>::iterator it = m_streams.find(stream_id);
+    if (it != m_streams.end())
+    {
+        //已有的流上再次收到头部块只能是请求体之后的trailer，内容忽略
+        if (it->second.remote_closed)
+            reset_stream(stream_id, STREAM_CLOSED);
+        else if (!end_stream)
+            reset_stream(stream_id, PROTOCOL_ERROR);
+        else
+            request_complete(stream_id);
+        return true;
+    }
+    if (stream_id <= m_last_stream)
+        return connection_error(STREAM_CLOSED);
+    m_last_stream = stream_id;
+
+    if (m_streams.size() >= MAX_CONCURRENT_STREAMS)
+    {
+        write_frame_header(m_out, 4, FRAME_RST_STREAM, 0, stream_id);
+        append_u32(m_out, REFUSED_STREAM);
+        return true;
+    }
+    h2_stream &stream = m_streams[stream_id];
+    stream.send_window = m_initial_window;
+    if (!build_request(headers, stream.request))
+    {
+        reset_stream(stream_id, PROTOCOL_ERROR);
+        return true;
+    }
+    if (end_stream)
+        request_complete(stream_id);
+    return true;
+}
+
+//伪头部转换成请求行与Host，其余头部原样转成HTTP/1.1的头部行
+//取值中的CR、LF会被HTTP/1.1解析当作行结束，连同连接级头部一起按格式错误拒绝
+bool h2_session::build_request(const header_list &headers, string &request)
+{
+    string method, path, authority, cookie, fields;
+    bool regular = false;
+    for (size_t i = 0; i < headers.size(); ++i)
+    {
+        const string &name = headers[i].first;
+        const string &value = headers[i].second;
+        if (name.empty() || value.find_first_of("\r\n", 0, 3) != string::npos)
+            return false;
+        if (':' == name[0])
+        {
+            //伪头部必须在普通头部之前
+            if (regular)
+                return false;
+            if (":method" == name)
+                method = value;
+            else if (":path" == name)
+                path = value;
+            else if (":authority" == name)
+                authority = value;
+            else if (":scheme" != name)
+                return false;
+            continue;
+        }
+        regular = true;
+        for (size_t j = 0; j < name.size(); ++j)
+        {
+            unsigned char c = name[j];
+            if (isupper(c) || c <= ' ' || c >= 0x7f || ':' == c)
+                return false;
+        }
+        if ("connection" == name || "keep-alive" == name || "proxy-connection" == name ||
+            "transfer-encoding" == name || "upgrade" == name)
+            return false;
+        if ("te" == name)
+        {
+            if ("trailers" != value)
+                return false;
+            continue;
+        }
+        //cookie可被拆成多个头部，合并成一行
+        if ("cookie" == name)
+        {
+            if (!cookie.empty())
+                cookie.append("; ");
+            cookie.append(value);
+            continue;
+        }
+        //请求体收全后按实际长度生成Content-Length
+        if ("content-length" == name)
+            continue;
+        if ("host" == name)
+        {
+            if (authority.empty())
+                authority = value;
+            continue;
+        }
+        fields.append(name).append(": ").append(value).append("\r\n");
+    }
+    if (method.empty() || path.empty())
+        return false;
+    if (method.find_first_of(" \t") != string::npos || path.find_first_of(" \t") != string::npos)
+        return false;
+
+    request.assign(method).append(" ").append(path).append(" HTTP/1.1\r\n");
+    if (!authority.empty())
+        request.append("Host: ").append(authority).append("\r\n");
+    request.append(fields);
+    if (!cookie.empty())
+        request.append("Cookie: ").append(cookie).append("\r\n");
+    return true;
+}
+
+void h2_session::request_complete(uint32_t stream_id)
+{
+    m_streams[stream_id].remote_closed = true;
+    m_ready.push_back(stream_id);
+}
+
+bool h2_session::next_request(int &stream_id, string &request)
+{
+    while (!m_ready.empty())
+    {
+        uint32_t id = m_ready.front();
+        m_ready.pop_front();
+        map<uint32_t, h2_stream>::iterator it = m_streams.find(id);
+        if (it == m_streams.end())
+            continue;
+
+        h2_stream &stream = it->second;
+        request.swap(stream.request);
+        if (stream.body_size)
+        {
+            char line[48];
+            request.append(line, snprintf(line, sizeof(line), "Content-Length: %zu\r\n", stream.body_size));
+        }
+        request.append("\r\n");
+        //超出上限的请求体未保存，http_conn看到Content-Length后回413
+        if (stream.body.size() == stream.body_size)
+            request.append(stream.body);
+        string().swap(stream.body);
+        stream_id = id;
+        return true;
+    }
+    return false;
+}
+
+bool h2_session::on_data(uint8_t flags, uint32_t stream_id, const unsigned char *payload, uint32_t len)
+{
+    if (0 == stream_id)
+        return connection_error(PROTOCOL_ERROR);
+    //接收窗口：收到多少立即归还多少，请求体的总量由max_body限制
+    if (len)
+        write_window_update(0, len);
+
+    map<uint32_t, h2_stream>::iterator it = m_streams.find(stream_id);
+    if (it == m_streams.end() || it->second.remote_closed)
+    {
+        if (stream_id > m_last_stream)
+            return connection_error(PROTOCOL_ERROR);
+        if (it != m_streams.end())
+            reset_stream(stream_id, STREAM_CLOSED);
+        return true;
+    }
+
+    const unsigned char *p = payload;
+    const unsigned char *end = payload + len;
+    if (flags & FLAG_PADDED)
+    {
+        if (p >= end)
+            return connection_error(PROTOCOL_ERROR);
+        uint8_t pad = *p++;
+        if (pad > end - p)
+            return connection_error(PROTOCOL_ERROR);
+        end -= pad;
+    }
+
+    h2_stream &stream = it->second;
+    stream.body_size += end - p;
+    if (stream.body_size <= m_max_body)
+        stream.body.append((const char *)p, end - p);
+    else
+        string().swap(stream.body);
+
+    if (flags & FLAG_END_STREAM)
+        request_complete(stream_id);
+    else if (len)
+        write_window_update(stream_id, len);
+    return true;
+}
+
+bool h2_session::on_settings(uint8_t flags, uint32_t stream_id, const unsigned char *payload, uint32_t len)
+{
+    if (0 != stream_id)
+        return connection_error(PROTOCOL_ERROR);
+    if (flags & FLAG_ACK)
+        return 0 == len || connection_error(FRAME_SIZE_ERROR);
+    if (len % 6)
+        return connection_error(FRAME_SIZE_ERROR);
+    if (!apply_settings(payload, len))
+        return false;
+    write_frame_header(m_out, 0, FRAME_SETTINGS, FLAG_ACK, 0);
+    return true;
+}
+
+bool h2_session::apply_settings(const unsigned char *payload, uint32_t len)
+{
+    for (uint32_t i = 0; i + 6 <= len; i += 6)
+    {
+        uint16_t id = ((uint16_t)payload[i] << 8) | payload[i + 1];
+        uint32_t value = read_u32(payload + i + 2);
+        switch (id)
+        {
+        case SETTINGS_HEADER_TABLE_SIZE:
+            m_encoder.set_max_size(value);
+            break;
+        case SETTINGS_ENABLE_PUSH:
+            if (value > 1)
+                return connection_error(PROTOCOL_ERROR);
+            break;
+        case SETTINGS_INITIAL_WINDOW_SIZE:
+        {
+            if (value > MAX_WINDOW)
+                return connection_error(FLOW_CONTROL_ERROR);
+            //已打开的流按差值调整，可能变为负数
+            int64_t delta = (int64_t)value - m_initial_window;
+            for (map<uint32_t, h2_stream>::iterator it = m_streams.begin(); it != m_streams.end(); ++it)
+                it->second.send_window += delta;
+            m_initial_window = value;
+            break;
+        }
+        case SETTINGS_MAX_FRAME_SIZE:
+            if (value < MAX_FRAME_SIZE || value > 0xffffff)
+                return connection_error(PROTOCOL_ERROR);
+            m_peer_max_frame = value;
+            break;
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+bool h2_session::on_window_update(uint32_t stream_id, const unsigned char *payload, uint32_t len)
+{
+    if (4 != len)
+        return connection_error(FRAME_SIZE_ERROR);
+    uint32_t increment = read_u32(payload) & 0x7fffffff;
+    if (0 == stream_id)
+    {
+        if (0 == increment)
+            return connection_error(PROTOCOL_ERROR);
+        m_send_window += increment;
+        if (m_send_window > MAX_WINDOW)
+            return connection_error(FLOW_CONTROL_ERROR);
+        return true;
+    }
+
+    map<uint32_t, h2_stream>::iterator it = m_streams.find(stream_id);
+    if (it == m_streams.end())
+        return stream_id <= m_last_stream || connection_error(PROTOCOL_ERROR);
+    if (0 == increment)
+    {
+        reset_stream(stream_id, PROTOCOL_ERROR);
+        return true;
+    }
+    it->second.send_window += increment;
+    if (it->second.send_window > MAX_WINDOW)
+        reset_stream(stream_id, FLOW_CONTROL_ERROR);
+    return true;
+}
+
+//连接级错误：发出GOAWAY后不再处理收到的帧，已排队的数据写完即关闭
+bool h2_session::connection_error(ERROR_CODE code)
+{
+    if (!m_goaway_sent)
+    {
+        write_frame_header(m_out, 8, FRAME_GOAWAY, 0, 0);
+        append_u32(m_out, m_last_stream);
+        append_u32(m_out, code);
+        m_goaway_sent = true;
+    }
+    return false;
+}
+
+void h2_session::reset_stream(uint32_t stream_id, ERROR_CODE code)
+{
+    write_frame_header(m_out, 4, FRAME_RST_STREAM, 0, stream_id);
+    append_u32(m_out, code);
+    close_stream(stream_id);
+}
+
+void h2_session::close_stream(uint32_t stream_id)
+{
+    map<uint32_t, h2_stream>::iterator it = m_streams.find(stream_id);
+    if (it == m_streams.end())
+        return;
+    if (it->second.file)
+        file_cache::get_instance()->release(it->second.file);
+    m_streams.erase(it);
+}
+
+void h2_session::write_frame_header(string &out, uint32_t len, uint8_t type, uint8_t flags, uint32_t stream_id)
+{
+    out.push_back((char)(len >> 16));
+    out.push_back((char)(len >> 8));
+    out.push_back((char)len);
+    out.push_back((char)type);
+    out.push_back((char)flags);
+    append_u32(out, stream_id);
+}
+
+void h2_session::write_settings()
+{
+    write_frame_header(m_out, 6, FRAME_SETTINGS, 0, 0);
+    m_out.push_back(0);
+    m_out.push_back((char)SETTINGS_MAX_CONCURRENT_STREAMS);
+    append_u32(m_out, MAX_CONCURRENT_STREAMS);
+}
+
+void h2_session::write_window_update(uint32_t stream_id, uint32_t increment)
+{
+    write_frame_header(m_out, 4, FRAME_WINDOW_UPDATE, 0, stream_id);
+    append_u32(m_out, increment);
+}
+
+//头部块超过对端的最大帧时拆成HEADERS + CONTINUATION
+void h2_session::write_headers(uint32_t stream_id, const header_list &headers, bool end_stream)
+{
+    string block;
+    m_encoder.encode(headers, block);
+    size_t off = 0;
+    bool first = true;
+    do
+    {
+        size_t len = block.size() - off;
+        if (len > m_peer_max_frame)
+            len = m_peer_max_frame;
+        uint8_t flags = off + len == block.size() ? FLAG_END_HEADERS : 0;
+        if (first && end_stream)
+            flags |= FLAG_END_STREAM;
+        write_frame_header(m_out, len, first ? FRAME_HEADERS : FRAME_CONTINUATION, flags, stream_id);
+        m_out.append(block, off, len);
+        off += len;
+        first = false;
+    } while (off < block.size());
+}
+
+void h2_session::respond(int stream_id, const char *head, size_t head_len, string &body, file_entry *file,
+                         off_t offset, size_t length)
+{
+    map<uint32_t, h2_stream>::iterator it = m_streams.find(stream_id);
+    if (it == m_streams.end())
+    {
+        if (file)
+            file_cache::get_instance()->release(file);
+        return;
+    }
+    h2_stream &stream = it->second;
+
+    //状态行"HTTP/1.1 200 OK"，之后每行一个"名称:值"，名称转小写，HTTP/1.1的连接级头部丢弃
+    header_list headers;
+    const char *end = head + head_len;
+    const char *blank = (const char *)memmem(head, head_len, "\r\n\r\n", 4);
+    int status = head_len > 12 ? atoi(head + 9) : 0;
+    if (!blank || status < 100)
+    {
+        blank = end;
+        status = 500;
+    }
+    char code[8];
+    headers.push_back(make_pair(string(":status"), string(code, snprintf(code, sizeof(code), "%d", status))));
+    const char *line = (const char *)memmem(head, blank - head, "\r\n", 2);
+    while (line && line < blank)
+    {
+        line += 2;
+        const char *eol = (const char *)memmem(line, blank + 2 - line, "\r\n", 2);
+        if (!eol)
+            break;
+        const char *colon = (const char *)memchr(line, ':', eol - line);
+        if (colon)
+        {
+            string name(line, colon - line);
+            for (size_t i = 0; i < name.size(); ++i)
+                name[i] = tolower((unsigned char)name[i]);
+            const char *value = colon + 1;
+            while (value < eol && (' ' == *value || '\t' == *value))
+                ++value;
+            if ("connection" != name && "keep-alive" != name && "transfer-encoding" != name && "upgrade" != name)
+                headers.push_back(make_pair(name, string(value, eol - value)));
+        }
+        line = eol;
+    }
+
+    //较短的错误页等直接写在响应头之后
+    if (blank + 4 < end)
+        stream.data.assign(blank + 4, end);
+    if (stream.data.empty())
+        stream.data.swap(body);
+    else
+        stream.data.append(body);
+    stream.data_off = 0;
+    stream.file = file;
+    stream.file_off = offset;
+    stream.file_left = file ? length : 0;
+
+    bool has_body = stream.pending() > 0;
+    write_headers(stream_id, headers, !has_body);
+    if (has_body)
+        m_sending.push_back(stream_id);
+    else
+        close_stream(stream_id);
+}
+
+//写出一个DATA帧，内存中的响应体先于文件部分；文件已映射时直接复制，否则从fd读取
+bool h2_session::write_data(uint32_t stream_id, h2_stream &stream, size_t len, string &out)
+{
+    bool last = len == stream.pending();
+    write_frame_header(out, len, FRAME_DATA, last ? FLAG_END_STREAM : 0, stream_id);
+    stream.send_window -= len;
+    m_send_window -= len;
+
+    size_t n = stream.data.size() - stream.data_off;
+    if (n > len)
+        n = len;
+    out.append(stream.data, stream.data_off, n);
+    stream.data_off += n;
+    len -= n;
+    if (stream.data_off == stream.data.size())
+    {
+        string().swap(stream.data);
+        stream.data_off = 0;
+    }
+    if (0 == len)
+        return true;
+
+    if (stream.file->address)
+        out.append(stream.file->address + stream.file_off, len);
+    else
+    {
+        size_t old = out.size();
+        out.resize(old + len);
+        //文件在发送期间被截短
+        if (pread(stream.file->fd, &out[old], len, stream.file_off) != (ssize_t)len)
+        {
+            out.resize(old - FRAME_HEADER_LEN - n);
+            m_send_window += n + len;
+            return false;
+        }
+    }
+    stream.file_off += len;
+    stream.file_left -= len;
+    return true;
+}
+
+bool h2_session::produce(string &out, size_t limit)
+{
+    out.append(m_out);
+    m_out.clear();
+    //升级的连接在收到客户端前言之前只发101、SETTINGS和响应头，部分客户端无法缓存紧跟101的大量数据
+    if (m_goaway_sent || m_expect_preface)
+        return !out.empty();
+
+    //各流轮流发送一帧，直到达到limit或所有可发送的流都受窗口限制
+    bool progress = true;
+    while (progress && out.size() < limit && m_send_window > 0)
+    {
+        progress = false;
+        for (size_t n = m_sending.size(); n > 0 && out.size() < limit && m_send_window > 0; --n)
+        {
+            uint32_t id = m_sending.front();
+            m_sending.pop_front();
+            map<uint32_t, h2_stream>::iterator it = m_streams.find(id);
+            if (it == m_streams.end())
+                continue;
+
+            h2_stream &stream = it->second;
+            int64_t len = stream.pending();
+            if (len > (int64_t)m_peer_max_frame)
+                len = m_peer_max_frame;
+            if (len > (int64_t)(limit - out.size()))
+                len = limit - out.size();
+            if (len > stream.send_window)
+                len = stream.send_window;
+            if (len > m_send_window)
+                len = m_send_window;
+            if (len <= 0)
+            {
+                m_sending.push_back(id);
+                continue;
+            }
+            if (!write_data(id, stream, len, out))
+            {
+                reset_stream(id, INTERNAL_ERROR);
+                out.append(m_out);
+                m_out.clear();
+                continue;
+            }
+            progress = true;
+            if (stream.pending())
+                m_sending.push_back(id);
+            else
+                close_stream(id);
+        }
+    }
+    return !out.empty();
+}
+
+bool h2_session::closing() const
+{
+    return m_goaway_sent || (m_peer_goaway && m_streams.empty());
+}
@@ -0,0 +1,124 @@
+#ifndef H2_SESSION_H
+#define H2_SESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <deque>
+#include <map>
+#include <string>
+
+#include "hpack.h"
+#include "../cache/file_cache.h"
+
+using namespace std;
+
+//一个流的状态：收到的请求在END_STREAM前逐步拼成HTTP/1.1报文，响应体按发送窗口分段发出
+struct h2_stream
+{
+    string request;      //请求行与头部(HTTP/1.1形式)，不含结尾空行
+    string body;
+    size_t body_size;    //收到的请求体字节数，超出上限后只计数不保存
+    bool remote_closed;  //已收到END_STREAM
+    int64_t send_window;
+    string data;         //内存中的响应体
+    size_t data_off;
+    file_entry *file;    //文件响应体，持有一个引用
+    off_t file_off;
+    size_t file_left;
+
+    h2_stream() : body_size(0), remote_closed(false), send_window(0), data_off(0), file(NULL), file_off(0), file_left(0) {}
+    size_t pending() const { return data.size() - data_off + file_left; }
+};
+
+//h2c连接的协议层：帧的解析与生成、HPACK、流量控制和流复用
+//请求转换成HTTP/1.1报文交给http_conn，响应也以HTTP/1.1报文交回，原有的请求解析与响应生成不区分协议
+class h2_session
+{
+public:
+    static const char PREFACE[];
+    static const size_t PREFACE_LEN = 24;
+    static const uint32_t MAX_FRAME_SIZE = 16384;       //本端接受的最大帧(协议默认值)
+    static const uint32_t MAX_CONCURRENT_STREAMS = 100;
+    static const size_t MAX_HEADER_BLOCK = 64 * 1024;   //HEADERS与CONTINUATION拼接后的上限
+    static const size_t OUTPUT_BATCH = 256 * 1024;      //一次交给连接写出的最多字节数
+
+    enum ERROR_CODE
+    {
+        NO_ERROR = 0,
+        PROTOCOL_ERROR = 1,
+        INTERNAL_ERROR = 2,
+        FLOW_CONTROL_ERROR = 3,
+        STREAM_CLOSED = 5,
+        FRAME_SIZE_ERROR = 6,
+        REFUSED_STREAM = 7,
+        COMPRESSION_ERROR = 9,
+        ENHANCE_YOUR_CALM = 11
+    };
+
+    //max_body为请求体上限，超出时请求体不保存，http_conn按Content-Length回413
+    explicit h2_session(size_t max_body);
+    ~h2_session();
+
+    //以先验知识建立的连接：发送本端SETTINGS，等待客户端前言
+    void start();
+    //HTTP/1.1请求带Upgrade:h2c，settings为HTTP2-Settings头的值
+    //先发101再发本端SETTINGS，升级前的请求成为流1，其响应随后由respond交回
+    bool upgrade(const char *settings);
+    //解析收到的字节，不完整的帧留待下次；出现连接错误时已排入GOAWAY并返回false
+    bool feed(const char *data, size_t len);
+    //取出一个已完整收到的请求，转换成HTTP/1.1报文
+    bool next_request(int &stream_id, string &request);
+    //head为http_conn生成的HTTP/1.1响应头，其后可能紧跟较短的响应体；body为其余的响应体
+    //file非空时响应体为文件的[offset, offset + length)，文件的一个引用转交给会话，发送时再从映射或fd读取
+    void respond(int stream_id, const char *head, size_t head_len, string &body, file_entry *file = NULL,
+                 off_t offset = 0, size_t length = 0);
+    //生成待发送的帧，最多约limit字节；发送窗口耗尽的流等对端WINDOW_UPDATE，返回是否生成了数据
+    bool produce(string &out, size_t limit = OUTPUT_BATCH);
+    //已发出GOAWAY，或对端GOAWAY后所有流都已结束，缓冲的数据写完后关闭连接
+    bool closing() const;
+
+private:
+    h2_session(const h2_session &);
+    h2_session &operator=(const h2_session &);
+
+    bool on_frame(uint8_t type, uint8_t flags, uint32_t stream_id, const unsigned char *payload, uint32_t len);
+    bool on_headers(uint8_t flags, uint32_t stream_id, const unsigned char *payload, uint32_t len);
+    bool on_header_block(uint32_t stream_id, bool end_stream);
+    bool on_data(uint8_t flags, uint32_t stream_id, const unsigned char *payload, uint32_t len);
+    bool on_settings(uint8_t flags, uint32_t stream_id, const unsigned char *payload, uint32_t len);
+    bool on_window_update(uint32_t stream_id, const unsigned char *payload, uint32_t len);
+    bool apply_settings(const unsigned char *payload, uint32_t len);
+    bool build_request(const header_list &headers, string &request);
+    void request_complete(uint32_t stream_id);
+    bool connection_error(ERROR_CODE code);
+    void reset_stream(uint32_t stream_id, ERROR_CODE code);
+    void close_stream(uint32_t stream_id);
+    void write_frame_header(string &out, uint32_t len, uint8_t type, uint8_t flags, uint32_t stream_id);
+    void write_settings();
+    void write_window_update(uint32_t stream_id, uint32_t increment);
+    void write_headers(uint32_t stream_id, const header_list &headers, bool end_stream);
+    bool write_data(uint32_t stream_id, h2_stream &stream, size_t len, string &out);
+
+private:
+    size_t m_max_body;
+    string m_in;            //未处理完的收到的字节
+    string m_out;           //已生成的控制帧与HEADERS，先于DATA发出
+    bool m_expect_preface;
+    bool m_goaway_sent;
+    bool m_peer_goaway;
+    uint32_t m_last_stream;  //已开始的最大客户端流
+    uint32_t m_continuation; //正在接收CONTINUATION的流，0表示没有
+    bool m_continuation_end; //该头部块所在HEADERS帧带END_STREAM
+    string m_header_block;
+    hpack_decoder m_decoder;
+    hpack_encoder m_encoder;
+    map<uint32_t, h2_stream> m_streams;
+    deque<uint32_t> m_ready;    //请求已收全，等待http_conn处理
+    deque<uint32_t> m_sending;  //有响应体待发送，轮流发送
+    int64_t m_send_window;      //连接级发送窗口
+    int64_t m_initial_window;   //对端SETTINGS_INITIAL_WINDOW_SIZE
+    uint32_t m_peer_max_frame;  //对端SETTINGS_MAX_FRAME_SIZE
+};
+
+#endif
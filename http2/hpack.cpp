@@ -0,0 +1,424 @@
+#include "hpack.h"
+
+//RFC 7541附录A
+static const pair<string, string> static_table[hpack_table::STATIC_COUNT] = {
+    make_pair(":authority", ""),
+    make_pair(":method", "GET"),
+    make_pair(":method", "POST"),
+    make_pair(":path", "/"),
+    make_pair(":path", "/index.html"),
+    make_pair(":scheme", "http"),
+    make_pair(":scheme", "https"),
+    make_pair(":status", "200"),
+    make_pair(":status", "204"),
+    make_pair(":status", "206"),
+    make_pair(":status", "304"),
+    make_pair(":status", "400"),
+    make_pair(":status", "404"),
+    make_pair(":status", "500"),
+    make_pair("accept-charset", ""),
+    make_pair("accept-encoding", "gzip, deflate"),
+    make_pair("accept-language", ""),
+    make_pair("accept-ranges", ""),
+    make_pair("accept", ""),
+    make_pair("access-control-allow-origin", ""),
+    make_pair("age", ""),
+    make_pair("allow", ""),
+    make_pair("authorization", ""),
+    make_pair("cache-control", ""),
+    make_pair("content-disposition", ""),
+    make_pair("content-encoding", ""),
+    make_pair("content-language", ""),
+    make_pair("content-length", ""),
+    make_pair("content-location", ""),
+    make_pair("content-range", ""),
+    make_pair("content-type", ""),
+    make_pair("cookie", ""),
+    make_pair("date", ""),
+    make_pair("etag", ""),
+    make_pair("expect", ""),
+    make_pair("expires", ""),
+    make_pair("from", ""),
+    make_pair("host", ""),
+    make_pair("if-match", ""),
+    make_pair("if-modified-since", ""),
+    make_pair("if-none-match", ""),
+    make_pair("if-range", ""),
+    make_pair("if-unmodified-since", ""),
+    make_pair("last-modified", ""),
+    make_pair("link", ""),
+    make_pair("location", ""),
+    make_pair("max-forwards", ""),
+    make_pair("proxy-authenticate", ""),
+    make_pair("proxy-authorization", ""),
+    make_pair("range", ""),
+    make_pair("referer", ""),
+    make_pair("refresh", ""),
+    make_pair("retry-after", ""),
+    make_pair("server", ""),
+    make_pair("set-cookie", ""),
+    make_pair("strict-transport-security", ""),
+    make_pair("transfer-encoding", ""),
+    make_pair("user-agent", ""),
+    make_pair("vary", ""),
+    make_pair("via", ""),
+    make_pair("www-authenticate", ""),
+};
+
+//RFC 7541附录B，按符号排列的{码字, 位数}，256为EOS
+struct huffman_code
+{
+    uint32_t code;
+    uint8_t bits;
+};
+static const huffman_code huffman_codes[257] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28}, {0xfffffe4, 28}, {0xfffffe5, 28},
+    {0xfffffe6, 28}, {0xfffffe7, 28}, {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28}, {0xfffffed, 28}, {0xfffffee, 28},
+    {0xfffffef, 28}, {0xffffff0, 28}, {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28}, {0xffffff8, 28}, {0xffffff9, 28},
+    {0xffffffa, 28}, {0xffffffb, 28}, {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10},
+    {0xf9, 8}, {0x7fb, 11}, {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6}, {0x1a, 6}, {0x1b, 6},
+    {0x1c, 6}, {0x1d, 6}, {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10}, {0x1ffa, 13}, {0x21, 6},
+    {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7}, {0x67, 7}, {0x68, 7},
+    {0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7},
+    {0xfd, 8}, {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5},
+    {0x25, 6}, {0x26, 6}, {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7},
+    {0x2c, 6}, {0x8, 5}, {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14},
+    {0x1ffd, 13}, {0xffffffc, 28}, {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22}, {0x7fffda, 23},
+    {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24}, {0x7fffe1, 23},
+    {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24}, {0x3fffda, 22}, {0x1fffdd, 21},
+    {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21}, {0x3fffdf, 22},
+    {0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23}, {0xfffea, 20}, {0x3fffe2, 22},
+    {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22}, {0x7ffff2, 23},
+    {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19}, {0x1fffe3, 21},
+    {0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28}, {0x7ffffe3, 27},
+    {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22}, {0x3fffeb, 22},
+    {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27}, {0x7ffffe8, 27},
+    {0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26}, {0x3fffffff, 30},
+};
+
+static const int HUFFMAN_EOS = 256;
+
+//码表展开成二叉树：内部节点的子节点下标为正，叶子为-1-符号
+struct huffman_tree
+{
+    int child[256][2];
+
+    huffman_tree()
+    {
+        int count = 1;
+        for (int i = 0; i < 256; ++i)
+            child[i][0] = child[i][1] = 0;
+        for (int sym = 0; sym <= HUFFMAN_EOS; ++sym)
+        {
+            int node = 0;
+            for (int b = huffman_codes[sym].bits - 1; b > 0; --b)
+            {
+                int bit = (huffman_codes[sym].code >> b) & 1;
+                if (0 == child[node][bit])
+                    child[node][bit] = count++;
+                node = child[node][bit];
+            }
+            child[node][huffman_codes[sym].code & 1] = -1 - sym;
+        }
+    }
+};
+
+bool huffman_decode(const unsigned char *data, size_t len, string &out)
+{
+    static const huffman_tree tree;
+    int node = 0;
+    int depth = 0;        //自上一个符号以来的位数
+    bool all_ones = true; //这些位是否全为1
+    for (size_t i = 0; i < len; ++i)
+    {
+        for (int b = 7; b >= 0; --b)
+        {
+            int bit = (data[i] >> b) & 1;
+            int next = tree.child[node][bit];
+            ++depth;
+            all_ones = all_ones && bit;
+            if (next > 0)
+            {
+                node = next;
+                continue;
+            }
+            if (0 == next)
+                return false;
+            int sym = -1 - next;
+            if (HUFFMAN_EOS == sym)
+                return false;
+            out.push_back((char)sym);
+            node = 0;
+            depth = 0;
+            all_ones = true;
+        }
+    }
+    //末尾只能是EOS码字的前缀(全1)，且不足一个字节
+    return depth < 8 && all_ones;
+}
+
+void hpack_encode_int(uint32_t value, int prefix, unsigned char flags, string &out)
+{
+    uint32_t max = (1u << prefix) - 1;
+    if (value < max)
+    {
+        out.push_back((char)(flags | value));
+        return;
+    }
+    out.push_back((char)(flags | max));
+    value -= max;
+    while (value >= 128)
+    {
+        out.push_back((char)(0x80 | (value & 0x7f)));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+bool hpack_decode_int(const unsigned char *&p, const unsigned char *end, int prefix, uint32_t &value)
+{
+    if (p >= end)
+        return false;
+    uint32_t max = (1u << prefix) - 1;
+    value = *p++ & max;
+    if (value < max)
+        return true;
+    //最多4个后续字节，足以表示头部块中任何合理的长度或索引
+    for (int shift = 0; shift <= 21; shift += 7)
+    {
+        if (p >= end)
+            return false;
+        unsigned char b = *p++;
+        value += (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+bool hpack_table::get(size_t index, const string *&name, const string *&value) const
+{
+    if (0 == index)
+        return false;
+    if (index <= STATIC_COUNT)
+    {
+        name = &static_table[index - 1].first;
+        value = &static_table[index - 1].second;
+        return true;
+    }
+    index -= STATIC_COUNT + 1;
+    if (index >= m_entries.size())
+        return false;
+    name = &m_entries[index].first;
+    value = &m_entries[index].second;
+    return true;
+}
+
+void hpack_table::evict(size_t limit)
+{
+    while (m_size > limit)
+    {
+        m_size -= m_entries.back().first.size() + m_entries.back().second.size() + ENTRY_OVERHEAD;
+        m_entries.pop_back();
+    }
+}
+
+void hpack_table::add(const string &name, const string &value)
+{
+    size_t size = name.size() + value.size() + ENTRY_OVERHEAD;
+    //比整张表还大的条目使表清空，本身也不加入
+    if (size > m_max_size)
+    {
+        evict(0);
+        return;
+    }
+    evict(m_max_size - size);
+    m_entries.push_front(make_pair(name, value));
+    m_size += size;
+}
+
+void hpack_table::set_max_size(size_t max_size)
+{
+    m_max_size = max_size;
+    evict(max_size);
+}
+
+size_t hpack_table::find(const string &name, const string &value, size_t &name_index) const
+{
+    name_index = 0;
+    for (size_t i = 0; i < STATIC_COUNT; ++i)
+    {
+        if (static_table[i].first != name)
+            continue;
+        if (static_table[i].second == value)
+            return i + 1;
+        if (!name_index)
+            name_index = i + 1;
+    }
+    for (size_t i = 0; i < m_entries.size(); ++i)
+    {
+        if (m_entries[i].first != name)
+            continue;
+        if (m_entries[i].second == value)
+            return STATIC_COUNT + 1 + i;
+        if (!name_index)
+            name_index = STATIC_COUNT + 1 + i;
+    }
+    return 0;
+}
+
+bool hpack_decoder::decode_string(const unsigned char *&p, const unsigned char *end, string &out)
+{
+    if (p >= end)
+        return false;
+    bool huffman = *p & 0x80;
+    uint32_t len;
+    if (!hpack_decode_int(p, end, 7, len) || len > (size_t)(end - p))
+        return false;
+    out.clear();
+    if (huffman)
+    {
+        if (!huffman_decode(p, len, out))
+            return false;
+    }
+    else
+        out.assign((const char *)p, len);
+    p += len;
+    return true;
+}
+
+//解码后的头部总量上限，防止少量字节反复引用动态表中的大条目
+static const size_t MAX_DECODED_SIZE = 64 * 1024;
+
+bool hpack_decoder::decode(const unsigned char *data, size_t len, header_list &headers)
+{
+    const unsigned char *p = data;
+    const unsigned char *end = data + len;
+    size_t decoded = 0;
+    bool leading = true;  //表大小更新只能出现在头部块开头
+    while (p < end)
+    {
+        unsigned char b = *p;
+        uint32_t index;
+        if (b & 0x80)
+        {
+            //索引头部字段
+            const string *name, *value;
+            if (!hpack_decode_int(p, end, 7, index) || !m_table.get(index, name, value))
+                return false;
+            headers.push_back(make_pair(*name, *value));
+        }
+        else if (0x20 == (b & 0xe0))
+        {
+            //动态表大小更新
+            if (!leading || !hpack_decode_int(p, end, 5, index) || index > m_limit)
+                return false;
+            m_table.set_max_size(index);
+            continue;
+        }
+        else
+        {
+            //字面量：01为加入动态表，0000为不加入，0001为永不索引
+            bool indexing = b & 0x40;
+            if (!hpack_decode_int(p, end, indexing ? 6 : 4, index))
+                return false;
+            string name, value;
+            if (index)
+            {
+                const string *table_name, *table_value;
+                if (!m_table.get(index, table_name, table_value))
+                    return false;
+                name = *table_name;
+            }
+            else if (!decode_string(p, end, name))
+                return false;
+            if (!decode_string(p, end, value))
+                return false;
+            if (indexing)
+                m_table.add(name, value);
+            headers.push_back(make_pair(name, value));
+        }
+        leading = false;
+        decoded += headers.back().first.size() + headers.back().second.size();
+        if (decoded > MAX_DECODED_SIZE)
+            return false;
+    }
+    return true;
+}
+
+void hpack_encoder::set_max_size(size_t max_size)
+{
+    if (max_size > hpack_table::DEFAULT_SIZE)
+        max_size = hpack_table::DEFAULT_SIZE;
+    if (max_size == m_table.max_size())
+        return;
+    m_table.set_max_size(max_size);
+    m_size_update = true;
+}
+
+static void encode_literal(const string &str, string &out)
+{
+    hpack_encode_int(str.size(), 7, 0, out);
+    out.append(str);
+}
+
+//每个响应都不同的取值，加入动态表只会挤掉可复用的条目
+static bool volatile_header(const string &name)
+{
+    return name == "content-length" || name == "etag" || name == "last-modified" || name == "content-range" ||
+           name == "date" || name == "location";
+}
+
+void hpack_encoder::encode(const header_list &headers, string &out)
+{
+    if (m_size_update)
+    {
+        hpack_encode_int(m_table.max_size(), 5, 0x20, out);
+        m_size_update = false;
+    }
+    for (size_t i = 0; i < headers.size(); ++i)
+    {
+        const string &name = headers[i].first;
+        const string &value = headers[i].second;
+        size_t name_index;
+        size_t index = m_table.find(name, value, name_index);
+        if (index)
+        {
+            hpack_encode_int(index, 7, 0x80, out);
+            continue;
+        }
+        if (name == "set-cookie")
+            hpack_encode_int(name_index, 4, 0x10, out);
+        else if (volatile_header(name))
+            hpack_encode_int(name_index, 4, 0x00, out);
+        else
+        {
+            hpack_encode_int(name_index, 6, 0x40, out);
+            m_table.add(name, value);
+        }
+        if (!name_index)
+            encode_literal(name, out);
+        encode_literal(value, out);
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+typedef vector<pair<string, string> > header_list;
+
+//HPACK(RFC 7541)的索引表：1~61为静态表，之后为动态表，新条目插在动态表最前
+//每个条目按名称、值的长度加32字节计入表大小，超出上限时从最旧的一端淘汰
+class hpack_table
+{
+public:
+    static const size_t STATIC_COUNT = 61;
+    static const size_t ENTRY_OVERHEAD = 32;
+    static const size_t DEFAULT_SIZE = 4096;
+
+    hpack_table() : m_size(0), m_max_size(DEFAULT_SIZE) {}
+
+    //index从1开始，超出范围返回false
+    bool get(size_t index, const string *&name, const string *&value) const;
+    void add(const string &name, const string &value);
+    void set_max_size(size_t max_size);
+    size_t max_size() const { return m_max_size; }
+    //名称与值都相同时返回该条目的索引；否则name_index为只有名称相同的条目索引(没有为0)，返回0
+    size_t find(const string &name, const string &value, size_t &name_index) const;
+
+private:
+    void evict(size_t limit);
+
+private:
+    deque<pair<string, string> > m_entries;
+    size_t m_size;
+    size_t m_max_size;
+};
+
+//解码一个完整的头部块，动态表状态在同一连接的所有头部块间延续
+//任何格式错误都是连接级错误(COMPRESSION_ERROR)，解码器此后不可再用
+class hpack_decoder
+{
+public:
+    hpack_decoder() : m_limit(hpack_table::DEFAULT_SIZE) {}
+
+    bool decode(const unsigned char *data, size_t len, header_list &headers);
+
+private:
+    bool decode_string(const unsigned char *&p, const unsigned char *end, string &out);
+
+private:
+    hpack_table m_table;
+    size_t m_limit;  //本端SETTINGS_HEADER_TABLE_SIZE，对端的表大小更新不能超过它
+};
+
+//编码响应头：完全匹配静态表或动态表的头部只发索引；取值每次都不同的头部(长度、校验值、日期等)不加入动态表
+//字面量不做Huffman编码，省去编码开销；Set-Cookie按never indexed发送，中间代理也不会缓存
+class hpack_encoder
+{
+public:
+    hpack_encoder() : m_size_update(false) {}
+
+    //对端通过SETTINGS_HEADER_TABLE_SIZE调整表大小，在下一个头部块开头通知对端
+    void set_max_size(size_t max_size);
+    void encode(const header_list &headers, string &out);
+
+private:
+    hpack_table m_table;
+    bool m_size_update;
+};
+
+//HPACK整数：prefix位前缀，高位的标志位由flags给出
+void hpack_encode_int(uint32_t value, int prefix, unsigned char flags, string &out);
+bool hpack_decode_int(const unsigned char *&p, const unsigned char *end, int prefix, uint32_t &value);
+//Huffman解码，填充位超过7位、不全为1或出现EOS时返回false
+bool huffman_decode(const unsigned char *data, size_t len, string &out);
+
+#endif
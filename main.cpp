@@ -16,7 +16,10 @@ int main(int argc, char *argv[])
     //初始化
     server.init(config.PORT, user, passwd, databasename, config.LOGWrite, 
                 config.OPT_LINGER, config.TRIGMode,  config.sql_num,  config.thread_num, 
-                config.close_log, config.actor_model);
+                config.close_log, config.actor_model, config.reactor_num,
+                config.reuseport, config.backlog, config.idle_timeout, config.max_body_kb,
+                config.precompress, config.gzip_level,
+                config.max_requests, config.page_cache_mb);
     
 
     //日志
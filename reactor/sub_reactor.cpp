@@ -0,0 +1,322 @@
+#include "sub_reactor.h"
+
+http_conn *sub_reactor::s_users = NULL;
+
+sub_reactor::sub_reactor(int id, http_conn *users, client_data *users_timer, int max_fd, int idle_timeout, int timeslot)
+    : m_id(id), m_listenfd(-1), m_LISTENTrigmode(0), m_started(false), m_stop(false),
+      m_users(users), m_users_timer(users_timer), m_max_fd(max_fd), m_idle_timeout(idle_timeout),
+      m_root(NULL), m_CONNTrigmode(0), m_close_log(0), m_connPool(NULL)
+{
+    s_users = users;
+
+    m_epollfd = epoll_create(5);
+    assert(m_epollfd != -1);
+
+    //eventfd用于主线程投递新连接后唤醒本循环
+    m_wakeupfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    assert(m_wakeupfd != -1);
+
+    epoll_event event;
+    event.data.fd = m_wakeupfd;
+    event.events = EPOLLIN;
+    epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_wakeupfd, &event);
+
+    //每timeslot毫秒检查一次本循环内的非活动连接
+    m_tickfd = Utils::create_tick_fd(timeslot);
+    event.data.fd = m_tickfd;
+    event.events = EPOLLIN;
+    epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_tickfd, &event);
+}
+
+sub_reactor::~sub_reactor()
+{
+    stop();
+    if (m_listenfd >= 0)
+        close(m_listenfd);
+    close(m_wakeupfd);
+    close(m_tickfd);
+    close(m_epollfd);
+}
+
+void sub_reactor::init(char *root, int conn_trigmode, int close_log, connection_pool *connPool)
+{
+    m_root = root;
+    m_CONNTrigmode = conn_trigmode;
+    m_close_log = close_log;
+    m_connPool = connPool;
+}
+
+void sub_reactor::set_listener(int listenfd, int listen_trigmode)
+{
+    m_listenfd = listenfd;
+    m_LISTENTrigmode = listen_trigmode;
+
+    epoll_event event;
+    event.data.fd = listenfd;
+    event.events = EPOLLIN;
+    if (1 == listen_trigmode)
+        event.events |= EPOLLET;
+    epoll_ctl(m_epollfd, EPOLL_CTL_ADD, listenfd, &event);
+}
+
+bool sub_reactor::start()
+{
+    if (pthread_create(&m_thread, NULL, worker, this) != 0)
+    {
+        LOG_ERROR("sub reactor %d start failed", m_id);
+        return false;
+    }
+    m_started = true;
+    return true;
+}
+
+void sub_reactor::stop()
+{
+    if (!m_started)
+        return;
+    m_stop = true;
+    wakeup();
+    pthread_join(m_thread, NULL);
+    m_started = false;
+}
+
+void sub_reactor::dispatch(int connfd, const sockaddr_in &client_address)
+{
+    pending_conn conn;
+    conn.connfd = connfd;
+    conn.address = client_address;
+
+    m_pending_lock.lock();
+    m_pending.push_back(conn);
+    m_pending_lock.unlock();
+
+    wakeup();
+}
+
+void sub_reactor::wakeup()
+{
+    uint64_t one = 1;
+    ssize_t n = ::write(m_wakeupfd, &one, sizeof(one));
+    (void)n;
+}
+
+void *sub_reactor::worker(void *arg)
+{
+    sub_reactor *reactor = (sub_reactor *)arg;
+    reactor->run();
+    return reactor;
+}
+
+//取走主线程投递的全部新连接
+void sub_reactor::accept_pending()
+{
+    uint64_t count;
+    while (read(m_wakeupfd, &count, sizeof(count)) > 0)
+        ;
+
+    vector<pending_conn> pending;
+    m_pending_lock.lock();
+    pending.swap(m_pending);
+    m_pending_lock.unlock();
+
+    for (size_t i = 0; i < pending.size(); ++i)
+    {
+        add_conn(pending[i].connfd, pending[i].address);
+    }
+}
+
+//批量accept本分片监听socket上的新连接
+//LT模式每次最多取MAX_ACCEPT_BATCH个，避免新连接风暴饿死已有连接；ET模式必须取到EAGAIN为止
+void sub_reactor::accept_batch()
+{
+    struct sockaddr_in client_address;
+    socklen_t client_addrlength;
+    int accepted = 0;
+
+    while (1 == m_LISTENTrigmode || accepted < MAX_ACCEPT_BATCH)
+    {
+        client_addrlength = sizeof(client_address);
+        int connfd = accept4(m_listenfd, (struct sockaddr *)&client_address, &client_addrlength,
+                             SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (connfd < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                LOG_ERROR("sub reactor %d accept error:%d", m_id, errno);
+            break;
+        }
+        ++accepted;
+        if (http_conn::m_user_count >= m_max_fd || connfd >= m_max_fd)
+        {
+            const char *info = "Internal server busy";
+            send(connfd, info, strlen(info), 0);
+            close(connfd);
+            LOG_ERROR("%s", "Internal server busy");
+            continue;
+        }
+        add_conn(connfd, client_address);
+    }
+}
+
+void sub_reactor::add_conn(int connfd, const sockaddr_in &client_address)
+{
+    m_users[connfd].bind_loop(m_epollfd, false);
+    m_users[connfd].init(connfd, client_address, m_root, m_CONNTrigmode, m_close_log);
+
+    m_users_timer[connfd].address = client_address;
+    m_users_timer[connfd].sockfd = connfd;
+    util_timer *timer = m_timer_lst.alloc_timer();
+    timer->user_data = &m_users_timer[connfd];
+    timer->cb_func = conn_timeout;
+    timer->expire = timer_now_ms() + m_idle_timeout;
+    m_users_timer[connfd].timer = timer;
+    m_timer_lst.add_timer(timer);
+}
+
+//关闭连接：close_conn先清除连接状态(序号自增、计数减一)再从本循环的epoll中移除并关闭fd
+void sub_reactor::conn_timeout(client_data *user_data)
+{
+    assert(user_data);
+    user_data->timer = NULL;
+    s_users[user_data->sockfd].close_conn();
+}
+
+void sub_reactor::adjust_timer(util_timer *timer)
+{
+    timer->expire = timer_now_ms() + m_idle_timeout;
+    m_timer_lst.adjust_timer(timer);
+}
+
+//先回收定时器再关闭连接，关闭之后不再访问该fd对应的元素
+void sub_reactor::deal_timer(util_timer *timer, int sockfd)
+{
+    m_timer_lst.del_timer(timer);
+    conn_timeout(&m_users_timer[sockfd]);
+
+    LOG_INFO("close fd %d", sockfd);
+}
+
+//事件属于该fd上当前的连接：连接已关闭或fd已被复用时序号不同
+bool sub_reactor::is_current(uint64_t data) const
+{
+    int sockfd = http_conn::event_fd(data);
+    return http_conn::event_serial(data) == m_users[sockfd].get_serial();
+}
+
+//读、处理、写都在本线程内完成，不经过线程池
+void sub_reactor::dealwithread(int sockfd)
+{
+    util_timer *timer = m_users_timer[sockfd].timer;
+    if (!timer)
+        return;
+    http_conn &conn = m_users[sockfd];
+
+    if (!conn.read_once())
+    {
+        deal_timer(timer, sockfd);
+        return;
+    }
+    adjust_timer(timer);
+    serve(sockfd);
+}
+
+//处理已读入的请求并直接写出；响应立即写完且缓冲区中还有流水线请求时接着处理下一个
+void sub_reactor::serve(int sockfd)
+{
+    util_timer *timer = m_users_timer[sockfd].timer;
+    http_conn &conn = m_users[sockfd];
+    unsigned int serial = conn.get_serial();
+
+    do
+    {
+        bool has_response;
+        {
+            connectionRAII mysqlcon(&conn.mysql, m_connPool);
+            has_response = conn.process();
+        }
+
+        //process内部已关闭连接，只回收本循环的定时器：fd可能已被其他循环复用，不再访问其元素
+        if (conn.get_serial() != serial)
+        {
+            m_timer_lst.del_timer(timer);
+            return;
+        }
+        if (!has_response)
+            return;
+
+        //直接尝试写出，只有写缓冲区满时write才会注册EPOLLOUT
+        if (!conn.write())
+        {
+            deal_timer(timer, sockfd);
+            return;
+        }
+    } while (conn.has_pending());
+}
+
+void sub_reactor::dealwithwrite(int sockfd)
+{
+    util_timer *timer = m_users_timer[sockfd].timer;
+    if (!timer)
+        return;
+
+    if (m_users[sockfd].write())
+    {
+        adjust_timer(timer);
+        if (m_users[sockfd].has_pending())
+            serve(sockfd);
+    }
+    else
+    {
+        deal_timer(timer, sockfd);
+    }
+}
+
+void sub_reactor::run()
+{
+    while (!m_stop)
+    {
+        int number = epoll_wait(m_epollfd, m_events, MAX_EVENT_NUMBER, -1);
+        if (number < 0 && errno != EINTR)
+        {
+            LOG_ERROR("sub reactor %d epoll failure", m_id);
+            break;
+        }
+
+        for (int i = 0; i < number; i++)
+        {
+            int sockfd = http_conn::event_fd(m_events[i].data.u64);
+
+            if (sockfd == m_listenfd)
+            {
+                accept_batch();
+            }
+            else if (sockfd == m_wakeupfd)
+            {
+                accept_pending();
+            }
+            else if (sockfd == m_tickfd)
+            {
+                Utils::drain_fd(m_tickfd);
+                m_timer_lst.tick();
+            }
+            else if (!is_current(m_events[i].data.u64))
+            {
+                //同一批事件中该连接已被关闭，或fd已交给其他连接
+                continue;
+            }
+            else if (m_events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            {
+                util_timer *timer = m_users_timer[sockfd].timer;
+                if (timer)
+                    deal_timer(timer, sockfd);
+            }
+            else if (m_events[i].events & EPOLLIN)
+            {
+                dealwithread(sockfd);
+            }
+            else if (m_events[i].events & EPOLLOUT)
+            {
+                dealwithwrite(sockfd);
+            }
+        }
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef SUB_REACTOR_H
+#define SUB_REACTOR_H
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <vector>
+#include <string>
+
+#include "../lock/locker.h"
+#include "../timer/lst_timer.h"
+#include "../http/http_conn.h"
+#include "../CGImysql/sql_connection_pool.h"
+
+using namespace std;
+
+//one loop per thread中的从反应堆
+//主线程accept后通过dispatch投递连接，之后该连接的读、处理、写与定时器都只在本线程内完成
+class sub_reactor
+{
+public:
+    static const int MAX_EVENT_NUMBER = 4096;
+    static const int MAX_ACCEPT_BATCH = 64;
+
+    sub_reactor(int id, http_conn *users, client_data *users_timer, int max_fd, int idle_timeout, int timeslot);
+    ~sub_reactor();
+
+    void init(char *root, int conn_trigmode, int close_log, connection_pool *connPool);
+    //SO_REUSEPORT分片模式：本循环拥有自己的监听socket，直接accept
+    void set_listener(int listenfd, int listen_trigmode);
+    bool start();
+    void stop();
+
+    //由主线程调用，投递一个新连接并唤醒本循环
+    void dispatch(int connfd, const sockaddr_in &client_address);
+
+private:
+    struct pending_conn
+    {
+        int connfd;
+        sockaddr_in address;
+    };
+
+    static void *worker(void *arg);
+    void run();
+    void wakeup();
+    void accept_pending();
+    void accept_batch();
+    void add_conn(int connfd, const sockaddr_in &client_address);
+    void adjust_timer(util_timer *timer);
+    void deal_timer(util_timer *timer, int sockfd);
+    void dealwithread(int sockfd);
+    void dealwithwrite(int sockfd);
+    void serve(int sockfd);
+    bool is_current(uint64_t data) const;
+    static void conn_timeout(client_data *user_data);
+
+private:
+    int m_id;
+    int m_epollfd;
+    int m_wakeupfd;
+    int m_tickfd;
+    int m_listenfd;
+    int m_LISTENTrigmode;
+    pthread_t m_thread;
+    bool m_started;
+    volatile bool m_stop;
+
+    //本循环拥有的连接切片：只访问由本循环接收的fd对应的元素
+    //连接关闭前先清除对应元素的状态，fd一旦关闭就可能被其他循环accept复用
+    static http_conn *s_users;  //各循环共享同一数组，供超时回调关闭连接
+    http_conn *m_users;
+    client_data *m_users_timer;
+    int m_max_fd;
+
+    //主线程投递、本线程取走的新连接
+    locker m_pending_lock;
+    vector<pending_conn> m_pending;
+
+    //本循环私有的定时器，由注册在本循环epoll中的timerfd驱动
+    timer_wheel m_timer_lst;
+    int m_idle_timeout;
+
+    char *m_root;
+    int m_CONNTrigmode;
+    int m_close_log;
+    connection_pool *m_connPool;
+
+    epoll_event m_events[MAX_EVENT_NUMBER];
+};
+
+#endif
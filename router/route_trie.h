@@ -0,0 +1,294 @@
+/*************************************************************
+*基数树(radix trie)路由表，启动时注册路由，匹配只按路径逐字节下行
+*静态边合并公共前缀，每个节点的静态子节点首字节互不相同；
+*:name匹配一个非空路径段，*name匹配剩余路径(可为空)且只能位于模式末尾
+*匹配时静态段优先于参数段，参数段优先于通配，只在更具体的分支失败时回退
+**************************************************************/
+
+#ifndef ROUTE_TRIE_H
+#define ROUTE_TRIE_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <strings.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+//方法编号与http_conn::METHOD的取值一致，未知方法为-1
+inline int route_method_id(const char *method)
+{
+    static const char *const names[] = {"GET", "POST", "HEAD", "PUT", "DELETE", "TRACE", "OPTIONS", "CONNECT", "PATCH"};
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); ++i)
+    {
+        if (strcasecmp(method, names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+//匹配得到的路径参数，取值直接指向被匹配的路径，不复制
+class route_params
+{
+public:
+    static const int MAX_PARAMS = 4;
+
+    route_params() : m_count(0) {}
+
+    int size() const { return m_count; }
+
+    bool get(const char *name, string &value) const
+    {
+        const param *p = find(name);
+        if (!p)
+            return false;
+        value.assign(p->value, p->len);
+        return true;
+    }
+
+    //十进制非负整数，含其它字符、为空或超出int范围时返回false
+    bool get_int(const char *name, int &value) const
+    {
+        const param *p = find(name);
+        if (!p || 0 == p->len)
+            return false;
+        long long n = 0;
+        for (size_t i = 0; i < p->len; ++i)
+        {
+            char c = p->value[i];
+            if (c < '0' || c > '9')
+                return false;
+            n = n * 10 + (c - '0');
+            if (n > INT_MAX)
+                return false;
+        }
+        value = (int)n;
+        return true;
+    }
+
+private:
+    template <class H>
+    friend class route_trie;
+
+    struct param
+    {
+        const string *name;
+        const char *value;
+        size_t len;
+    };
+
+    const param *find(const char *name) const
+    {
+        for (int i = 0; i < m_count; ++i)
+        {
+            if (*m_params[i].name == name)
+                return &m_params[i];
+        }
+        return NULL;
+    }
+
+    bool push(const string *name, const char *value, size_t len)
+    {
+        if (m_count >= MAX_PARAMS)
+            return false;
+        m_params[m_count].name = name;
+        m_params[m_count].value = value;
+        m_params[m_count].len = len;
+        ++m_count;
+        return true;
+    }
+
+    void pop() { --m_count; }
+
+private:
+    param m_params[MAX_PARAMS];
+    int m_count;
+};
+
+template <class H>
+class route_trie
+{
+public:
+    static const int ANY_METHOD = -1;
+    static const int METHOD_COUNT = 9;
+
+    route_trie() { m_nodes.push_back(node()); }
+
+    //pattern以'/'开头；同一模式、同一方法重复注册时后者覆盖前者
+    //同一位置的参数段或通配段只能有一个名字，以先注册的为准
+    void add(int method, const char *pattern, const H &handler)
+    {
+        int cur = 0;
+        const char *p = pattern;
+        while (*p)
+        {
+            if (':' == *p || '*' == *p)
+            {
+                bool wildcard = '*' == *p;
+                size_t n = wildcard ? strlen(p + 1) : strcspn(p + 1, "/");
+                int child = wildcard ? m_nodes[cur].wildcard : m_nodes[cur].param;
+                if (child < 0)
+                {
+                    child = new_node(string());
+                    m_nodes[child].name.assign(p + 1, n);
+                    if (wildcard)
+                        m_nodes[cur].wildcard = child;
+                    else
+                        m_nodes[cur].param = child;
+                }
+                cur = child;
+                p += 1 + n;
+            }
+            else
+            {
+                size_t n = strcspn(p, ":*");
+                cur = insert_static(cur, string(p, n));
+                p += n;
+            }
+        }
+
+        int slot = method >= 0 && method < METHOD_COUNT ? method : METHOD_COUNT;
+        m_nodes[cur].handlers[slot] = handler;
+        m_nodes[cur].has[slot] = true;
+    }
+
+    //只匹配path的前len字节，调用者先去掉查询串；没有匹配的路由或方法不允许时返回NULL
+    //返回的参数指向path，path需在使用参数期间保持有效
+    const H *match(int method, const char *path, size_t len, route_params &params) const
+    {
+        params.m_count = 0;
+        return match_node(0, method, path, 0, len, params);
+    }
+
+private:
+    struct node
+    {
+        string prefix;         //进入该节点的静态边
+        string name;           //参数段或通配段的名字
+        vector<int> children;  //静态子节点
+        int param;
+        int wildcard;
+        H handlers[METHOD_COUNT + 1];  //最后一个为不限方法
+        bool has[METHOD_COUNT + 1];
+
+        node() : param(-1), wildcard(-1), handlers(), has() {}
+    };
+
+    int new_node(const string &prefix)
+    {
+        m_nodes.push_back(node());
+        m_nodes.back().prefix = prefix;
+        return (int)m_nodes.size() - 1;
+    }
+
+    int find_child(int cur, char c) const
+    {
+        const vector<int> &children = m_nodes[cur].children;
+        for (size_t i = 0; i < children.size(); ++i)
+        {
+            if (m_nodes[children[i]].prefix[0] == c)
+                return children[i];
+        }
+        return -1;
+    }
+
+    int insert_static(int cur, string text)
+    {
+        while (!text.empty())
+        {
+            int child = find_child(cur, text[0]);
+            if (child < 0)
+            {
+                child = new_node(text);
+                m_nodes[cur].children.push_back(child);
+                return child;
+            }
+
+            string prefix = m_nodes[child].prefix;
+            size_t common = 0;
+            while (common < prefix.size() && common < text.size() && prefix[common] == text[common])
+                ++common;
+            if (common < prefix.size())
+            {
+                //只有部分前缀相同时拆开这条边，公共部分成为新的中间节点
+                int mid = new_node(prefix.substr(0, common));
+                m_nodes[child].prefix.erase(0, common);
+                m_nodes[mid].children.push_back(child);
+                vector<int> &children = m_nodes[cur].children;
+                for (size_t i = 0; i < children.size(); ++i)
+                {
+                    if (children[i] == child)
+                        children[i] = mid;
+                }
+                child = mid;
+            }
+            cur = child;
+            text.erase(0, common);
+        }
+        return cur;
+    }
+
+    const H *handler(int index, int method) const
+    {
+        const node &n = m_nodes[index];
+        if (method >= 0 && method < METHOD_COUNT && n.has[method])
+            return &n.handlers[method];
+        if (n.has[METHOD_COUNT])
+            return &n.handlers[METHOD_COUNT];
+        return NULL;
+    }
+
+    const H *match_node(int index, int method, const char *path, size_t pos, size_t len, route_params &params) const
+    {
+        const node &n = m_nodes[index];
+        const H *found = NULL;
+        if (pos == len)
+        {
+            found = handler(index, method);
+            if (found)
+                return found;
+        }
+        else
+        {
+            int child = find_child(index, path[pos]);
+            if (child >= 0)
+            {
+                const string &prefix = m_nodes[child].prefix;
+                if (len - pos >= prefix.size() && memcmp(path + pos, prefix.data(), prefix.size()) == 0)
+                {
+                    found = match_node(child, method, path, pos + prefix.size(), len, params);
+                    if (found)
+                        return found;
+                }
+            }
+
+            if (n.param >= 0)
+            {
+                size_t end = pos;
+                while (end < len && path[end] != '/')
+                    ++end;
+                if (end > pos && params.push(&m_nodes[n.param].name, path + pos, end - pos))
+                {
+                    found = match_node(n.param, method, path, end, len, params);
+                    if (found)
+                        return found;
+                    params.pop();
+                }
+            }
+        }
+
+        if (n.wildcard >= 0)
+        {
+            found = handler(n.wildcard, method);
+            if (found && params.push(&m_nodes[n.wildcard].name, path + pos, len - pos))
+                return found;
+        }
+        return NULL;
+    }
+
+private:
+    vector<node> m_nodes;
+};
+
+#endif
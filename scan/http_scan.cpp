@@ -0,0 +1,162 @@
+#include "http_scan.h"
+
+#include <string.h>
+#include <strings.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+typedef size_t (*find2_func)(const char *, size_t, char, char);
+
+static size_t find2_scalar(const char *p, size_t len, char a, char b)
+{
+    for (size_t i = 0; i < len; ++i)
+    {
+        if (p[i] == a || p[i] == b)
+            return i;
+    }
+    return len;
+}
+
+#ifdef SCAN_X86
+//每次比较16字节：pcmpestri在needle中的任一字节出现时给出最低位置
+__attribute__((target("sse4.2"))) static size_t find2_sse42(const char *p, size_t len, char a, char b)
+{
+    const __m128i needle = _mm_setr_epi8(a, b, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(p + i));
+        int idx = _mm_cmpestri(needle, 2, chunk, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if (idx < 16)
+            return i + idx;
+    }
+    return i + find2_scalar(p + i, len - i, a, b);
+}
+
+//每次比较32字节，两个比较结果合并后取最低的置位
+__attribute__((target("avx2"))) static size_t find2_avx2(const char *p, size_t len, char a, char b)
+{
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, va), _mm256_cmpeq_epi8(chunk, vb));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return i + find2_scalar(p + i, len - i, a, b);
+}
+#endif
+
+struct scan_entry
+{
+    const char *name;
+    find2_func func;
+};
+
+static const scan_entry scan_impls[] = {
+#ifdef SCAN_X86
+    {"avx2", find2_avx2},
+    {"sse4.2", find2_sse42},
+#endif
+    {"scalar", find2_scalar},
+};
+
+static bool cpu_supports(const char *impl)
+{
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (strcmp(impl, "avx2") == 0)
+        return __builtin_cpu_supports("avx2");
+    if (strcmp(impl, "sse4.2") == 0)
+        return __builtin_cpu_supports("sse4.2");
+#endif
+    return strcmp(impl, "scalar") == 0;
+}
+
+//按优先顺序取CPU支持的第一个实现
+static const scan_entry *choose_impl()
+{
+    for (size_t i = 0; i < sizeof(scan_impls) / sizeof(scan_impls[0]); ++i)
+    {
+        if (cpu_supports(scan_impls[i].name))
+            return &scan_impls[i];
+    }
+    return &scan_impls[sizeof(scan_impls) / sizeof(scan_impls[0]) - 1];
+}
+
+static const scan_entry *current_impl = choose_impl();
+
+size_t scan_find2(const char *p, size_t len, char a, char b)
+{
+    return current_impl->func(p, len, a, b);
+}
+
+const char *scan_impl()
+{
+    return current_impl->name;
+}
+
+bool scan_force(const char *impl)
+{
+    for (size_t i = 0; i < sizeof(scan_impls) / sizeof(scan_impls[0]); ++i)
+    {
+        if (strcmp(scan_impls[i].name, impl) == 0 && cpu_supports(impl))
+        {
+            current_impl = &scan_impls[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+struct header_entry
+{
+    const char *name;
+    size_t len;
+    HEADER_NAME id;
+};
+
+//槽位由header_slot计算，各名称互不冲突；增删头部时需重新选取系数
+static const header_entry header_table[16] = {
+    {"if-none-match", 13, HEADER_IF_NONE_MATCH},
+    {"upgrade", 7, HEADER_UPGRADE},
+    {NULL, 0, HEADER_UNKNOWN},
+    {"http2-settings", 14, HEADER_HTTP2_SETTINGS},
+    {NULL, 0, HEADER_UNKNOWN},
+    {"connection", 10, HEADER_CONNECTION},
+    {"range", 5, HEADER_RANGE},
+    {"if-modified-since", 17, HEADER_IF_MODIFIED_SINCE},
+    {"host", 4, HEADER_HOST},
+    {NULL, 0, HEADER_UNKNOWN},
+    {"cookie", 6, HEADER_COOKIE},
+    {"accept-encoding", 15, HEADER_ACCEPT_ENCODING},
+    {NULL, 0, HEADER_UNKNOWN},
+    {NULL, 0, HEADER_UNKNOWN},
+    {"if-range", 8, HEADER_IF_RANGE},
+    {"content-length", 14, HEADER_CONTENT_LENGTH},
+};
+
+//由长度与首尾字节(转小写)计算槽位
+static inline size_t header_slot(const char *name, size_t len)
+{
+    unsigned first = (unsigned char)name[0] | 0x20;
+    unsigned last = (unsigned char)name[len - 1] | 0x20;
+    return (len + first * 3 + last * 15) & 15;
+}
+
+HEADER_NAME lookup_header(const char *name, size_t len)
+{
+    if (0 == len)
+        return HEADER_UNKNOWN;
+    const header_entry &entry = header_table[header_slot(name, len)];
+    if (entry.len == len && strncasecmp(entry.name, name, len) == 0)
+        return entry.id;
+    return HEADER_UNKNOWN;
+}
@@ -0,0 +1,34 @@
+#ifndef HTTP_SCAN_H
+#define HTTP_SCAN_H
+
+#include <stddef.h>
+
+//http_conn关心的请求头，其余头部一律忽略
+enum HEADER_NAME
+{
+    HEADER_UNKNOWN = 0,
+    HEADER_CONNECTION,
+    HEADER_CONTENT_LENGTH,
+    HEADER_HOST,
+    HEADER_COOKIE,
+    HEADER_RANGE,
+    HEADER_IF_RANGE,
+    HEADER_IF_NONE_MATCH,
+    HEADER_IF_MODIFIED_SINCE,
+    HEADER_ACCEPT_ENCODING,
+    HEADER_UPGRADE,
+    HEADER_HTTP2_SETTINGS
+};
+
+//在[p, p + len)中查找第一个等于a或b的字节，返回其下标，没有时返回len；不读取范围之外的字节
+//启动时按CPU选用AVX2、SSE4.2或逐字节的实现
+size_t scan_find2(const char *p, size_t len, char a, char b);
+//当前使用的实现："avx2"、"sse4.2"或"scalar"
+const char *scan_impl();
+//测试用：改用指定的实现，CPU不支持时返回false
+bool scan_force(const char *impl);
+
+//按头部名称(不含冒号，不区分大小写)查完美哈希表，一次比较即可确定
+HEADER_NAME lookup_header(const char *name, size_t len);
+
+#endif
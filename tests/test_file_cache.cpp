@@ -0,0 +1,154 @@
+#include <gtest/gtest.h>
+#include "../cache/file_cache.h"
+#include "../compress/gzip_encoder.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string>
+
+using namespace std;
+
+class FileCacheTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        char tmpl[] = "/tmp/file_cache_test_XXXXXX";
+        ASSERT_NE(mkdtemp(tmpl), nullptr);
+        root = tmpl;
+        chmod(root.c_str(), 0755);
+        cache = file_cache::get_instance();
+        ASSERT_GE(cache->init(root.c_str()), 0);
+    }
+
+    void TearDown() override {
+        cache->clear();
+        string cmd = "rm -rf " + root;
+        ASSERT_EQ(system(cmd.c_str()), 0);
+    }
+
+    string write_file(const string& name, const string& content) {
+        string path = root + "/" + name;
+        FILE* fp = fopen(path.c_str(), "w");
+        fwrite(content.data(), 1, content.size(), fp);
+        fclose(fp);
+        return path;
+    }
+
+    file_cache* cache;
+    string root;
+};
+
+TEST_F(FileCacheTest, HitReturnsSameEntryWithPrecomputedHeaders) {
+    string path = write_file("a.css", "body{}");
+
+    file_entry* first = nullptr;
+    ASSERT_EQ(cache->acquire(path.c_str(), first), 0);
+    EXPECT_EQ(string(first->address, first->st.st_size), "body{}");
+    EXPECT_EQ(first->headers, "Content-Type:text/css; charset=utf-8\r\nETag:" + first->etag + "\r\nLast-Modified:" +
+                                  first->last_modified + "\r\nVary:Accept-Encoding\r\nAccept-Ranges:bytes\r\nContent-Length:6\r\n");
+
+    file_entry* second = nullptr;
+    ASSERT_EQ(cache->acquire(path.c_str(), second), 0);
+    EXPECT_EQ(first, second);
+    cache->release(first);
+    cache->release(second);
+}
+
+TEST_F(FileCacheTest, InotifyInvalidatesModifiedFile) {
+    string path = write_file("a.html", "old");
+    file_entry* entry = nullptr;
+    ASSERT_EQ(cache->acquire(path.c_str(), entry), 0);
+
+    write_file("a.html", "newer");
+    cache->process_events();
+
+    file_entry* fresh = nullptr;
+    ASSERT_EQ(cache->acquire(path.c_str(), fresh), 0);
+    EXPECT_NE(fresh, entry);
+    EXPECT_EQ(string(fresh->address, fresh->st.st_size), "newer");
+    cache->release(entry);
+    cache->release(fresh);
+}
+
+TEST_F(FileCacheTest, ErrorsForMissingAndDirectory) {
+    file_entry* entry = nullptr;
+    EXPECT_EQ(cache->acquire((root + "/missing.html").c_str(), entry), ENOENT);
+    EXPECT_EQ(cache->acquire(root.c_str(), entry), EISDIR);
+}
+
+TEST_F(FileCacheTest, GzipSidecarServedAsVariant) {
+    string css;
+    for (int i = 0; i < 200; ++i)
+        css += ".item" + to_string(i) + "{margin:0;padding:0;}\n";
+    string path = write_file("site.css", css);
+    ASSERT_TRUE(gzip_sidecar(path.c_str()));
+    cache->process_events();
+
+    file_entry* entry = nullptr;
+    ASSERT_EQ(cache->acquire(path.c_str(), entry), 0);
+    ASSERT_NE(entry->gzip, nullptr);
+    file_entry* variant = cache->use_gzip(entry);
+    EXPECT_LT(variant->st.st_size, (off_t)css.size());
+    EXPECT_EQ((unsigned char)variant->address[0], 0x1f);
+    EXPECT_EQ((unsigned char)variant->address[1], 0x8b);
+    EXPECT_EQ(variant->type_line, entry->type_line);
+    EXPECT_EQ(variant->etag, entry->etag.substr(0, entry->etag.size() - 1) + "-gz\"");
+    EXPECT_NE(variant->headers.find("Content-Encoding:gzip\r\n"), string::npos);
+    cache->release(variant);
+}
+
+// 源文件在生成副本的同一秒内再次修改：按纳秒比较修改时间，旧副本不再作为变体，也会被重新生成
+TEST_F(FileCacheTest, SidecarFromSameSecondEditIsStale) {
+    string css;
+    for (int i = 0; i < 200; ++i)
+        css += ".old" + to_string(i) + "{margin:0;}\n";
+    string path = write_file("same.css", css);
+    ASSERT_TRUE(gzip_sidecar(path.c_str()));
+
+    struct stat gz;
+    ASSERT_EQ(stat((path + ".gz").c_str(), &gz), 0);
+    write_file("same.css", css + ".new{margin:0;}\n");
+    struct timespec times[2] = {gz.st_atim, gz.st_mtim};
+    times[1].tv_nsec = gz.st_mtim.tv_nsec > 0 ? gz.st_mtim.tv_nsec - 1 : 1;
+    ASSERT_EQ(utimensat(AT_FDCWD, path.c_str(), times, 0), 0);
+    cache->process_events();
+
+    file_entry* entry = nullptr;
+    ASSERT_EQ(cache->acquire(path.c_str(), entry), 0);
+    EXPECT_EQ(entry->gzip, nullptr);
+    cache->release(entry);
+
+    ASSERT_TRUE(gzip_sidecar(path.c_str()));
+    struct stat origin, fresh;
+    ASSERT_EQ(stat(path.c_str(), &origin), 0);
+    ASSERT_EQ(stat((path + ".gz").c_str(), &fresh), 0);
+    EXPECT_TRUE(gzip_sidecar_fresh(fresh, origin));
+}
+
+// 启用预压缩后，源文件写入完成由后台线程重新生成副本，process_events本身不压缩
+TEST_F(FileCacheTest, SidecarRegeneratedInBackground) {
+    cache->enable_precompress();
+    string js;
+    for (int i = 0; i < 200; ++i)
+        js += "var v" + to_string(i) + " = " + to_string(i) + ";\n";
+    string path = write_file("app.js", js);
+    cache->process_events();
+
+    struct stat origin, gz;
+    ASSERT_EQ(stat(path.c_str(), &origin), 0);
+    bool fresh = false;
+    for (int i = 0; i < 500 && !fresh; ++i) {
+        usleep(10 * 1000);
+        fresh = stat((path + ".gz").c_str(), &gz) == 0 && gzip_sidecar_fresh(gz, origin);
+    }
+    ASSERT_TRUE(fresh);
+
+    cache->process_events();
+    file_entry* entry = nullptr;
+    ASSERT_EQ(cache->acquire(path.c_str(), entry), 0);
+    EXPECT_NE(entry->gzip, nullptr);
+    cache->release(entry);
+}
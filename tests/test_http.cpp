@@ -6,6 +6,7 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <sys/epoll.h>
 #include <cstring>
 #include <vector>
@@ -25,8 +26,15 @@ public:
     static int& get_write_idx(http_conn& conn) { return conn.m_write_idx; }
     static long& get_checked_idx(http_conn& conn) { return conn.m_checked_idx; }
     static long& get_content_length(http_conn& conn) { return conn.m_content_length; }
-    static char* get_read_buf(http_conn& conn) { return conn.m_read_buf; }
-    static char* get_write_buf(http_conn& conn) { return conn.m_write_buf; }
+    // 缓冲区按需从池中取得，直接写入前先挂上
+    static char* get_read_buf(http_conn& conn) {
+        conn.attach_buffer(conn.m_read_buf, http_conn::READ_BUFFER_SIZE);
+        return conn.m_read_buf;
+    }
+    static char* get_write_buf(http_conn& conn) {
+        conn.attach_buffer(conn.m_write_buf, conn.m_write_cap);
+        return conn.m_write_buf;
+    }
     static char*& get_url(http_conn& conn) { return conn.m_url; }
     static char*& get_version(http_conn& conn) { return conn.m_version; }
     static char*& get_host(http_conn& conn) { return conn.m_host; }
@@ -39,6 +47,9 @@ public:
     static http_conn::HTTP_CODE call_parse_headers(http_conn& conn, char* text) {
         return conn.parse_headers(text);
     }
+    static http_conn::HTTP_CODE call_process_read(http_conn& conn) {
+        return conn.process_read();
+    }
     static http_conn::LINE_STATUS call_parse_line(http_conn& conn) {
         return conn.parse_line();
     }
@@ -54,6 +65,27 @@ public:
     static bool call_add_cookie(http_conn& conn, const string& name, const string& value, int max_age) {
         return conn.add_cookie(name, value, max_age);
     }
+    static string& get_response_body(http_conn& conn) { return conn.m_response_body; }
+    static Response& get_response(http_conn& conn) { return conn.m_response; }
+    static iovec* get_iov(http_conn& conn, int& count) { return conn.get_iov(count); }
+    static bool call_next_request(http_conn& conn) { return conn.next_request(); }
+    static bool is_h2(http_conn& conn) { return conn.m_h2 != NULL; }
+    static http_conn::HTTP_CODE call_login_page(http_conn& conn, const string& path, const string& username) {
+        conn.attach_buffer(conn.m_real_file, http_conn::FILENAME_LEN);
+        strncpy(conn.m_real_file, path.c_str(), http_conn::FILENAME_LEN - 1);
+        static char url[] = "/welcome.html";
+        conn.m_url = url;
+        conn.login_username = username;
+        conn.login_role = "user";
+        return conn.serve_file();
+    }
+    static bool call_process_write(http_conn& conn, http_conn::HTTP_CODE ret) {
+        return conn.process_write(ret);
+    }
+    static void call_end_stream(http_conn& conn, const string& rest) {
+        Response response;
+        conn.end_stream(response.append(rest));
+    }
 };
 
 class HttpConnTest : public ::testing::Test {
@@ -87,12 +119,8 @@ protected:
 
 TEST_F(HttpConnTest, InitializationTest) {
     string root = "/var/www/html";
-    string user = "testuser";
-    string passwd = "testpass";
-    string sqlname = "testdb";
     
-    conn.init(sockfd, client_addr, const_cast<char*>(root.c_str()), 
-             0, 0, user, passwd, sqlname);
+    conn.init(sockfd, client_addr, const_cast<char*>(root.c_str()), 0, 0);
     
     EXPECT_EQ(HttpConnTestAccessor::get_sockfd(conn), sockfd);
     EXPECT_EQ(memcmp(&HttpConnTestAccessor::get_address(conn), &client_addr, sizeof(sockaddr_in)), 0);
@@ -104,7 +132,7 @@ TEST_F(HttpConnTest, InitializationTest) {
 }
 
 TEST_F(HttpConnTest, ParseRequestLineValidGetRequest) {
-    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 0, "user", "pass", "db");
+    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 0);
     
     char request_line[] = "GET /index.html HTTP/1.1";
     http_conn::HTTP_CODE result = HttpConnTestAccessor::call_parse_request_line(conn, request_line);
@@ -116,7 +144,7 @@ TEST_F(HttpConnTest, ParseRequestLineValidGetRequest) {
 }
 
 TEST_F(HttpConnTest, ParseRequestLineValidPostRequest) {
-    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 0, "user", "pass", "db");
+    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 0);
     
     char request_line[] = "POST /api/login HTTP/1.1";
     http_conn::HTTP_CODE result = HttpConnTestAccessor::call_parse_request_line(conn, request_line);
@@ -128,7 +156,7 @@ TEST_F(HttpConnTest, ParseRequestLineValidPostRequest) {
 }
 
 TEST_F(HttpConnTest, ParseRequestLineInvalidMethod) {
-    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 0, "user", "pass", "db");
+    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 0);
     
     char request_line[] = "INVALID /index.html HTTP/1.1";
     http_conn::HTTP_CODE result = HttpConnTestAccessor::call_parse_request_line(conn, request_line);
@@ -137,7 +165,7 @@ TEST_F(HttpConnTest, ParseRequestLineInvalidMethod) {
 }
 
 TEST_F(HttpConnTest, ParseRequestLineInvalidVersion) {
-    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 0, "user", "pass", "db");
+    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 0);
     
     char request_line[] = "GET /index.html HTTP/2.0";
     http_conn::HTTP_CODE result = HttpConnTestAccessor::call_parse_request_line(conn, request_line);
@@ -146,7 +174,7 @@ TEST_F(HttpConnTest, ParseRequestLineInvalidVersion) {
 }
 
 TEST_F(HttpConnTest, ParseRequestLineMalformed) {
-    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 0, "user", "pass", "db");
+    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 0);
     
     char request_line[] = "GET";
     http_conn::HTTP_CODE result = HttpConnTestAccessor::call_parse_request_line(conn, request_line);
@@ -155,7 +183,7 @@ TEST_F(HttpConnTest, ParseRequestLineMalformed) {
 }
 
 TEST_F(HttpConnTest, ParseLineStatusTests) {
-    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 0, "user", "pass", "db");
+    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 0);
     
     strcpy(HttpConnTestAccessor::get_read_buf(conn), "GET /index.html HTTP/1.1\r\n");
     HttpConnTestAccessor::get_read_idx(conn) = strlen(HttpConnTestAccessor::get_read_buf(conn));
@@ -166,7 +194,7 @@ TEST_F(HttpConnTest, ParseLineStatusTests) {
 }
 
 TEST_F(HttpConnTest, ParseLineIncompleteData) {
-    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 0, "user", "pass", "db");
+    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 0);
     
     strcpy(HttpConnTestAccessor::get_read_buf(conn), "GET /index.html");
     HttpConnTestAccessor::get_read_idx(conn) = strlen(HttpConnTestAccessor::get_read_buf(conn));
@@ -177,7 +205,7 @@ TEST_F(HttpConnTest, ParseLineIncompleteData) {
 }
 
 TEST_F(HttpConnTest, ParseLineBadFormat) {
-    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 0, "user", "pass", "db");
+    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 0);
     
     strcpy(HttpConnTestAccessor::get_read_buf(conn), "GET /index.html\n");
     HttpConnTestAccessor::get_read_idx(conn) = strlen(HttpConnTestAccessor::get_read_buf(conn));
@@ -188,7 +216,7 @@ TEST_F(HttpConnTest, ParseLineBadFormat) {
 }
 
 TEST_F(HttpConnTest, ParseHeadersValidHeaders) {
-    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 0, "user", "pass", "db");
+    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 0);
     
     char header1[] = "Host: localhost:8080";
     http_conn::HTTP_CODE result1 = HttpConnTestAccessor::call_parse_headers(conn, header1);
@@ -207,7 +235,7 @@ TEST_F(HttpConnTest, ParseHeadersValidHeaders) {
 }
 
 TEST_F(HttpConnTest, ParseHeadersEmptyLine) {
-    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 0, "user", "pass", "db");
+    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 0);
     
     char empty_line[] = "";
     http_conn::HTTP_CODE result = HttpConnTestAccessor::call_parse_headers(conn, empty_line);
@@ -215,7 +243,7 @@ TEST_F(HttpConnTest, ParseHeadersEmptyLine) {
 }
 
 TEST_F(HttpConnTest, CloseConnectionTest) {
-    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 0, "user", "pass", "db");
+    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 0);
     int initial_count = http_conn::m_user_count;
     
     conn.close_conn(true);
@@ -225,7 +253,7 @@ TEST_F(HttpConnTest, CloseConnectionTest) {
 }
 
 TEST_F(HttpConnTest, BufferOverflowProtection) {
-    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 0, "user", "pass", "db");
+    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 0);
     
     HttpConnTestAccessor::get_read_idx(conn) = http_conn::READ_BUFFER_SIZE;
     bool result = conn.read_once();
@@ -233,6 +261,206 @@ TEST_F(HttpConnTest, BufferOverflowProtection) {
     EXPECT_FALSE(result);
 }
 
+TEST_F(HttpConnTest, LargeBodySpillsIntoChain) {
+    conn.init(sockfd, client_addr, const_cast<char*>("/nonexistent"), 0, 1);
+
+    string body(20000, 'x');
+    for (size_t i = 0; i < body.size(); ++i)
+        body[i] = 'a' + i % 26;
+    string head = "POST /upload HTTP/1.1\r\nContent-Length: 20000\r\n\r\n";
+    ASSERT_TRUE(conn.append_read(head.data(), head.size()));
+    ASSERT_TRUE(conn.append_read(body.data(), body.size()));
+
+    EXPECT_EQ(HttpConnTestAccessor::call_process_read(conn), http_conn::NO_RESOURCE);
+    EXPECT_EQ(conn.body_length(), 20000);
+    EXPECT_EQ(conn.body_view(), nullptr);
+    EXPECT_EQ(conn.body_string(), body);
+
+    char part[100];
+    EXPECT_EQ(conn.read_body(19950, part, sizeof(part)), 50u);
+    EXPECT_EQ(string(part, 50), body.substr(19950));
+}
+
+TEST_F(HttpConnTest, BodyOverLimitRejected) {
+    long saved = http_conn::m_max_body;
+    http_conn::m_max_body = 1024;
+    conn.init(sockfd, client_addr, const_cast<char*>("/nonexistent"), 0, 1);
+
+    string head = "POST /upload HTTP/1.1\r\nContent-Length: 4096\r\n\r\n";
+    ASSERT_TRUE(conn.append_read(head.data(), head.size()));
+    EXPECT_EQ(HttpConnTestAccessor::call_process_read(conn), http_conn::BODY_TOO_LARGE);
+
+    http_conn::m_max_body = saved;
+}
+
+// HTTP/2前言只在连接的第一个请求处识别，不限制请求数时也一样
+TEST_F(HttpConnTest, H2PrefaceIgnoredAfterFirstRequest) {
+    ASSERT_EQ(http_conn::m_max_requests, 0);
+    char tmpl[] = "/tmp/h2_preface_XXXXXX";
+    ASSERT_NE(mkdtemp(tmpl), nullptr);
+    string dir(tmpl);
+    FILE* f = fopen((dir + "/x.txt").c_str(), "w");
+    fputs("x", f);
+    fclose(f);
+    conn.init(sockfd, client_addr, const_cast<char*>(dir.c_str()), 0, 1);
+
+    string reqs = "GET /x.txt HTTP/1.1\r\nHost: a\r\n\r\n" + string(h2_session::PREFACE, h2_session::PREFACE_LEN);
+    ASSERT_TRUE(conn.append_read(reqs.data(), reqs.size()));
+    EXPECT_TRUE(conn.process());
+    ASSERT_TRUE(HttpConnTestAccessor::call_next_request(conn));
+    conn.process();
+    EXPECT_FALSE(HttpConnTestAccessor::is_h2(conn));
+
+    conn.close_conn();
+    sockfd = -1;
+    file_cache::get_instance()->clear();
+    unlink((dir + "/x.txt").c_str());
+    rmdir(dir.c_str());
+}
+
+// 请求体之后紧跟的下一个请求在复位后保留，且首字节不受请求体结尾'\0'的影响
+TEST_F(HttpConnTest, PipelinedRequestKeptAfterResponse) {
+    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 1);
+
+    string reqs = "POST /a HTTP/1.1\r\nContent-Length: 3\r\n\r\nabcGET /b HTTP/1.1\r\nConnection: close\r\n\r\n";
+    ASSERT_TRUE(conn.append_read(reqs.data(), reqs.size()));
+    HttpConnTestAccessor::call_process_read(conn);
+    EXPECT_STREQ(conn.body_view(), "abc");
+    EXPECT_TRUE(HttpConnTestAccessor::get_linger(conn));
+
+    ASSERT_TRUE(HttpConnTestAccessor::call_next_request(conn));
+    EXPECT_TRUE(conn.has_pending());
+    HttpConnTestAccessor::call_process_read(conn);
+    EXPECT_STREQ(HttpConnTestAccessor::get_url(conn), "/b");
+    EXPECT_EQ(HttpConnTestAccessor::get_method(conn), http_conn::GET);
+    EXPECT_FALSE(HttpConnTestAccessor::get_linger(conn));
+    EXPECT_FALSE(HttpConnTestAccessor::call_next_request(conn));
+}
+
+// 分段输出立即以chunk写出，剩余部分与结束chunk留给write()
+TEST_F(HttpConnTest, StreamedChunksSentDuringRendering) {
+    int sv[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+    conn.init(sv[0], client_addr, const_cast<char*>("/var/www/html"), 0, 1);
+
+    chunk_writer sink(&conn);
+    sink.write("<head>");
+    sink.write("");
+    char buf[256];
+    ssize_t n = recv(sv[1], buf, sizeof(buf), MSG_DONTWAIT);
+    ASSERT_GT(n, 0);
+    EXPECT_EQ(string(buf, n), "HTTP/1.1 200 OK\r\nContent-Type:text/html\r\nVary:Accept-Encoding\r\n"
+                              "Transfer-Encoding:chunked\r\nConnection:close\r\n\r\n6\r\n<head>\r\n");
+
+    HttpConnTestAccessor::call_end_stream(conn, "<body></body>");
+    EXPECT_EQ(HttpConnTestAccessor::get_response_body(conn), "d\r\n<body></body>\r\n0\r\n\r\n");
+    EXPECT_TRUE(HttpConnTestAccessor::call_process_write(conn, http_conn::STREAM_REQUEST));
+    conn.close_conn();
+    close(sv[1]);
+}
+
+TEST_F(HttpConnTest, HeaderBuilderOutput) {
+    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 1);
+
+    EXPECT_TRUE(HttpConnTestAccessor::call_add_status_line(conn, 200, "OK"));
+    EXPECT_TRUE(HttpConnTestAccessor::call_add_status_line(conn, 418, "I'm a teapot"));
+    EXPECT_TRUE(HttpConnTestAccessor::call_add_headers(conn, 1234567));
+    string out(HttpConnTestAccessor::get_write_buf(conn), HttpConnTestAccessor::get_write_idx(conn));
+    EXPECT_EQ(out, "HTTP/1.1 200 OK\r\nHTTP/1.1 418 I'm a teapot\r\n"
+                   "Content-Length:1234567\r\nConnection:close\r\n\r\n");
+}
+
+TEST_F(HttpConnTest, LongCookieGrowsWriteBuffer) {
+    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 1);
+
+    string value(3000, 'v');
+    EXPECT_TRUE(HttpConnTestAccessor::call_add_status_line(conn, 200, "OK"));
+    EXPECT_TRUE(HttpConnTestAccessor::call_add_cookie(conn, "big", value, 60));
+    string out(HttpConnTestAccessor::get_write_buf(conn), HttpConnTestAccessor::get_write_idx(conn));
+    EXPECT_EQ(out, "HTTP/1.1 200 OK\r\nSet-Cookie: big=" + value + "; Max-Age=60; Path=/\r\n");
+}
+
+TEST_F(HttpConnTest, DynamicBodyGzippedWhenAccepted) {
+    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 1);
+
+    char header[] = "Accept-Encoding: deflate, gzip";
+    HttpConnTestAccessor::call_parse_headers(conn, header);
+    string html;
+    for (int i = 0; i < 100; ++i)
+        html += "<p>article " + to_string(i) + "</p>\n";
+    HttpConnTestAccessor::get_response(conn).append(html);
+    ASSERT_TRUE(HttpConnTestAccessor::call_process_write(conn, http_conn::CONTENT_REQUEST));
+
+    string head(HttpConnTestAccessor::get_write_buf(conn), HttpConnTestAccessor::get_write_idx(conn));
+    const string& body = HttpConnTestAccessor::get_response_body(conn);
+    EXPECT_NE(head.find("Vary:Accept-Encoding\r\nContent-Encoding:gzip\r\n"), string::npos);
+    EXPECT_NE(head.find("Content-Length:" + to_string(body.size()) + "\r\n"), string::npos);
+    EXPECT_LT(body.size(), html.size());
+    EXPECT_EQ((unsigned char)body[0], 0x1f);
+}
+
+// 登录成功页与普通文件一样可能换成.gz变体，响应头须带Content-Encoding
+TEST_F(HttpConnTest, LoginPageGzipVariantHasContentEncoding) {
+    char tmpl[] = "/tmp/login_gzip_XXXXXX";
+    ASSERT_NE(mkdtemp(tmpl), nullptr);
+    string dir(tmpl);
+    string page(2048, 'w');
+    FILE* f = fopen((dir + "/welcome.html").c_str(), "w");
+    fwrite(page.data(), 1, page.size(), f);
+    fclose(f);
+    f = fopen((dir + "/welcome.html.gz").c_str(), "w");
+    fwrite("\x1f\x8b\x08\x00", 1, 4, f);
+    fclose(f);
+    // 副本与源文件修改时间相同才被使用(同gzip -k)
+    struct stat st;
+    ASSERT_EQ(stat((dir + "/welcome.html").c_str(), &st), 0);
+    struct timespec times[2] = {st.st_atim, st.st_mtim};
+    ASSERT_EQ(utimensat(AT_FDCWD, (dir + "/welcome.html.gz").c_str(), times, 0), 0);
+
+    conn.init(sockfd, client_addr, const_cast<char*>(dir.c_str()), 0, 1);
+    char header[] = "Accept-Encoding: gzip";
+    HttpConnTestAccessor::call_parse_headers(conn, header);
+    http_conn::HTTP_CODE ret = HttpConnTestAccessor::call_login_page(conn, dir + "/welcome.html", "alice");
+    ASSERT_EQ(ret, http_conn::LOGIN_SUCCESS);
+    ASSERT_TRUE(HttpConnTestAccessor::call_process_write(conn, ret));
+
+    string head(HttpConnTestAccessor::get_write_buf(conn), HttpConnTestAccessor::get_write_idx(conn));
+    EXPECT_EQ(head.find("HTTP/1.1 200 OK\r\nContent-Type:text/html\r\n"), 0u);
+    EXPECT_NE(head.find("Content-Encoding:gzip\r\n"), string::npos);
+    EXPECT_NE(head.find("Vary:Accept-Encoding\r\n"), string::npos);
+    EXPECT_NE(head.find("Set-Cookie: session_id="), string::npos);
+    EXPECT_NE(head.find("Content-Length:4\r\n"), string::npos);
+
+    conn.close_conn();
+    sockfd = -1;
+    file_cache::get_instance()->clear();
+    unlink((dir + "/welcome.html.gz").c_str());
+    unlink((dir + "/welcome.html").c_str());
+    rmdir(dir.c_str());
+}
+
+// 处理器的状态码与Content-Type写入响应头，各段(含借用的静态数据)各占一个iovec，不拼接
+TEST_F(HttpConnTest, SegmentedResponseKeepsStatusAndType) {
+    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 1);
+
+    static const char prefix[] = "{\"success\":false,";
+    Response& response = HttpConnTestAccessor::get_response(conn);
+    response = Response(404, "application/json");
+    response.cache_control = "no-store";
+    response.borrow(prefix).append("\"message\":\"not found\"}");
+    ASSERT_TRUE(HttpConnTestAccessor::call_process_write(conn, http_conn::CONTENT_REQUEST));
+
+    string head(HttpConnTestAccessor::get_write_buf(conn), HttpConnTestAccessor::get_write_idx(conn));
+    EXPECT_EQ(head.find("HTTP/1.1 404 Not Found\r\nContent-Type:application/json\r\nCache-Control:no-store\r\n"), 0u);
+    EXPECT_NE(head.find("Content-Length:39\r\n"), string::npos);
+    int count = 0;
+    iovec* iov = HttpConnTestAccessor::get_iov(conn, count);
+    ASSERT_EQ(count, 3);
+    EXPECT_EQ(iov[1].iov_base, (void*)prefix);
+    EXPECT_EQ(string((char*)iov[2].iov_base, iov[2].iov_len), "\"message\":\"not found\"}");
+    EXPECT_TRUE(conn.is_writing());
+}
+
 // HttpResponseTest 移除，因为这些方法依赖日志系统初始化
 
 class UserSessionTest : public ::testing::Test {
@@ -435,7 +663,7 @@ protected:
 TEST_F(HttpConnectionLifecycleTest, FullInitializationTest) {
     int initial_count = http_conn::m_user_count;
     
-    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 0, "user", "pass", "db");
+    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 0);
     
     EXPECT_EQ(http_conn::m_user_count, initial_count + 1);
     EXPECT_EQ(HttpConnTestAccessor::get_sockfd(conn), sockfd);
@@ -444,7 +672,7 @@ TEST_F(HttpConnectionLifecycleTest, FullInitializationTest) {
 }
 
 TEST_F(HttpConnectionLifecycleTest, AddressGetterTest) {
-    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 0, "user", "pass", "db");
+    conn.init(sockfd, client_addr, const_cast<char*>("/var/www/html"), 0, 0);
     
     sockaddr_in* addr = conn.get_address();
     ASSERT_NE(addr, nullptr);
@@ -0,0 +1,140 @@
+#include <gtest/gtest.h>
+#include "../http2/hpack.h"
+#include "../http2/h2_session.h"
+#include <string>
+
+using namespace std;
+
+static string unhex(const char* hex) {
+    string out;
+    for (const char* p = hex; p[0] && p[1]; p += 2) {
+        char byte[3] = {p[0], p[1], 0};
+        out.push_back((char)strtol(byte, nullptr, 16));
+    }
+    return out;
+}
+
+static string frame(uint8_t type, uint8_t flags, uint32_t stream_id, const string& payload) {
+    string out;
+    out.push_back((char)(payload.size() >> 16));
+    out.push_back((char)(payload.size() >> 8));
+    out.push_back((char)payload.size());
+    out.push_back((char)type);
+    out.push_back((char)flags);
+    for (int shift = 24; shift >= 0; shift -= 8)
+        out.push_back((char)(stream_id >> shift));
+    return out + payload;
+}
+
+// RFC 7541 C.4：三个使用Huffman编码的请求共享同一个动态表
+TEST(HpackTest, DecodesRfcHuffmanRequests) {
+    hpack_decoder decoder;
+    const char* blocks[] = {
+        "828684418cf1e3c2e5f23a6ba0ab90f4ff",
+        "828684be5886a8eb10649cbf",
+        "828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf",
+    };
+    header_list headers;
+    for (size_t i = 0; i < 3; ++i) {
+        string block = unhex(blocks[i]);
+        headers.clear();
+        ASSERT_TRUE(decoder.decode((const unsigned char*)block.data(), block.size(), headers)) << i;
+    }
+    ASSERT_EQ(headers.size(), 5u);
+    EXPECT_EQ(headers[1].first, ":scheme");
+    EXPECT_EQ(headers[1].second, "https");
+    EXPECT_EQ(headers[3].second, "www.example.com");
+    EXPECT_EQ(headers[4].first, "custom-key");
+    EXPECT_EQ(headers[4].second, "custom-value");
+
+    // 填充位不全为1属于压缩错误
+    string bad = unhex("418cf1e3c2e5f23a6ba0ab90f4fe");
+    hpack_decoder other;
+    EXPECT_FALSE(other.decode((const unsigned char*)bad.data(), bad.size(), headers));
+}
+
+TEST(HpackTest, EncoderIndexesRepeatedHeaders) {
+    hpack_encoder encoder;
+    hpack_decoder decoder;
+    header_list headers;
+    headers.push_back(make_pair(string(":status"), string("200")));
+    headers.push_back(make_pair(string("content-type"), string("text/html")));
+    headers.push_back(make_pair(string("content-length"), string("4180")));
+
+    string first, second;
+    encoder.encode(headers, first);
+    encoder.encode(headers, second);
+    // 第二次content-type只需一个字节的动态表索引，content-length不进入动态表，仍按字面量发送
+    EXPECT_EQ(first.size(), 19u);
+    EXPECT_EQ(second.size(), 9u);
+
+    header_list decoded;
+    ASSERT_TRUE(decoder.decode((const unsigned char*)first.data(), first.size(), decoded));
+    decoded.clear();
+    ASSERT_TRUE(decoder.decode((const unsigned char*)second.data(), second.size(), decoded));
+    EXPECT_EQ(decoded, headers);
+}
+
+TEST(H2SessionTest, RequestTranslatedAndResponseFramed) {
+    h2_session session(1024);
+    session.start();
+
+    string block;
+    hpack_encoder encoder;
+    header_list request;
+    request.push_back(make_pair(string(":method"), string("GET")));
+    request.push_back(make_pair(string(":scheme"), string("http")));
+    request.push_back(make_pair(string(":path"), string("/judge.html")));
+    request.push_back(make_pair(string(":authority"), string("localhost")));
+    request.push_back(make_pair(string("cookie"), string("a=1")));
+    request.push_back(make_pair(string("cookie"), string("b=2")));
+    encoder.encode(request, block);
+
+    string in(h2_session::PREFACE, h2_session::PREFACE_LEN);
+    in += frame(0x4, 0, 0, "");
+    in += frame(0x1, 0x5, 1, block);
+    // 分两次送入，不完整的帧留到下次
+    ASSERT_TRUE(session.feed(in.data(), 30));
+    ASSERT_TRUE(session.feed(in.data() + 30, in.size() - 30));
+
+    int id = 0;
+    string text;
+    ASSERT_TRUE(session.next_request(id, text));
+    EXPECT_EQ(id, 1);
+    EXPECT_EQ(text, "GET /judge.html HTTP/1.1\r\nHost: localhost\r\nCookie: a=1; b=2\r\n\r\n");
+    EXPECT_FALSE(session.next_request(id, text));
+
+    const char head[] = "HTTP/1.1 200 OK\r\nContent-Length:5\r\nConnection:keep-alive\r\n\r\nhello";
+    string body;
+    session.respond(1, head, sizeof(head) - 1, body);
+
+    string out;
+    ASSERT_TRUE(session.produce(out));
+    // 本端SETTINGS、SETTINGS ACK、HEADERS、带END_STREAM的DATA
+    size_t pos = 0;
+    string types, data;
+    while (pos + 9 <= out.size()) {
+        size_t len = ((unsigned char)out[pos] << 16) | ((unsigned char)out[pos + 1] << 8) | (unsigned char)out[pos + 2];
+        types.push_back('0' + out[pos + 3]);
+        if (0 == out[pos + 3]) {
+            EXPECT_EQ(out[pos + 4], 0x1);
+            data = out.substr(pos + 9, len);
+        }
+        pos += 9 + len;
+    }
+    EXPECT_EQ(pos, out.size());
+    EXPECT_EQ(types, "4410");
+    EXPECT_EQ(data, "hello");
+    EXPECT_FALSE(session.closing());
+}
+
+TEST(H2SessionTest, BadPrefaceSendsGoaway) {
+    h2_session session(1024);
+    session.start();
+    const char junk[] = "GET / HTTP/1.1\r\n\r\n";
+    EXPECT_FALSE(session.feed(junk, sizeof(junk) - 1));
+    EXPECT_TRUE(session.closing());
+    string out;
+    ASSERT_TRUE(session.produce(out));
+    EXPECT_EQ(out[out.size() - 17 + 3], 0x7);
+}
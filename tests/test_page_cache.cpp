@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+#include "../cache/page_cache.h"
+#include "../blog/blog_handler.h"
+#include <pthread.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class PageCacheTest : public ::testing::Test {
+protected:
+    void put(const string& key, const string& page, const string& tag1, const string& tag2 = "") {
+        vector<string> tags(1, tag1);
+        if (!tag2.empty())
+            tags.push_back(tag2);
+        cache.put(key, page, tags, cache.generation());
+    }
+
+    page_cache cache;
+};
+
+TEST_F(PageCacheTest, InvalidateByTagOnlyDropsDependents) {
+    put("index:1", "index", "index", "categories");
+    put("article:1", "a1", "article:1");
+    put("article:2", "a2", "article:2");
+    put("category:3:1", "c3", "category:3", "categories");
+
+    cache.invalidate("article:1");
+    EXPECT_FALSE(cache.get("article:1"));
+    ASSERT_TRUE(cache.get("article:2"));
+    EXPECT_EQ(*cache.get("article:2"), "a2");
+
+    // 分类侧栏变化时首页和分类页都失效，文章页保留
+    cache.invalidate("categories");
+    EXPECT_FALSE(cache.get("index:1"));
+    EXPECT_FALSE(cache.get("category:3:1"));
+    EXPECT_TRUE(cache.get("article:2"));
+    EXPECT_EQ(cache.count(), 1u);
+    EXPECT_EQ(cache.bytes(), 2u);
+}
+
+TEST_F(PageCacheTest, RenderStartedBeforeInvalidationNotStored) {
+    uint64_t generation = cache.generation();
+    cache.invalidate("article:1");
+    page_cache::page_ptr page = cache.put("article:1", "old", vector<string>(1, "article:1"), generation);
+    ASSERT_TRUE(page);
+    EXPECT_EQ(*page, "old");
+    EXPECT_FALSE(cache.get("article:1"));
+}
+
+TEST_F(PageCacheTest, EvictsLeastRecentlyUsedAndExpires) {
+    cache.set_limits(80, page_cache::DEFAULT_MAX_AGE);
+    put("a", string(10, 'a'), "t");
+    put("b", string(10, 'b'), "t");
+    EXPECT_TRUE(cache.get("a"));
+    // 超过总量的1/8的页面不保存
+    put("big", string(11, 'x'), "t");
+    EXPECT_FALSE(cache.get("big"));
+    for (int i = 0; i < 7; ++i)
+        put("p" + to_string(i), string(10, 'p'), "t");
+    EXPECT_TRUE(cache.get("a"));
+    EXPECT_FALSE(cache.get("b"));
+    EXPECT_LE(cache.bytes(), 80u);
+
+    cache.set_limits(80, 0);
+    EXPECT_FALSE(cache.get("a"));
+}
+
+static void* acquire_page(void* arg) {
+    page_cache* cache = (page_cache*)arg;
+    bool lead = true;
+    page_cache::page_ptr page = cache->acquire("index:1", lead);
+    return new string(page && !lead ? *page : "");
+}
+
+TEST_F(PageCacheTest, CoalescesMissesAndServesStaleWhileRefreshing) {
+    // 未命中时只有第一个调用者渲染，等待者拿到它保存的页面
+    bool lead = false;
+    EXPECT_FALSE(cache.acquire("index:1", lead));
+    ASSERT_TRUE(lead);
+    pthread_t waiter;
+    ASSERT_EQ(pthread_create(&waiter, NULL, acquire_page, &cache), 0);
+    usleep(50 * 1000);
+    cache.finish("index:1", make_shared<const string>("v1"), vector<string>(1, "index"), cache.generation());
+    void* result = nullptr;
+    pthread_join(waiter, &result);
+    EXPECT_EQ(*(string*)result, "v1");
+    delete (string*)result;
+
+    // 过期后照常返回旧页面，只有一个调用者负责刷新；刷新失败时保留旧页面
+    cache.set_limits(page_cache::DEFAULT_MAX_BYTES, 0);
+    EXPECT_FALSE(cache.get("index:1"));
+    page_cache::page_ptr stale = cache.acquire("index:1", lead);
+    ASSERT_TRUE(stale);
+    EXPECT_EQ(*stale, "v1");
+    EXPECT_TRUE(lead);
+    EXPECT_TRUE(cache.acquire("index:1", lead));
+    EXPECT_FALSE(lead);
+    cache.finish("index:1", page_cache::page_ptr(), vector<string>(1, "index"), cache.generation());
+    stale = cache.acquire("index:1", lead);
+    ASSERT_TRUE(stale);
+    EXPECT_EQ(*stale, "v1");
+    EXPECT_FALSE(lead);
+}
+
+// 页面的ETag在渲染前由缓存代数得出，不随每次渲染变化；条件GET命中时直接回304
+TEST(BlogPageValidatorTest, ConditionalGetAnsweredBeforeRendering) {
+    BlogHandler handler;
+    handler.init(connection_pool::GetInstance());
+    handler.set_page_cache(0);
+
+    Request request;
+    request.method = "GET";
+    request.path = "/blog";
+    Response first = handler.handle_request(request);
+    ASSERT_EQ(first.status, 200);
+    ASSERT_EQ(first.etag.compare(0, 3, "W/\""), 0);
+    EXPECT_EQ(handler.handle_request(request).etag, first.etag);
+
+    request.if_none_match = first.etag;
+    Response cached = handler.handle_request(request);
+    EXPECT_EQ(cached.status, 304);
+    EXPECT_TRUE(cached.empty());
+    EXPECT_EQ(cached.etag, first.etag);
+
+    // 弱比较：列表中不带W/的同一校验值也命中
+    string listed = "\"other\", " + first.etag.substr(2);
+    request.if_none_match = listed;
+    EXPECT_EQ(handler.handle_request(request).status, 304);
+
+    request.if_none_match = "\"other\"";
+    EXPECT_EQ(handler.handle_request(request).status, 200);
+}
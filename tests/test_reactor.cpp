@@ -0,0 +1,267 @@
+#include <gtest/gtest.h>
+#include "../reactor/sub_reactor.h"
+#include "../webserver.h"
+#include "../http2/h2_session.h"
+#include "../cache/file_cache.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+static const int TEST_MAX_FD = 4096;
+static const int CLIENTS = 8;
+static const int ROUNDS = 200;
+
+static int reuseport_listener(int port) {
+    int listenfd = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int flag = 1;
+    setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+    setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag));
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (bind(listenfd, (sockaddr*)&address, sizeof(address)) != 0 || listen(listenfd, 1024) != 0) {
+        close(listenfd);
+        return -1;
+    }
+    return listenfd;
+}
+
+// 客户端反复连接后立即关闭、RST关闭或闲置到服务端超时，使各分片的关闭与accept交错复用同一批fd
+static void* churn(void* arg) {
+    int port = *(int*)arg;
+    for (int i = 0; i < ROUNDS; ++i) {
+        int fd = socket(PF_INET, SOCK_STREAM, 0);
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        if (connect(fd, (sockaddr*)&address, sizeof(address)) == 0) {
+            if (i % 3 == 1) {
+                struct linger reset = {1, 0};
+                setsockopt(fd, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+            }
+            else if (i % 3 == 2) {
+                usleep(30 * 1000);
+            }
+        }
+        close(fd);
+    }
+    return NULL;
+}
+
+TEST(SubReactorTest, ShardedReactorsKeepTimerSlotsConsistent) {
+    http_conn* users = new http_conn[TEST_MAX_FD];
+    client_data* users_timer = new client_data[TEST_MAX_FD];
+    for (int i = 0; i < TEST_MAX_FD; ++i)
+        users_timer[i].timer = NULL;
+    int base_count = http_conn::m_user_count;
+
+    int first = reuseport_listener(0);
+    ASSERT_GE(first, 0);
+    sockaddr_in bound;
+    socklen_t len = sizeof(bound);
+    getsockname(first, (sockaddr*)&bound, &len);
+    int port = ntohs(bound.sin_port);
+
+    // 闲置超时短于部分客户端的闲置时间，超时关闭与对端关闭同时发生
+    vector<sub_reactor*> reactors;
+    char root[] = "/tmp";
+    for (int i = 0; i < 4; ++i) {
+        sub_reactor* reactor = new sub_reactor(i, users, users_timer, TEST_MAX_FD, 20, 5);
+        reactor->init(root, 0, 1, NULL);
+        int listenfd = 0 == i ? first : reuseport_listener(port);
+        ASSERT_GE(listenfd, 0);
+        reactor->set_listener(listenfd, 0);
+        ASSERT_TRUE(reactor->start());
+        reactors.push_back(reactor);
+    }
+
+    pthread_t clients[CLIENTS];
+    for (int i = 0; i < CLIENTS; ++i)
+        pthread_create(&clients[i], NULL, churn, &port);
+    for (int i = 0; i < CLIENTS; ++i)
+        pthread_join(clients[i], NULL);
+
+    // 所有连接都应被关闭，且每个fd对应的定时器都已清除
+    // 客户端已关闭的连接可能仍在监听队列中，连接数须保持归零一段时间(超过闲置超时)
+    int settled = 0;
+    for (int i = 0; i < 500 && settled < 20; ++i) {
+        usleep(10 * 1000);
+        settled = http_conn::m_user_count == base_count ? settled + 1 : 0;
+    }
+    for (size_t i = 0; i < reactors.size(); ++i)
+        delete reactors[i];
+
+    EXPECT_EQ(http_conn::m_user_count, base_count);
+    int live_timers = 0;
+    for (int i = 0; i < TEST_MAX_FD; ++i) {
+        if (users_timer[i].timer)
+            ++live_timers;
+    }
+    EXPECT_EQ(live_timers, 0);
+
+    delete[] users_timer;
+    delete[] users;
+}
+
+// 等待工作线程投递完成通知后交给主循环处理
+static void drain_completions(WebServer& server) {
+    pollfd pfd = {server.m_completions->get_fd(), POLLIN, 0};
+    ASSERT_EQ(poll(&pfd, 1, 5000), 1);
+    server.dealwithcompletions();
+}
+
+static void send_all(int fd, const string& data) {
+    ASSERT_EQ(send(fd, data.data(), data.size(), 0), (ssize_t)data.size());
+}
+
+// reactor模式(-a 1)下工作线程在process中关闭连接(h2会话收到GOAWAY)，主循环须回收定时器且连接数只减一次
+TEST(ReactorModeTest, WorkerClosedConnectionReleasesTimer) {
+    WebServer server;
+    server.m_listenfd = -1;
+    server.m_signalfd = -1;
+    server.m_tickfd = -1;
+    server.m_epollfd = epoll_create(5);
+    server.m_actormodel = 1;
+    server.m_CONNTrigmode = 0;
+    server.m_close_log = 1;
+    server.m_idle_timeout = 60000;
+    http_conn::m_epollfd = server.m_epollfd;
+    Utils::u_epollfd = server.m_epollfd;
+    Utils::u_users = server.users;
+    server.m_pool = new threadpool<http_conn>(1, connection_pool::GetInstance(), 1);
+    server.m_completions = new completion_queue;
+    server.m_pool->set_completion_queue(server.m_completions);
+    int base_count = http_conn::m_user_count;
+
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    int client = fds[0];
+    int sockfd = fds[1];
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    server.timer(sockfd, address);
+    ASSERT_TRUE(server.users_timer[sockfd].timer != NULL);
+
+    // 前言与空SETTINGS：服务端回复SETTINGS及其ACK
+    string hello(h2_session::PREFACE, h2_session::PREFACE_LEN);
+    hello.append("\x00\x00\x00\x04\x00\x00\x00\x00\x00", 9);
+    send_all(client, hello);
+    server.dealwithread(sockfd);
+    drain_completions(server);
+    server.dealwithwrite(sockfd);
+    drain_completions(server);
+    char buf[4096];
+    ASSERT_GT(recv(client, buf, sizeof(buf), 0), 0);
+    ASSERT_TRUE(server.users_timer[sockfd].timer != NULL);
+
+    // 客户端GOAWAY且没有进行中的流，工作线程直接关闭连接
+    send_all(client, string("\x00\x00\x08\x07\x00\x00\x00\x00\x00"
+                            "\x00\x00\x00\x00\x00\x00\x00\x00", 17));
+    server.dealwithread(sockfd);
+    drain_completions(server);
+
+    EXPECT_EQ(server.users[sockfd].get_sockfd(), -1);
+    EXPECT_TRUE(server.users_timer[sockfd].timer == NULL);
+    EXPECT_EQ(http_conn::m_user_count, base_count);
+
+    // 时间轮上不应再有该连接的定时器，到期处理不会再次关闭
+    server.utils.m_timer_lst.tick(timer_now_ms() + 24 * 3600 * 1000);
+    EXPECT_EQ(http_conn::m_user_count, base_count);
+
+    close(client);
+}
+
+// 主循环模式(-a 0/1)下闲置超时同样经close_conn关闭连接，连接对象不再保留fd与缓冲区
+TEST(ReactorModeTest, IdleTimeoutClosesThroughCloseConn) {
+    WebServer server;
+    server.m_listenfd = -1;
+    server.m_signalfd = -1;
+    server.m_tickfd = -1;
+    server.m_epollfd = epoll_create(5);
+    server.m_CONNTrigmode = 0;
+    server.m_close_log = 1;
+    server.m_idle_timeout = 10;
+    http_conn::m_epollfd = server.m_epollfd;
+    Utils::u_epollfd = server.m_epollfd;
+    Utils::u_users = server.users;
+    int base_count = http_conn::m_user_count;
+
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    int sockfd = fds[1];
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    server.timer(sockfd, address);
+    ASSERT_EQ(http_conn::m_user_count, base_count + 1);
+
+    server.utils.m_timer_lst.tick(timer_now_ms() + 1000);
+    EXPECT_TRUE(server.users_timer[sockfd].timer == NULL);
+    EXPECT_EQ(server.users[sockfd].get_sockfd(), -1);
+    EXPECT_EQ(http_conn::m_user_count, base_count);
+
+    // 对端读到EOF说明服务端fd已关闭
+    char c;
+    EXPECT_EQ(recv(fds[0], &c, 1, 0), 0);
+    close(fds[0]);
+}
+
+// 响应未发完时闲置超时，close_conn须归还连接持有的文件缓存引用，条目才能被淘汰或失效释放
+TEST(ReactorModeTest, IdleTimeoutReleasesFileCacheEntry) {
+    char tmpl[] = "/tmp/reactor_test_XXXXXX";
+    ASSERT_NE(mkdtemp(tmpl), nullptr);
+    string root = tmpl;
+    string path = root + "/a.txt";
+    FILE* fp = fopen(path.c_str(), "w");
+    fputs("hello", fp);
+    fclose(fp);
+    file_cache* cache = file_cache::get_instance();
+    ASSERT_GE(cache->init(root.c_str()), 0);
+
+    WebServer server;
+    server.m_root = tmpl;
+    server.m_listenfd = -1;
+    server.m_signalfd = -1;
+    server.m_tickfd = -1;
+    server.m_epollfd = epoll_create(5);
+    server.m_CONNTrigmode = 0;
+    server.m_close_log = 1;
+    server.m_idle_timeout = 10;
+    http_conn::m_epollfd = server.m_epollfd;
+    Utils::u_epollfd = server.m_epollfd;
+    Utils::u_users = server.users;
+
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    int sockfd = fds[1];
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    server.timer(sockfd, address);
+
+    // 生成响应后不发送，连接持有文件条目
+    send_all(fds[0], "GET /a.txt HTTP/1.1\r\nHost: x\r\n\r\n");
+    ASSERT_TRUE(server.users[sockfd].read_once());
+    server.users[sockfd].process();
+    file_entry* entry = nullptr;
+    ASSERT_EQ(cache->acquire(path.c_str(), entry), 0);
+    int held = entry->refs;
+
+    server.utils.m_timer_lst.tick(timer_now_ms() + 1000);
+    EXPECT_EQ(server.users[sockfd].get_sockfd(), -1);
+    EXPECT_EQ(entry->refs, held - 1);
+
+    cache->release(entry);
+    cache->clear();
+    close(fds[0]);
+    string cmd = "rm -rf " + root;
+    ASSERT_EQ(system(cmd.c_str()), 0);
+}
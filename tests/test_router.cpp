@@ -0,0 +1,76 @@
+#include <gtest/gtest.h>
+#include "../router/route_trie.h"
+#include <string.h>
+#include <string>
+
+using namespace std;
+
+class RouteTrieTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        routes.add(GET, "/blog", 1);
+        routes.add(GET, "/blog/article/:id", 2);
+        routes.add(GET, "/blog/api/articles/:id", 3);
+        routes.add(PUT, "/blog/api/articles/:id", 4);
+        routes.add(GET, "/blog/api/articles/latest", 5);
+        routes.add(route_trie<int>::ANY_METHOD, "/static/*path", 6);
+        routes.add(GET, "/blog/admin", 7);
+    }
+
+    const int* match(int method, const char* path) {
+        return routes.match(method, path, strcspn(path, "?"), params);
+    }
+
+    static const int GET = 0;
+    static const int PUT = 3;
+    route_trie<int> routes;
+    route_params params;
+};
+
+TEST_F(RouteTrieTest, SplitEdgesKeepEveryRoute) {
+    // /blog、/blog/article、/blog/admin、/blog/api共享前缀，插入时边被逐级拆开
+    ASSERT_NE(match(GET, "/blog"), nullptr);
+    EXPECT_EQ(*match(GET, "/blog"), 1);
+    ASSERT_NE(match(GET, "/blog/admin"), nullptr);
+    EXPECT_EQ(*match(GET, "/blog/admin"), 7);
+    EXPECT_EQ(match(GET, "/blog/"), nullptr);
+    EXPECT_EQ(match(GET, "/blo"), nullptr);
+    EXPECT_EQ(match(GET, "/blog/adminx"), nullptr);
+}
+
+TEST_F(RouteTrieTest, ParamsTypedAndMethodDispatched) {
+    const int* h = match(GET, "/blog/article/42?from=index");
+    ASSERT_NE(h, nullptr);
+    EXPECT_EQ(*h, 2);
+    int id = 0;
+    EXPECT_TRUE(params.get_int("id", id));
+    EXPECT_EQ(id, 42);
+
+    ASSERT_NE(match(GET, "/blog/article/12abc"), nullptr);
+    EXPECT_FALSE(params.get_int("id", id));
+    ASSERT_NE(match(GET, "/blog/article/99999999999"), nullptr);
+    EXPECT_FALSE(params.get_int("id", id));
+    EXPECT_EQ(match(GET, "/blog/article/"), nullptr);
+    EXPECT_EQ(match(GET, "/blog/article/1/comments"), nullptr);
+
+    ASSERT_NE(match(PUT, "/blog/api/articles/7"), nullptr);
+    EXPECT_EQ(*match(PUT, "/blog/api/articles/7"), 4);
+    EXPECT_EQ(match(1, "/blog/api/articles/7"), nullptr);
+}
+
+TEST_F(RouteTrieTest, StaticBeatsParamAndWildcardTakesRest) {
+    // 静态段优先，失败时回退到参数段
+    EXPECT_EQ(*match(GET, "/blog/api/articles/latest"), 5);
+    EXPECT_EQ(*match(GET, "/blog/api/articles/lat"), 3);
+    EXPECT_EQ(*match(PUT, "/blog/api/articles/latest"), 4);
+
+    const int* h = match(1, "/static/css/main.css");
+    ASSERT_NE(h, nullptr);
+    EXPECT_EQ(*h, 6);
+    string path;
+    EXPECT_TRUE(params.get("path", path));
+    EXPECT_EQ(path, "css/main.css");
+    ASSERT_NE(match(GET, "/static/"), nullptr);
+    EXPECT_TRUE(params.get("path", path));
+    EXPECT_EQ(path, "");
+}
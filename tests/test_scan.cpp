@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+#include "../scan/http_scan.h"
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+using namespace std;
+
+class ScanTest : public ::testing::Test {
+protected:
+    void SetUp() override { saved = scan_impl(); }
+    void TearDown() override { scan_force(saved.c_str()); }
+
+    string saved;
+};
+
+TEST_F(ScanTest, EveryImplementationMatchesScalar) {
+    const char* impls[] = {"avx2", "sse4.2", "scalar"};
+    srand(7);
+    for (int round = 0; round < 200; ++round) {
+        // 长度覆盖向量块之内、之间和尾部剩余的情况
+        size_t len = rand() % 100;
+        string data(len + 32, 'x');
+        for (size_t i = 0; i < len; ++i) {
+            int r = rand() % 40;
+            data[i] = 0 == r ? '\r' : (1 == r ? '\n' : (char)('a' + r % 26));
+        }
+        // 范围之外的字节不能被当作结果
+        data[len] = '\n';
+
+        size_t expect = len;
+        for (size_t i = 0; i < len; ++i) {
+            if (data[i] == '\r' || data[i] == '\n') {
+                expect = i;
+                break;
+            }
+        }
+        for (size_t k = 0; k < 3; ++k) {
+            if (!scan_force(impls[k]))
+                continue;
+            EXPECT_EQ(scan_find2(data.data(), len, '\r', '\n'), expect) << impls[k] << " len " << len;
+        }
+    }
+    EXPECT_TRUE(scan_force("scalar"));
+    EXPECT_FALSE(scan_force("neon-or-unknown"));
+}
+
+TEST_F(ScanTest, KnownHeadersFoundCaseInsensitively) {
+    const char* names[] = {"Connection", "Content-Length", "Host", "Cookie", "Range", "If-Range",
+                           "If-None-Match", "If-Modified-Since", "Accept-Encoding", "Upgrade", "HTTP2-Settings"};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        EXPECT_EQ(lookup_header(names[i], strlen(names[i])), (HEADER_NAME)(HEADER_CONNECTION + i)) << names[i];
+    }
+    EXPECT_EQ(lookup_header("content-length", 14), HEADER_CONTENT_LENGTH);
+    EXPECT_EQ(lookup_header("User-Agent", 10), HEADER_UNKNOWN);
+    EXPECT_EQ(lookup_header("Hosts", 5), HEADER_UNKNOWN);
+    EXPECT_EQ(lookup_header("Content-Lengtx", 14), HEADER_UNKNOWN);
+    EXPECT_EQ(lookup_header("", 0), HEADER_UNKNOWN);
+}
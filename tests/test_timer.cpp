@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+#include "../timer/lst_timer.h"
+#include <vector>
+
+using namespace std;
+
+// 记录到期回调的顺序，sockfd用作定时器编号
+static vector<int> fired;
+
+static void record_cb(client_data *user_data) {
+    fired.push_back(user_data->sockfd);
+}
+
+class TimerWheelTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        fired.clear();
+        // 对齐到槽边界，便于精确断言触发时刻
+        now = (timer_now_ms() / timer_wheel::RESOLUTION_MS + 1) * timer_wheel::RESOLUTION_MS;
+    }
+
+    util_timer* add(int id, time_t expire) {
+        data[id].sockfd = id;
+        util_timer* timer = wheel.alloc_timer();
+        timer->expire = expire;
+        timer->cb_func = record_cb;
+        timer->user_data = &data[id];
+        data[id].timer = timer;
+        wheel.add_timer(timer);
+        return timer;
+    }
+
+    timer_wheel wheel;
+    client_data data[16];
+    time_t now;
+};
+
+TEST_F(TimerWheelTest, FiresOnlyAfterExpire) {
+    add(1, now + 3000);
+    wheel.tick(now + 2999);
+    EXPECT_TRUE(fired.empty());
+    wheel.tick(now + 3000);
+    ASSERT_EQ(fired.size(), 1u);
+    EXPECT_EQ(fired[0], 1);
+}
+
+TEST_F(TimerWheelTest, AdjustPostponesExpire) {
+    util_timer* timer = add(1, now + 5000);
+    timer->expire = now + 15000;
+    wheel.adjust_timer(timer);
+    wheel.tick(now + 10000);
+    EXPECT_TRUE(fired.empty());
+    wheel.tick(now + 15000);
+    EXPECT_EQ(fired.size(), 1u);
+}
+
+TEST_F(TimerWheelTest, DeletedTimerNeverFires) {
+    util_timer* timer = add(1, now + 5000);
+    add(2, now + 5000);
+    wheel.del_timer(timer);
+    wheel.tick(now + 5000);
+    ASSERT_EQ(fired.size(), 1u);
+    EXPECT_EQ(fired[0], 2);
+}
+
+// 跨越多层的定时器需要经过级联，且不能提前或错过，延迟以槽为单位
+TEST_F(TimerWheelTest, CascadesAcrossLevels) {
+    const time_t slots[] = {1, 255, 256, 300, 16383, 16384, 20000, 1100000};
+    const int count = sizeof(slots) / sizeof(slots[0]);
+    time_t delays[count];
+    for (int i = 0; i < count; ++i) {
+        delays[i] = slots[i] * timer_wheel::RESOLUTION_MS;
+        add(i, now + delays[i]);
+    }
+
+    for (int i = 0; i < count; ++i) {
+        wheel.tick(now + delays[i] - 1);
+        EXPECT_EQ(fired.size(), (size_t)i) << "delay " << delays[i];
+        wheel.tick(now + delays[i]);
+        ASSERT_EQ(fired.size(), (size_t)i + 1) << "delay " << delays[i];
+        EXPECT_EQ(fired[i], i);
+    }
+}
+
+TEST_F(TimerWheelTest, SlabReusesFreedNodes) {
+    util_timer* timer = add(1, now + 5000);
+    wheel.del_timer(timer);
+    EXPECT_EQ(wheel.alloc_timer(), timer);
+}
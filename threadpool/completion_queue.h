@@ -0,0 +1,73 @@
+#ifndef COMPLETION_QUEUE_H
+#define COMPLETION_QUEUE_H
+
+#include <vector>
+#include <exception>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "../lock/locker.h"
+
+//工作线程处理完一个连接后投递给主循环的完成通知
+struct completion
+{
+    int sockfd;
+    unsigned int serial;  //连接序号，用于丢弃fd被复用之后才到达的旧通知
+    int close_conn;       //1表示读写失败，需要主循环关闭连接
+    int closed;           //1表示工作线程已自行关闭连接，close_conn使序号加一
+};
+
+//工作线程 -> 主循环的完成通道
+//队列由空变为非空时写一次eventfd，主循环在epoll中监听该fd并一次取走全部通知
+class completion_queue
+{
+public:
+    completion_queue()
+    {
+        m_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_eventfd < 0)
+        {
+            throw std::exception();
+        }
+    }
+    ~completion_queue()
+    {
+        close(m_eventfd);
+    }
+    int get_fd() const
+    {
+        return m_eventfd;
+    }
+    void post(const completion &item)
+    {
+        m_lock.lock();
+        bool was_empty = m_queue.empty();
+        m_queue.push_back(item);
+        m_lock.unlock();
+
+        if (was_empty)
+        {
+            uint64_t one = 1;
+            ssize_t n = write(m_eventfd, &one, sizeof(one));
+            (void)n;
+        }
+    }
+    void drain(std::vector<completion> &items)
+    {
+        uint64_t count;
+        ssize_t n = read(m_eventfd, &count, sizeof(count));
+        (void)n;
+
+        items.clear();
+        m_lock.lock();
+        items.swap(m_queue);
+        m_lock.unlock();
+    }
+
+private:
+    int m_eventfd;
+    locker m_lock;
+    std::vector<completion> m_queue;
+};
+
+#endif
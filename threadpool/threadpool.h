@@ -7,6 +7,7 @@
 #include <pthread.h>
 #include "../lock/locker.h"
 #include "../CGImysql/sql_connection_pool.h"
+#include "completion_queue.h"
 
 template <typename T>
 class threadpool
@@ -17,6 +18,8 @@ public:
     ~threadpool();
     bool append(T *request, int state);
     bool append_p(T *request);
+    //reactor模式下工作线程通过该通道通知主循环，主循环不再等待工作线程
+    void set_completion_queue(completion_queue *completions) { m_completions = completions; }
 
 private:
     /*工作线程运行的函数，它不断从工作队列中取出任务并执行之*/
@@ -32,9 +35,11 @@ private:
     sem m_queuestat;            //是否有任务需要处理
     connection_pool *m_connPool;  //数据库
     int m_actor_model;          //模型切换
+    completion_queue *m_completions; //reactor模式的完成通道
+    volatile bool m_stop;       //线程池析构时通知工作线程退出
 };
 template <typename T>
-threadpool<T>::threadpool( int actor_model, connection_pool *connPool, int thread_number, int max_requests) : m_actor_model(actor_model),m_thread_number(thread_number), m_max_requests(max_requests), m_threads(NULL),m_connPool(connPool)
+threadpool<T>::threadpool( int actor_model, connection_pool *connPool, int thread_number, int max_requests) : m_actor_model(actor_model),m_thread_number(thread_number), m_max_requests(max_requests), m_threads(NULL),m_connPool(connPool), m_completions(NULL), m_stop(false)
 {
     if (thread_number <= 0 || max_requests <= 0)
         throw std::exception();
@@ -48,16 +53,17 @@ threadpool<T>::threadpool( int actor_model, connection_pool *connPool, int threa
             delete[] m_threads;
             throw std::exception();
         }
-        if (pthread_detach(m_threads[i]))
-        {
-            delete[] m_threads;
-            throw std::exception();
-        }
     }
 }
 template <typename T>
 threadpool<T>::~threadpool()
 {
+    //reactor模式下主循环不再等待工作线程，退出前必须等正在处理的请求结束
+    m_stop = true;
+    for (int i = 0; i < m_thread_number; ++i)
+        m_queuestat.post();
+    for (int i = 0; i < m_thread_number; ++i)
+        pthread_join(m_threads[i], NULL);
     delete[] m_threads;
 }
 template <typename T>
@@ -99,9 +105,11 @@ void *threadpool<T>::worker(void *arg)
 template <typename T>
 void threadpool<T>::run()
 {
-    while (true)
+    while (!m_stop)
     {
         m_queuestat.wait();
+        if (m_stop)
+            break;
         m_queuelocker.lock();
         if (m_workqueue.empty())
         {
@@ -115,6 +123,10 @@ void threadpool<T>::run()
             continue;
         if (1 == m_actor_model)
         {
+            //process可能关闭连接，先记下fd与序号
+            completion done;
+            done.sockfd = request->get_sockfd();
+            done.serial = request->get_serial();
             if (0 == request->m_state)
             {
                 if (request->read_once())
@@ -134,6 +146,12 @@ void threadpool<T>::run()
                 if (request->write())
                 {
                     request->improv = 1;
+                    //读缓冲区中已有下一个流水线请求，在本线程内接着处理
+                    if (request->has_pending())
+                    {
+                        connectionRAII mysqlcon(&request->mysql, m_connPool);
+                        request->process();
+                    }
                 }
                 else
                 {
@@ -141,6 +159,11 @@ void threadpool<T>::run()
                     request->timer_flag = 1;
                 }
             }
+            //process内部关闭连接时序号已变，主循环只需回收定时器；读写失败时由主循环关闭连接
+            done.closed = request->get_serial() != done.serial ? 1 : 0;
+            done.close_conn = (0 == done.closed && 1 == request->timer_flag) ? 1 : 0;
+            if (m_completions)
+                m_completions->post(done);
         }
         else
         {
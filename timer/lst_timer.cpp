@@ -1,147 +1,161 @@
 #include "lst_timer.h"
 #include "../http/http_conn.h"
 
-sort_timer_lst::sort_timer_lst()
+timer_wheel::timer_wheel() : m_current(timer_now_ms() / RESOLUTION_MS), m_free(NULL)
 {
-    head = NULL;
-    tail = NULL;
+    for (int i = 0; i < SLOT_NUM; ++i)
+    {
+        m_slots[i] = NULL;
+    }
 }
-sort_timer_lst::~sort_timer_lst()
+timer_wheel::~timer_wheel()
 {
-    util_timer *tmp = head;
-    while (tmp)
+    for (size_t i = 0; i < m_chunks.size(); ++i)
     {
-        head = tmp->next;
-        delete tmp;
-        tmp = head;
+        delete[] m_chunks[i];
     }
 }
 
-void sort_timer_lst::add_timer(util_timer *timer)
+util_timer *timer_wheel::alloc_timer()
 {
-    if (!timer)
+    if (!m_free)
     {
-        return;
-    }
-    if (!head)
-    {
-        head = tail = timer;
-        return;
-    }
-    if (timer->expire < head->expire)
-    {
-        timer->next = head;
-        head->prev = timer;
-        head = timer;
-        return;
+        util_timer *chunk = new util_timer[SLAB_SIZE];
+        m_chunks.push_back(chunk);
+        for (int i = 0; i < SLAB_SIZE; ++i)
+        {
+            chunk[i].next = m_free;
+            m_free = &chunk[i];
+        }
     }
-    add_timer(timer, head);
+    util_timer *timer = m_free;
+    m_free = timer->next;
+    timer->prev = NULL;
+    timer->next = NULL;
+    timer->slot = -1;
+    return timer;
 }
-void sort_timer_lst::adjust_timer(util_timer *timer)
+
+void timer_wheel::free_timer(util_timer *timer)
 {
-    if (!timer)
-    {
-        return;
-    }
-    util_timer *tmp = timer->next;
-    if (!tmp || (timer->expire < tmp->expire))
-    {
-        return;
-    }
-    if (timer == head)
-    {
-        head = head->next;
-        head->prev = NULL;
-        timer->next = NULL;
-        add_timer(timer, head);
+    timer->slot = -1;
+    timer->prev = NULL;
+    timer->next = m_free;
+    m_free = timer;
+}
+
+//选择能容纳到期时间的最低一层：该层上到期时间与当前时间的槽距小于层大小
+void timer_wheel::link(util_timer *timer)
+{
+    //向上取整到槽，保证定时器不会早于expire触发
+    time_t expire = (timer->expire + RESOLUTION_MS - 1) / RESOLUTION_MS;
+    if (expire < m_current)
+        expire = m_current;
+    int level = 0;
+    for (; level < LEVELS - 1; ++level)
+    {
+        int shift = level_shift(level);
+        if ((expire >> shift) - (m_current >> shift) < level_size(level))
+            break;
     }
-    else
-    {
+    int shift = level_shift(level);
+    //超出最高层范围的定时器先挂在最远的槽上，级联时再重新放置
+    if ((expire >> shift) - (m_current >> shift) >= level_size(level))
+        expire = ((m_current >> shift) + level_size(level) - 1) << shift;
+
+    int slot = level_base(level) + (int)((expire >> shift) & (level_size(level) - 1));
+    timer->slot = slot;
+    timer->prev = NULL;
+    timer->next = m_slots[slot];
+    if (m_slots[slot])
+        m_slots[slot]->prev = timer;
+    m_slots[slot] = timer;
+}
+
+void timer_wheel::unlink(util_timer *timer)
+{
+    if (timer->prev)
         timer->prev->next = timer->next;
+    else
+        m_slots[timer->slot] = timer->next;
+    if (timer->next)
         timer->next->prev = timer->prev;
-        add_timer(timer, timer->next);
-    }
+    timer->prev = NULL;
+    timer->next = NULL;
+    timer->slot = -1;
 }
-void sort_timer_lst::del_timer(util_timer *timer)
+
+void timer_wheel::add_timer(util_timer *timer)
 {
     if (!timer)
     {
         return;
     }
-    if ((timer == head) && (timer == tail))
-    {
-        delete timer;
-        head = NULL;
-        tail = NULL;
-        return;
-    }
-    if (timer == head)
-    {
-        head = head->next;
-        head->prev = NULL;
-        delete timer;
-        return;
-    }
-    if (timer == tail)
+    link(timer);
+}
+void timer_wheel::adjust_timer(util_timer *timer)
+{
+    if (!timer || timer->slot < 0)
     {
-        tail = tail->prev;
-        tail->next = NULL;
-        delete timer;
         return;
     }
-    timer->prev->next = timer->next;
-    timer->next->prev = timer->prev;
-    delete timer;
+    unlink(timer);
+    link(timer);
 }
-void sort_timer_lst::tick()
+void timer_wheel::del_timer(util_timer *timer)
 {
-    if (!head)
+    if (!timer)
     {
         return;
     }
-    
-    time_t cur = time(NULL);
-    util_timer *tmp = head;
+    if (timer->slot >= 0)
+        unlink(timer);
+    free_timer(timer);
+}
+
+//把高层当前槽上的定时器重新放置到更低的层
+void timer_wheel::cascade(int level)
+{
+    int slot = level_base(level) + (int)((m_current >> level_shift(level)) & (level_size(level) - 1));
+    util_timer *tmp = m_slots[slot];
+    m_slots[slot] = NULL;
     while (tmp)
     {
-        if (cur < tmp->expire)
-        {
-            break;
-        }
-        tmp->cb_func(tmp->user_data);
-        head = tmp->next;
-        if (head)
-        {
-            head->prev = NULL;
-        }
-        delete tmp;
-        tmp = head;
+        util_timer *next = tmp->next;
+        link(tmp);
+        tmp = next;
     }
 }
 
-void sort_timer_lst::add_timer(util_timer *timer, util_timer *lst_head)
+void timer_wheel::tick()
 {
-    util_timer *prev = lst_head;
-    util_timer *tmp = prev->next;
-    while (tmp)
+    tick(timer_now_ms());
+}
+
+void timer_wheel::tick(time_t now_ms)
+{
+    time_t now = now_ms / RESOLUTION_MS;
+    while (m_current <= now)
     {
-        if (timer->expire < tmp->expire)
+        //从高层到低层级联，保证从高层落下的定时器还能被下一层当前槽接住
+        for (int level = LEVELS - 1; level > 0; --level)
         {
-            prev->next = timer;
-            timer->next = tmp;
-            tmp->prev = timer;
-            timer->prev = prev;
-            break;
+            if (0 == (m_current & (((time_t)1 << level_shift(level)) - 1)))
+                cascade(level);
         }
-        prev = tmp;
-        tmp = tmp->next;
-    }
-    if (!tmp)
-    {
-        prev->next = timer;
-        timer->prev = prev;
-        timer->next = NULL;
-        tail = timer;
+
+        int slot = (int)(m_current & (ROOT_SIZE - 1));
+        util_timer *tmp = m_slots[slot];
+        m_slots[slot] = NULL;
+        while (tmp)
+        {
+            util_timer *next = tmp->next;
+            tmp->slot = -1;
+            tmp->cb_func(tmp->user_data);
+            free_timer(tmp);
+            tmp = next;
+        }
+        ++m_current;
     }
 }
 
@@ -176,14 +190,24 @@ void Utils::addfd(int epollfd, int fd, bool one_shot, int TRIGMode)
     setnonblocking(fd);
 }
 
-//信号处理函数
-void Utils::sig_handler(int sig)
+int Utils::create_tick_fd(int interval_ms)
+{
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    assert(fd != -1);
+
+    struct itimerspec its;
+    its.it_interval.tv_sec = interval_ms / 1000;
+    its.it_interval.tv_nsec = (interval_ms % 1000) * 1000000L;
+    its.it_value = its.it_interval;
+    timerfd_settime(fd, 0, &its, NULL);
+    return fd;
+}
+
+void Utils::drain_fd(int fd)
 {
-    //为保证函数的可重入性，保留原来的errno
-    int save_errno = errno;
-    int msg = sig;
-    send(u_pipefd[1], (char *)&msg, 1, 0);
-    errno = save_errno;
+    uint64_t count;
+    while (read(fd, &count, sizeof(count)) > 0)
+        ;
 }
 
 //设置信号函数
@@ -198,11 +222,10 @@ void Utils::addsig(int sig, void(handler)(int), bool restart)
     assert(sigaction(sig, &sa, NULL) != -1);
 }
 
-//定时处理任务，重新定时以不断触发SIGALRM信号
+//定时处理任务，检查到期的非活动连接
 void Utils::timer_handler()
 {
     m_timer_lst.tick();
-    alarm(m_TIMESLOT);
 }
 
 void Utils::show_error(int connfd, const char *info)
@@ -211,14 +234,14 @@ void Utils::show_error(int connfd, const char *info)
     close(connfd);
 }
 
-int *Utils::u_pipefd = 0;
 int Utils::u_epollfd = 0;
+http_conn *Utils::u_users = NULL;
 
 class Utils;
+//与其他关闭路径一样经close_conn归还缓冲区、文件缓存引用和h2会话
 void cb_func(client_data *user_data)
 {
-    epoll_ctl(Utils::u_epollfd, EPOLL_CTL_DEL, user_data->sockfd, 0);
     assert(user_data);
-    close(user_data->sockfd);
-    http_conn::m_user_count--;
+    user_data->timer = NULL;
+    Utils::u_users[user_data->sockfd].close_conn();
 }
@@ -22,9 +22,20 @@
 #include <sys/uio.h>
 
 #include <time.h>
+#include <sys/timerfd.h>
+#include <vector>
 #include "../log/log.h"
 
 class util_timer;
+class http_conn;
+
+//单调时钟的毫秒数，定时器的到期时间都以此为基准，不受系统时间调整影响
+inline time_t timer_now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
 struct client_data
 {
@@ -36,33 +47,61 @@ struct client_data
 class util_timer
 {
 public:
-    util_timer() : prev(NULL), next(NULL) {}
+    util_timer() : prev(NULL), next(NULL), slot(-1) {}
 
 public:
-    time_t expire;
+    time_t expire;  //到期时间，timer_now_ms()的毫秒数
     
     void (* cb_func)(client_data *);
     client_data *user_data;
     util_timer *prev;
     util_timer *next;
+    int slot;  //所在时间轮槽位，-1表示不在轮上
 };
 
-class sort_timer_lst
+//分层时间轮：添加、调整、删除定时器都是O(1)，tick只处理到期的槽
+//第0层256个槽，每槽RESOLUTION_MS毫秒；之上三层各64个槽，粒度依次放大256、64、64倍
+//定时器节点由内部slab分配，通过alloc_timer取得，del_timer或到期后回收，不再逐个new/delete
+class timer_wheel
 {
 public:
-    sort_timer_lst();
-    ~sort_timer_lst();
+    timer_wheel();
+    ~timer_wheel();
 
+    util_timer *alloc_timer();
     void add_timer(util_timer *timer);
+    //expire修改后调用，重新挂到对应的槽上
     void adjust_timer(util_timer *timer);
     void del_timer(util_timer *timer);
     void tick();
+    void tick(time_t now_ms);
 
-private:
-    void add_timer(util_timer *timer, util_timer *lst_head);
+    static const int RESOLUTION_MS = 10;
 
-    util_timer *head;
-    util_timer *tail;
+private:
+    static const int LEVELS = 4;
+    static const int ROOT_BITS = 8;
+    static const int LEVEL_BITS = 6;
+    static const int ROOT_SIZE = 1 << ROOT_BITS;
+    static const int LEVEL_SIZE = 1 << LEVEL_BITS;
+    static const int SLOT_NUM = ROOT_SIZE + (LEVELS - 1) * LEVEL_SIZE;
+    static const int SLAB_SIZE = 1024;
+
+    static int level_shift(int level) { return 0 == level ? 0 : ROOT_BITS + (level - 1) * LEVEL_BITS; }
+    static int level_size(int level) { return 0 == level ? ROOT_SIZE : LEVEL_SIZE; }
+    static int level_base(int level) { return 0 == level ? 0 : ROOT_SIZE + (level - 1) * LEVEL_SIZE; }
+
+    void link(util_timer *timer);
+    void unlink(util_timer *timer);
+    void cascade(int level);
+    void free_timer(util_timer *timer);
+
+    util_timer *m_slots[SLOT_NUM];
+    time_t m_current;  //下一个待处理的槽，以RESOLUTION_MS为单位
+
+    //slab：按块分配定时器节点，空闲节点通过next串成链表
+    std::vector<util_timer *> m_chunks;
+    util_timer *m_free;
 };
 
 class Utils
@@ -73,27 +112,29 @@ public:
 
     void init(int timeslot);
 
+    //创建周期为interval_ms毫秒的timerfd，直接注册到事件循环的epoll中驱动定时器
+    static int create_tick_fd(int interval_ms);
+    //读走timerfd/eventfd上的计数
+    static void drain_fd(int fd);
+
     //对文件描述符设置非阻塞
     int setnonblocking(int fd);
 
     //将内核事件表注册读事件，ET模式，选择开启EPOLLONESHOT
     void addfd(int epollfd, int fd, bool one_shot, int TRIGMode);
 
-    //信号处理函数
-    static void sig_handler(int sig);
-
     //设置信号函数
     void addsig(int sig, void(handler)(int), bool restart = true);
 
-    //定时处理任务，重新定时以不断触发SIGALRM信号
+    //定时处理任务，检查到期的非活动连接
     void timer_handler();
 
     void show_error(int connfd, const char *info);
 
 public:
-    static int *u_pipefd;
-    sort_timer_lst m_timer_lst;
+    timer_wheel m_timer_lst;
     static int u_epollfd;
+    static http_conn *u_users;  //主循环的连接数组，超时回调经close_conn关闭连接
     int m_TIMESLOT;
 };
 
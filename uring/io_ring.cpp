@@ -0,0 +1,287 @@
+#include "io_ring.h"
+
+#ifdef WEBSERVER_HAVE_IO_URING
+
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+io_ring::io_ring()
+    : m_fd(-1), m_sq_entries(0), m_sq_ptr(MAP_FAILED), m_sq_size(0), m_cq_ptr(MAP_FAILED), m_cq_size(0),
+      m_sqes((struct io_uring_sqe *)MAP_FAILED), m_sqes_size(0), m_sq_head(NULL), m_sq_tail(NULL), m_sq_mask(NULL),
+      m_sq_array(NULL), m_sq_local_tail(0), m_cq_head(NULL), m_cq_tail(NULL), m_cq_mask(NULL), m_cqes(NULL),
+      m_buf_ring((struct io_uring_buf_ring *)MAP_FAILED), m_buf_ring_size(0), m_bufs(NULL), m_buf_count(0),
+      m_buf_size(0), m_buf_tail(0)
+{
+}
+
+io_ring::~io_ring()
+{
+    if (m_buf_ring != MAP_FAILED)
+        munmap(m_buf_ring, m_buf_ring_size);
+    free(m_bufs);
+    if (m_sqes != MAP_FAILED)
+        munmap(m_sqes, m_sqes_size);
+    if (m_cq_ptr != MAP_FAILED && m_cq_ptr != m_sq_ptr)
+        munmap(m_cq_ptr, m_cq_size);
+    if (m_sq_ptr != MAP_FAILED)
+        munmap(m_sq_ptr, m_sq_size);
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+bool io_ring::init(unsigned entries)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    //CQ放大到SQ的4倍，multishot请求一次提交会产生多个完成事件
+    p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+    p.cq_entries = entries * 4;
+    m_fd = sys_io_uring_setup(entries, &p);
+    if (m_fd < 0 && errno == EINVAL)
+    {
+        //较老的内核不认识后两个标志
+        memset(&p, 0, sizeof(p));
+        p.flags = IORING_SETUP_CQSIZE;
+        p.cq_entries = entries * 4;
+        m_fd = sys_io_uring_setup(entries, &p);
+    }
+    if (m_fd < 0)
+        return false;
+
+    m_sq_entries = p.sq_entries;
+    m_sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    m_cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (m_cq_size > m_sq_size)
+            m_sq_size = m_cq_size;
+        m_cq_size = m_sq_size;
+    }
+
+    m_sq_ptr = mmap(NULL, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    if (m_sq_ptr == MAP_FAILED)
+        return false;
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        m_cq_ptr = m_sq_ptr;
+    else
+    {
+        m_cq_ptr = mmap(NULL, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+        if (m_cq_ptr == MAP_FAILED)
+            return false;
+    }
+
+    m_sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    m_sqes = (struct io_uring_sqe *)mmap(NULL, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                         m_fd, IORING_OFF_SQES);
+    if (m_sqes == MAP_FAILED)
+        return false;
+
+    char *sq = (char *)m_sq_ptr;
+    m_sq_head = (unsigned *)(sq + p.sq_off.head);
+    m_sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    m_sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    m_sq_array = (unsigned *)(sq + p.sq_off.array);
+    m_sq_local_tail = *m_sq_tail;
+
+    char *cq = (char *)m_cq_ptr;
+    m_cq_head = (unsigned *)(cq + p.cq_off.head);
+    m_cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    m_cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    m_cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return true;
+}
+
+bool io_ring::setup_buffers(unsigned short bgid, unsigned count, unsigned size)
+{
+    m_buf_ring_size = count * sizeof(struct io_uring_buf);
+    m_buf_ring = (struct io_uring_buf_ring *)mmap(NULL, m_buf_ring_size, PROT_READ | PROT_WRITE,
+                                                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m_buf_ring == MAP_FAILED)
+        return false;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long)m_buf_ring;
+    reg.ring_entries = count;
+    reg.bgid = bgid;
+    if (sys_io_uring_register(m_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        return false;
+
+    m_bufs = (char *)malloc((size_t)count * size);
+    if (!m_bufs)
+        return false;
+    m_buf_count = count;
+    m_buf_size = size;
+    m_buf_tail = 0;
+    for (unsigned i = 0; i < count; ++i)
+        recycle_buffer((unsigned short)i);
+    return true;
+}
+
+void io_ring::recycle_buffer(unsigned short bid)
+{
+    //C++下内核头文件的柔性数组成员前多出一个空结构体，不能用m_buf_ring->bufs取下标
+    struct io_uring_buf *buf = (struct io_uring_buf *)m_buf_ring + (m_buf_tail & (m_buf_count - 1));
+    buf->addr = (unsigned long)buffer(bid);
+    buf->len = m_buf_size;
+    buf->bid = bid;
+    ++m_buf_tail;
+    __atomic_store_n(&m_buf_ring->tail, m_buf_tail, __ATOMIC_RELEASE);
+}
+
+struct io_uring_sqe *io_ring::get_sqe()
+{
+    unsigned head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    if (m_sq_local_tail - head >= m_sq_entries)
+    {
+        //SQ已满，先把已准备的请求交给内核
+        submit_and_wait(0);
+        head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+        if (m_sq_local_tail - head >= m_sq_entries)
+            return NULL;
+    }
+
+    unsigned idx = m_sq_local_tail & *m_sq_mask;
+    struct io_uring_sqe *sqe = &m_sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    m_sq_array[idx] = idx;
+    ++m_sq_local_tail;
+    return sqe;
+}
+
+int io_ring::submit_and_wait(unsigned wait_nr)
+{
+    __atomic_store_n(m_sq_tail, m_sq_local_tail, __ATOMIC_RELEASE);
+    unsigned to_submit = m_sq_local_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    if (0 == to_submit && 0 == wait_nr)
+        return 0;
+
+    int ret = sys_io_uring_enter(m_fd, to_submit, wait_nr, wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0);
+    if (ret < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY))
+        return 0;
+    return ret;
+}
+
+bool io_ring::next_cqe(struct io_uring_cqe &cqe)
+{
+    unsigned head = *m_cq_head;
+    if (head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE))
+        return false;
+
+    cqe = m_cqes[head & *m_cq_mask];
+    __atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool io_ring::prep_accept_multishot(int fd, uint64_t data)
+{
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    //连接socket保持阻塞模式：对O_NONBLOCK的socket，io_uring会把EAGAIN直接返回而不是在内核中等待可写
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = data;
+    return true;
+}
+
+bool io_ring::prep_recv_multishot(int fd, unsigned short bgid, uint64_t data)
+{
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = bgid;
+    sqe->user_data = data;
+    return true;
+}
+
+bool io_ring::prep_writev(int fd, const struct iovec *iov, int count, uint64_t data)
+{
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)iov;
+    sqe->len = count;
+    sqe->user_data = data;
+    return true;
+}
+
+bool io_ring::prep_read(int fd, void *buf, unsigned len, uint64_t data)
+{
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)buf;
+    sqe->len = len;
+    sqe->off = (uint64_t)-1;
+    sqe->user_data = data;
+    return true;
+}
+
+bool io_ring::prep_timeout(struct __kernel_timespec *ts, uint64_t data)
+{
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = (unsigned long)ts;
+    sqe->len = 1;
+    sqe->user_data = data;
+    return true;
+}
+
+//用socketpair实际跑一次multishot recv：内核可能支持io_uring却不支持该标志，或被io_uring_disabled禁用
+bool io_ring::supported()
+{
+    io_ring ring;
+    if (!ring.init(8) || !ring.setup_buffers(0, 2, 64))
+        return false;
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0)
+        return false;
+
+    bool ok = false;
+    if (ring.prep_recv_multishot(sv[0], 0, 1) && ring.submit_and_wait(0) >= 0 && ::write(sv[1], "x", 1) == 1 &&
+        ring.submit_and_wait(1) >= 0)
+    {
+        struct io_uring_cqe cqe;
+        ok = ring.next_cqe(cqe) && 1 == cqe.res && (cqe.flags & IORING_CQE_F_BUFFER);
+    }
+    close(sv[0]);
+    close(sv[1]);
+    return ok;
+}
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef IO_RING_H
+#define IO_RING_H
+
+#include <stdint.h>
+#include <sys/uio.h>
+
+//内核头文件足够新(multishot recv + 缓冲区环)时才编译io_uring后端，否则只保留epoll
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(IORING_RECV_MULTISHOT) && defined(IORING_ACCEPT_MULTISHOT)
+#define WEBSERVER_HAVE_IO_URING 1
+#endif
+#endif
+#endif
+
+#ifdef WEBSERVER_HAVE_IO_URING
+
+//对io_uring系统调用的最小封装：SQ/CQ环、提供给recv的缓冲区环以及常用请求的准备函数
+//不依赖liburing，只使用内核头文件
+class io_ring
+{
+public:
+    io_ring();
+    ~io_ring();
+
+    //运行时检测内核是否支持本后端用到的全部特性(缓冲区环、multishot accept/recv)
+    static bool supported();
+
+    bool init(unsigned entries);
+    //注册一组count个、每个size字节的recv缓冲区，count须为2的幂
+    bool setup_buffers(unsigned short bgid, unsigned count, unsigned size);
+    char *buffer(unsigned short bid) { return m_bufs + (size_t)bid * m_buf_size; }
+    //缓冲区中的数据处理完毕后归还给内核
+    void recycle_buffer(unsigned short bid);
+
+    //提交所有已准备的请求，并等待至少wait_nr个完成事件
+    int submit_and_wait(unsigned wait_nr);
+    //取出一个完成事件，没有时返回false
+    bool next_cqe(struct io_uring_cqe &cqe);
+
+    bool prep_accept_multishot(int fd, uint64_t data);
+    bool prep_recv_multishot(int fd, unsigned short bgid, uint64_t data);
+    bool prep_writev(int fd, const struct iovec *iov, int count, uint64_t data);
+    bool prep_read(int fd, void *buf, unsigned len, uint64_t data);
+    bool prep_timeout(struct __kernel_timespec *ts, uint64_t data);
+
+private:
+    struct io_uring_sqe *get_sqe();
+
+private:
+    int m_fd;
+    unsigned m_sq_entries;
+
+    void *m_sq_ptr;
+    size_t m_sq_size;
+    void *m_cq_ptr;
+    size_t m_cq_size;
+    struct io_uring_sqe *m_sqes;
+    size_t m_sqes_size;
+
+    unsigned *m_sq_head;
+    unsigned *m_sq_tail;
+    unsigned *m_sq_mask;
+    unsigned *m_sq_array;
+    unsigned m_sq_local_tail;
+
+    unsigned *m_cq_head;
+    unsigned *m_cq_tail;
+    unsigned *m_cq_mask;
+    struct io_uring_cqe *m_cqes;
+
+    //缓冲区环
+    struct io_uring_buf_ring *m_buf_ring;
+    size_t m_buf_ring_size;
+    char *m_bufs;
+    unsigned m_buf_count;
+    unsigned m_buf_size;
+    unsigned short m_buf_tail;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,375 @@
+#include "uring_loop.h"
+
+#ifdef WEBSERVER_HAVE_IO_URING
+
+#include <sys/eventfd.h>
+
+//recv缓冲区组号，每个ring各自注册
+static const unsigned short RECV_BGID = 0;
+
+http_conn *uring_loop::s_users = NULL;
+
+uring_loop::uring_loop(int id, http_conn *users, client_data *users_timer, int max_fd, int idle_timeout, int timeslot)
+    : m_id(id), m_listenfd(-1), m_owns_listener(false), m_wake_buf(0), m_started(false), m_stop(false),
+      m_users(users), m_users_timer(users_timer), m_max_fd(max_fd), m_deferred(max_fd), m_idle_timeout(idle_timeout),
+      m_root(NULL), m_CONNTrigmode(0), m_close_log(0), m_connPool(NULL)
+{
+    s_users = users;
+
+    m_wakeupfd = eventfd(0, EFD_CLOEXEC);
+    assert(m_wakeupfd != -1);
+
+    m_tick.tv_sec = timeslot / 1000;
+    m_tick.tv_nsec = (timeslot % 1000) * 1000000L;
+}
+
+uring_loop::~uring_loop()
+{
+    stop();
+    if (m_owns_listener && m_listenfd >= 0)
+        close(m_listenfd);
+    close(m_wakeupfd);
+}
+
+bool uring_loop::supported()
+{
+    return io_ring::supported();
+}
+
+void uring_loop::init(char *root, int conn_trigmode, int close_log, connection_pool *connPool)
+{
+    m_root = root;
+    m_CONNTrigmode = conn_trigmode;
+    m_close_log = close_log;
+    m_connPool = connPool;
+}
+
+void uring_loop::set_listener(int listenfd, bool owned)
+{
+    m_listenfd = listenfd;
+    m_owns_listener = owned;
+}
+
+bool uring_loop::start()
+{
+    if (!m_ring.init(RING_ENTRIES) || !m_ring.setup_buffers(RECV_BGID, RECV_BUF_COUNT, RECV_BUF_SIZE))
+    {
+        LOG_ERROR("uring loop %d ring setup failed", m_id);
+        return false;
+    }
+    if (pthread_create(&m_thread, NULL, worker, this) != 0)
+    {
+        LOG_ERROR("uring loop %d start failed", m_id);
+        return false;
+    }
+    m_started = true;
+    return true;
+}
+
+void uring_loop::stop()
+{
+    if (!m_started)
+        return;
+    m_stop = true;
+    uint64_t one = 1;
+    ssize_t n = ::write(m_wakeupfd, &one, sizeof(one));
+    (void)n;
+    pthread_join(m_thread, NULL);
+    m_started = false;
+}
+
+void *uring_loop::worker(void *arg)
+{
+    uring_loop *loop = (uring_loop *)arg;
+    loop->run();
+    return loop;
+}
+
+//user_data布局：高8位操作类型，中间24位连接序号，低32位fd
+uint64_t uring_loop::make_data(int op, int sockfd) const
+{
+    uint64_t serial = sockfd >= 0 ? (m_users[sockfd].get_serial() & 0xffffff) : 0;
+    return ((uint64_t)op << 56) | (serial << 32) | (uint32_t)sockfd;
+}
+
+//连接已关闭或fd已被新连接复用时，迟到的完成事件需丢弃
+bool uring_loop::is_current(uint64_t data, int sockfd) const
+{
+    if (sockfd < 0 || sockfd >= m_max_fd || !m_users_timer[sockfd].timer)
+        return false;
+    return ((data >> 32) & 0xffffff) == (m_users[sockfd].get_serial() & 0xffffff);
+}
+
+void uring_loop::submit_recv(int sockfd)
+{
+    m_ring.prep_recv_multishot(sockfd, RECV_BGID, make_data(OP_RECV, sockfd));
+}
+
+void uring_loop::submit_write(int sockfd)
+{
+    int count;
+    struct iovec *iov = m_users[sockfd].get_iov(count);
+    m_ring.prep_writev(sockfd, iov, count, make_data(OP_WRITE, sockfd));
+}
+
+void uring_loop::submit_tick()
+{
+    m_ring.prep_timeout(&m_tick, make_data(OP_TICK, -1));
+}
+
+void uring_loop::submit_wake()
+{
+    m_ring.prep_read(m_wakeupfd, &m_wake_buf, sizeof(m_wake_buf), make_data(OP_WAKE, -1));
+}
+
+void uring_loop::add_conn(int connfd)
+{
+    sockaddr_in client_address;
+    socklen_t client_addrlength = sizeof(client_address);
+    memset(&client_address, 0, sizeof(client_address));
+    getpeername(connfd, (struct sockaddr *)&client_address, &client_addrlength);
+
+    m_users[connfd].bind_ring();
+    m_users[connfd].init(connfd, client_address, m_root, m_CONNTrigmode, m_close_log);
+    m_deferred[connfd].clear();
+
+    m_users_timer[connfd].address = client_address;
+    m_users_timer[connfd].sockfd = connfd;
+    util_timer *timer = m_timer_lst.alloc_timer();
+    timer->user_data = &m_users_timer[connfd];
+    timer->cb_func = conn_timeout;
+    timer->expire = timer_now_ms() + m_idle_timeout;
+    m_users_timer[connfd].timer = timer;
+    m_timer_lst.add_timer(timer);
+
+    submit_recv(connfd);
+}
+
+//关闭连接：close_conn先清除连接状态再shutdown并关闭fd，fd一旦关闭就可能被其他循环复用
+//socket上挂着multishot recv，shutdown让内核结束该请求并向对端发送FIN
+void uring_loop::conn_timeout(client_data *user_data)
+{
+    assert(user_data);
+    user_data->timer = NULL;
+    s_users[user_data->sockfd].close_conn();
+}
+
+void uring_loop::adjust_timer(util_timer *timer)
+{
+    timer->expire = timer_now_ms() + m_idle_timeout;
+    m_timer_lst.adjust_timer(timer);
+}
+
+//先回收定时器再关闭连接，关闭之后不再访问该fd对应的元素
+void uring_loop::deal_timer(util_timer *timer, int sockfd)
+{
+    m_timer_lst.del_timer(timer);
+    conn_timeout(&m_users_timer[sockfd]);
+
+    LOG_INFO("close fd %d", sockfd);
+}
+
+void uring_loop::handle_accept(const struct io_uring_cqe &cqe)
+{
+    int connfd = cqe.res;
+    if (connfd >= 0)
+    {
+        if (http_conn::m_user_count >= m_max_fd || connfd >= m_max_fd)
+        {
+            const char *info = "Internal server busy";
+            send(connfd, info, strlen(info), 0);
+            close(connfd);
+            LOG_ERROR("%s", "Internal server busy");
+        }
+        else
+        {
+            add_conn(connfd);
+        }
+    }
+    else
+    {
+        LOG_ERROR("uring loop %d accept error:%d", m_id, -connfd);
+    }
+
+    //multishot accept被内核终止(如出错)时重新提交
+    if (!(cqe.flags & IORING_CQE_F_MORE))
+        m_ring.prep_accept_multishot(m_listenfd, make_data(OP_ACCEPT, -1));
+}
+
+void uring_loop::handle_recv(const struct io_uring_cqe &cqe, int sockfd)
+{
+    bool has_buffer = cqe.flags & IORING_CQE_F_BUFFER;
+    unsigned short bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+
+    if (!is_current(cqe.user_data, sockfd))
+    {
+        if (has_buffer)
+            m_ring.recycle_buffer(bid);
+        return;
+    }
+
+    util_timer *timer = m_users_timer[sockfd].timer;
+    if (cqe.res == -ENOBUFS)
+    {
+        //缓冲区暂时耗尽，本次recv请求已结束，重新提交等待归还的缓冲区
+        submit_recv(sockfd);
+        return;
+    }
+    if (cqe.res <= 0)
+    {
+        if (has_buffer)
+            m_ring.recycle_buffer(bid);
+        deal_timer(timer, sockfd);
+        return;
+    }
+
+    http_conn &conn = m_users[sockfd];
+    unsigned int serial = conn.get_serial();
+    bool ok;
+    if (conn.is_writing())
+    {
+        //上一个响应尚未写完，先暂存新到的数据
+        m_deferred[sockfd].append(m_ring.buffer(bid), cqe.res);
+        ok = m_deferred[sockfd].size() <= (size_t)(http_conn::READ_BUFFER_SIZE + http_conn::m_max_body);
+    }
+    else
+    {
+        ok = conn.append_read(m_ring.buffer(bid), cqe.res);
+    }
+    m_ring.recycle_buffer(bid);
+    if (!ok)
+    {
+        deal_timer(timer, sockfd);
+        return;
+    }
+
+    adjust_timer(timer);
+    if (!conn.is_writing())
+        serve(sockfd);
+
+    if (!(cqe.flags & IORING_CQE_F_MORE) && conn.get_serial() == serial)
+        submit_recv(sockfd);
+}
+
+//解析请求并在得到完整响应时提交writev
+void uring_loop::serve(int sockfd)
+{
+    http_conn &conn = m_users[sockfd];
+    util_timer *timer = m_users_timer[sockfd].timer;
+    unsigned int serial = conn.get_serial();
+    bool has_response;
+    {
+        connectionRAII mysqlcon(&conn.mysql, m_connPool);
+        has_response = conn.process();
+    }
+
+    //process内部已关闭连接，只回收本循环的定时器：fd可能已被其他循环复用，不再访问其元素
+    if (conn.get_serial() != serial)
+    {
+        m_timer_lst.del_timer(timer);
+        return;
+    }
+    if (has_response)
+        submit_write(sockfd);
+}
+
+void uring_loop::handle_write(const struct io_uring_cqe &cqe, int sockfd)
+{
+    if (!is_current(cqe.user_data, sockfd))
+        return;
+
+    util_timer *timer = m_users_timer[sockfd].timer;
+    if (cqe.res < 0)
+    {
+        deal_timer(timer, sockfd);
+        return;
+    }
+
+    int ret = m_users[sockfd].written(cqe.res);
+    if (ret > 0)
+    {
+        submit_write(sockfd);
+    }
+    else if (ret < 0)
+    {
+        deal_timer(timer, sockfd);
+    }
+    else if (!m_deferred[sockfd].empty() || m_users[sockfd].has_pending())
+    {
+        //响应写完且保持连接，处理已读入的流水线请求以及写出期间到达的数据
+        string pending;
+        pending.swap(m_deferred[sockfd]);
+        if (!m_users[sockfd].append_read(pending.data(), pending.size()))
+        {
+            deal_timer(timer, sockfd);
+            return;
+        }
+        serve(sockfd);
+    }
+}
+
+void uring_loop::handle(const struct io_uring_cqe &cqe)
+{
+    int op = (int)(cqe.user_data >> 56);
+    int sockfd = (int)(uint32_t)cqe.user_data;
+
+    switch (op)
+    {
+    case OP_ACCEPT:
+        handle_accept(cqe);
+        break;
+    case OP_RECV:
+        handle_recv(cqe, sockfd);
+        break;
+    case OP_WRITE:
+        handle_write(cqe, sockfd);
+        break;
+    case OP_TICK:
+        //每timeslot毫秒检查一次本循环内的非活动连接
+        m_timer_lst.tick();
+        submit_tick();
+        break;
+    case OP_WAKE:
+        if (!m_stop)
+            submit_wake();
+        break;
+    default:
+        break;
+    }
+}
+
+void uring_loop::run()
+{
+    m_ring.prep_accept_multishot(m_listenfd, make_data(OP_ACCEPT, -1));
+    submit_tick();
+    submit_wake();
+
+    while (!m_stop)
+    {
+        //提交上一轮处理中准备的全部请求，同时等待新的完成事件
+        if (m_ring.submit_and_wait(1) < 0)
+        {
+            LOG_ERROR("uring loop %d enter failure:%d", m_id, errno);
+            break;
+        }
+
+        struct io_uring_cqe cqe;
+        while (m_ring.next_cqe(cqe))
+        {
+            handle(cqe);
+        }
+    }
+}
+
+#else
+
+//内核头文件不支持io_uring时只保留接口，supported()返回false使调用者回退到epoll
+uring_loop::uring_loop(int, http_conn *, client_data *, int, int, int) {}
+uring_loop::~uring_loop() {}
+bool uring_loop::supported() { return false; }
+void uring_loop::init(char *, int, int, connection_pool *) {}
+void uring_loop::set_listener(int, bool) {}
+bool uring_loop::start() { return false; }
+void uring_loop::stop() {}
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef URING_LOOP_H
+#define URING_LOOP_H
+
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <vector>
+#include <string>
+
+#include "io_ring.h"
+#include "../timer/lst_timer.h"
+#include "../http/http_conn.h"
+#include "../CGImysql/sql_connection_pool.h"
+
+using namespace std;
+
+//io_uring事件循环：每个线程一个ring，accept、recv、writev都以请求形式批量提交
+//一次io_uring_enter同时完成提交与收割，取代epoll_wait + accept/recv/writev的逐个系统调用
+class uring_loop
+{
+public:
+    static const unsigned RING_ENTRIES = 1024;
+    static const unsigned RECV_BUF_COUNT = 1024;  //须为2的幂
+    static const unsigned RECV_BUF_SIZE = 4096;
+
+    uring_loop(int id, http_conn *users, client_data *users_timer, int max_fd, int idle_timeout, int timeslot);
+    ~uring_loop();
+
+    //内核与编译时的内核头文件都支持本后端时返回true，否则调用者回退到epoll
+    static bool supported();
+
+    void init(char *root, int conn_trigmode, int close_log, connection_pool *connPool);
+    //owned为true时由本循环负责关闭监听socket(SO_REUSEPORT分片)
+    void set_listener(int listenfd, bool owned);
+    bool start();
+    void stop();
+
+#ifdef WEBSERVER_HAVE_IO_URING
+private:
+    enum OP_TYPE
+    {
+        OP_ACCEPT = 1,
+        OP_RECV,
+        OP_WRITE,
+        OP_TICK,
+        OP_WAKE
+    };
+
+    static void *worker(void *arg);
+    void run();
+    void handle(const struct io_uring_cqe &cqe);
+    void handle_accept(const struct io_uring_cqe &cqe);
+    void handle_recv(const struct io_uring_cqe &cqe, int sockfd);
+    void handle_write(const struct io_uring_cqe &cqe, int sockfd);
+    void add_conn(int connfd);
+    void serve(int sockfd);
+    void submit_recv(int sockfd);
+    void submit_write(int sockfd);
+    void submit_tick();
+    void submit_wake();
+    uint64_t make_data(int op, int sockfd) const;
+    bool is_current(uint64_t data, int sockfd) const;
+    void adjust_timer(util_timer *timer);
+    void deal_timer(util_timer *timer, int sockfd);
+    static void conn_timeout(client_data *user_data);
+
+private:
+    int m_id;
+    io_ring m_ring;
+    int m_listenfd;
+    bool m_owns_listener;
+    int m_wakeupfd;
+    uint64_t m_wake_buf;
+    struct __kernel_timespec m_tick;
+    pthread_t m_thread;
+    bool m_started;
+    volatile bool m_stop;
+
+    //本循环拥有的连接切片
+    static http_conn *s_users;  //各循环共享同一数组，供超时回调关闭连接
+    http_conn *m_users;
+    client_data *m_users_timer;
+    int m_max_fd;
+    //写出响应期间收到的后续请求数据，发送完毕后再交给连接
+    vector<string> m_deferred;
+
+    timer_wheel m_timer_lst;
+    int m_idle_timeout;
+
+    char *m_root;
+    int m_CONNTrigmode;
+    int m_close_log;
+    connection_pool *m_connPool;
+#endif
+};
+
+#endif
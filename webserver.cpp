@@ -14,22 +14,39 @@ WebServer::WebServer()
     strcat(m_root, root);
 
     //定时器
-    users_timer = new client_data[MAX_FD];
+    users_timer = new client_data[MAX_FD]();
+
+    m_pool = NULL;
+    m_completions = NULL;
+    m_reactor_num = 0;
+    m_next_reactor = 0;
 }
 
 WebServer::~WebServer()
 {
+    for (size_t i = 0; i < m_reactors.size(); ++i)
+    {
+        delete m_reactors[i];
+    }
+    for (size_t i = 0; i < m_uring_loops.size(); ++i)
+    {
+        delete m_uring_loops[i];
+    }
     close(m_epollfd);
-    close(m_listenfd);
-    close(m_pipefd[1]);
-    close(m_pipefd[0]);
+    if (m_listenfd >= 0)
+        close(m_listenfd);
+    close(m_signalfd);
+    close(m_tickfd);
+    //先停止线程池，工作线程可能仍在访问users
+    delete m_pool;
+    delete m_completions;
     delete[] users;
     delete[] users_timer;
-    delete m_pool;
 }
 
 void WebServer::init(int port, string user, string passWord, string databaseName, int log_write, 
-                     int opt_linger, int trigmode, int sql_num, int thread_num, int close_log, int actor_model)
+                     int opt_linger, int trigmode, int sql_num, int thread_num, int close_log, int actor_model, int reactor_num,
+                     int reuseport, int backlog, int idle_timeout, int max_body_kb, int precompress, int gzip_level, int max_requests, int page_cache_mb)
 {
     m_port = port;
     m_user = user;
@@ -42,6 +59,28 @@ void WebServer::init(int port, string user, string passWord, string databaseName
     m_TRIGMode = trigmode;
     m_close_log = close_log;
     m_actormodel = actor_model;
+    m_reactor_num = reactor_num;
+    m_reuseport = reuseport;
+    m_backlog = backlog;
+    m_idle_timeout = idle_timeout;
+    m_precompress = precompress;
+    m_page_cache_mb = page_cache_mb < 0 ? 0 : page_cache_mb;
+    http_conn::m_max_body = (long)max_body_kb * 1024;
+    http_conn::m_gzip_level = gzip_level < 0 ? 0 : (gzip_level > 9 ? 9 : gzip_level);
+    http_conn::m_max_requests = max_requests;
+    //时间轮的检查开销只与流逝的时间有关，检查周期取超时时间的1/15，限制在[10ms, 1s]
+    m_timeslot = idle_timeout / 15;
+    if (m_timeslot < MIN_TIMESLOT)
+        m_timeslot = MIN_TIMESLOT;
+    if (m_timeslot > MAX_TIMESLOT)
+        m_timeslot = MAX_TIMESLOT;
+
+    //在创建任何线程之前屏蔽SIGTERM、SIGHUP，之后的线程都继承该掩码，信号只经signalfd交给主循环
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
 }
 
 void WebServer::trig_mode()
@@ -94,31 +133,92 @@ void WebServer::sql_pool()
     users->initmysql_result(m_connPool);
     
     //初始化博客处理器
-    http_conn::init_blog_handler(m_connPool);
+    http_conn::init_blog_handler(m_connPool, (size_t)m_page_cache_mb * 1024 * 1024);
 }
 
 void WebServer::thread_pool()
 {
+    //io_uring模式：内核或编译环境不支持时回退到epoll的proactor模式
+    if (2 == m_actormodel)
+    {
+        if (uring_loop::supported())
+            return;
+        LOG_ERROR("%s", "io_uring not available, fall back to epoll");
+        m_actormodel = 0;
+    }
+
+    //多反应堆模式下由各子反应堆线程自行处理请求，不需要线程池
+    if (m_reactor_num > 0)
+        return;
+
     //线程池
     m_pool = new threadpool<http_conn>(m_actormodel, m_connPool, m_thread_num);
+
+    //reactor模式：工作线程完成读写后经eventfd通知主循环，主循环不阻塞等待
+    if (1 == m_actormodel)
+    {
+        m_completions = new completion_queue;
+        m_pool->set_completion_queue(m_completions);
+    }
 }
 
-void WebServer::eventListen()
+void WebServer::sub_reactors()
+{
+    //每个子反应堆一个线程，拥有独立的epoll、定时器以及分配给它的连接
+    for (int i = 0; i < m_reactor_num; ++i)
+    {
+        sub_reactor *reactor = new sub_reactor(i, users, users_timer, MAX_FD, m_idle_timeout, m_timeslot);
+        reactor->init(m_root, m_CONNTrigmode, m_close_log, m_connPool);
+        //每个分片一个SO_REUSEPORT监听socket，各自accept
+        if (1 == m_reuseport)
+            reactor->set_listener(create_listener(true), m_LISTENTrigmode);
+        m_reactors.push_back(reactor);
+    }
+    for (size_t i = 0; i < m_reactors.size(); ++i)
+    {
+        if (!m_reactors[i]->start())
+            exit(1);
+    }
+}
+
+void WebServer::uring_loops()
+{
+    //每个线程一个ring；SO_REUSEPORT分片时各自拥有监听socket，否则共享主线程创建的监听socket
+    int loop_num = m_reactor_num > 0 ? m_reactor_num : 1;
+    for (int i = 0; i < loop_num; ++i)
+    {
+        uring_loop *loop = new uring_loop(i, users, users_timer, MAX_FD, m_idle_timeout, m_timeslot);
+        loop->init(m_root, m_CONNTrigmode, m_close_log, m_connPool);
+        if (m_listenfd < 0)
+            loop->set_listener(create_listener(true), true);
+        else
+            loop->set_listener(m_listenfd, false);
+        m_uring_loops.push_back(loop);
+    }
+    for (size_t i = 0; i < m_uring_loops.size(); ++i)
+    {
+        if (!m_uring_loops[i]->start())
+            exit(1);
+    }
+}
+
+//创建监听socket，reuseport为true时设置SO_REUSEPORT，由内核在多个监听socket间分发新连接
+int WebServer::create_listener(bool reuseport)
 {
     //网络编程基础步骤
-    m_listenfd = socket(PF_INET, SOCK_STREAM, 0);
-    assert(m_listenfd >= 0);
+    int listenfd = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    assert(listenfd >= 0);
 
     //优雅关闭连接
     if (0 == m_OPT_LINGER)
     {
         struct linger tmp = {0, 1};
-        setsockopt(m_listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+        setsockopt(listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
     }
     else if (1 == m_OPT_LINGER)
     {
         struct linger tmp = {1, 1};
-        setsockopt(m_listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+        setsockopt(listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
     }
 
     int ret = 0;
@@ -129,61 +229,111 @@ void WebServer::eventListen()
     address.sin_port = htons(m_port);
 
     int flag = 1;
-    setsockopt(m_listenfd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
-    ret = bind(m_listenfd, (struct sockaddr *)&address, sizeof(address));
+    setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+    if (reuseport)
+    {
+        ret = setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag));
+        assert(ret >= 0);
+    }
+    ret = bind(listenfd, (struct sockaddr *)&address, sizeof(address));
     assert(ret >= 0);
-    ret = listen(m_listenfd, 5);
+    ret = listen(listenfd, m_backlog);
     assert(ret >= 0);
 
-    utils.init(TIMESLOT);
+    return listenfd;
+}
+
+void WebServer::eventListen()
+{
+    //SO_REUSEPORT分片模式下由各子反应堆/io_uring循环自己监听和accept，主线程不再持有监听socket
+    bool uring = 2 == m_actormodel;
+    bool sharded = (m_reactor_num > 0 || uring) && 1 == m_reuseport;
+    m_listenfd = sharded ? -1 : create_listener(false);
+
+    utils.init(m_timeslot);
 
     //epoll创建内核事件表
     epoll_event events[MAX_EVENT_NUMBER];
     m_epollfd = epoll_create(5);
     assert(m_epollfd != -1);
 
-    utils.addfd(m_epollfd, m_listenfd, false, m_LISTENTrigmode);
+    //io_uring模式下监听socket由各循环的multishot accept处理，不注册到epoll
+    if (m_listenfd >= 0 && !uring)
+        utils.addfd(m_epollfd, m_listenfd, false, m_LISTENTrigmode);
     http_conn::m_epollfd = m_epollfd;
 
-    ret = socketpair(PF_UNIX, SOCK_STREAM, 0, m_pipefd);
-    assert(ret != -1);
-    utils.setnonblocking(m_pipefd[1]);
-    utils.addfd(m_epollfd, m_pipefd[0], false, 0);
+    //信号与定时都以fd的形式注册到epoll，epoll_wait不再被信号打断
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGHUP);
+    m_signalfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    assert(m_signalfd != -1);
+    utils.addfd(m_epollfd, m_signalfd, false, 0);
+
+    m_tickfd = Utils::create_tick_fd(m_timeslot);
+    utils.addfd(m_epollfd, m_tickfd, false, 0);
+
+    if (m_completions)
+        utils.addfd(m_epollfd, m_completions->get_fd(), false, 0);
+
+    //静态文件缓存通过inotify得知根目录下的文件变化，inotify不可用时退化为逐次打开
+    int cachefd = file_cache::get_instance()->init(m_root);
+    if (cachefd >= 0)
+        utils.addfd(m_epollfd, cachefd, false, 0);
+    else
+        LOG_ERROR("%s", "inotify init failure, static file cache disabled");
+    if (m_precompress)
+        file_cache::get_instance()->enable_precompress();
 
     utils.addsig(SIGPIPE, SIG_IGN);
-    utils.addsig(SIGALRM, utils.sig_handler, false);
-    utils.addsig(SIGTERM, utils.sig_handler, false);
-
-    alarm(TIMESLOT);
 
-    //工具类,信号和描述符基础操作
-    Utils::u_pipefd = m_pipefd;
+    //工具类,描述符基础操作
     Utils::u_epollfd = m_epollfd;
+    Utils::u_users = users;
+
+    if (uring)
+        uring_loops();
+    else if (m_reactor_num > 0)
+        sub_reactors();
 }
 
 void WebServer::timer(int connfd, struct sockaddr_in client_address)
 {
-    users[connfd].init(connfd, client_address, m_root, m_CONNTrigmode, m_close_log, m_user, m_passWord, m_databaseName);
+    //多反应堆模式：主线程只负责accept，按轮询将连接交给子反应堆
+    if (m_reactor_num > 0)
+    {
+        m_reactors[m_next_reactor]->dispatch(connfd, client_address);
+        m_next_reactor = (m_next_reactor + 1) % m_reactor_num;
+        return;
+    }
+
+    users[connfd].init(connfd, client_address, m_root, m_CONNTrigmode, m_close_log);
+
+    //工作线程关闭的上一个连接的完成通知尚未处理时，fd已被复用，其定时器在此回收
+    if (users_timer[connfd].timer)
+    {
+        utils.m_timer_lst.del_timer(users_timer[connfd].timer);
+        users_timer[connfd].timer = NULL;
+    }
 
     //初始化client_data数据
     //创建定时器，设置回调函数和超时时间，绑定用户数据，将定时器添加到链表中
     users_timer[connfd].address = client_address;
     users_timer[connfd].sockfd = connfd;
-    util_timer *timer = new util_timer;
+    util_timer *timer = utils.m_timer_lst.alloc_timer();
     timer->user_data = &users_timer[connfd];
     timer->cb_func = cb_func;
-    time_t cur = time(NULL);
-    timer->expire = cur + 3 * TIMESLOT;
+    timer->expire = timer_now_ms() + m_idle_timeout;
     users_timer[connfd].timer = timer;
     utils.m_timer_lst.add_timer(timer);
 }
 
-//若有数据传输，则将定时器往后延迟3个单位
-//并对新的定时器在链表上的位置进行调整
+//若有数据传输，则将定时器往后延迟一个超时时间
+//并对新的定时器在时间轮上的位置进行调整
 void WebServer::adjust_timer(util_timer *timer)
 {
-    time_t cur = time(NULL);
-    timer->expire = cur + 3 * TIMESLOT;
+    timer->expire = timer_now_ms() + m_idle_timeout;
     utils.m_timer_lst.adjust_timer(timer);
 
     LOG_INFO("%s", "adjust timer once");
@@ -203,78 +353,58 @@ void WebServer::deal_timer(util_timer *timer, int sockfd)
 bool WebServer::dealclientdata()
 {
     struct sockaddr_in client_address;
-    socklen_t client_addrlength = sizeof(client_address);
-    if (0 == m_LISTENTrigmode)
+    socklen_t client_addrlength;
+    int accepted = 0;
+
+    //LT模式每次最多取MAX_ACCEPT_BATCH个连接，剩余的留给下一轮epoll_wait；ET模式必须取到EAGAIN为止
+    while (1 == m_LISTENTrigmode || accepted < MAX_ACCEPT_BATCH)
     {
-        int connfd = accept(m_listenfd, (struct sockaddr *)&client_address, &client_addrlength);
+        client_addrlength = sizeof(client_address);
+        int connfd = accept4(m_listenfd, (struct sockaddr *)&client_address, &client_addrlength,
+                             SOCK_NONBLOCK | SOCK_CLOEXEC);
         if (connfd < 0)
         {
-            LOG_ERROR("%s:errno is:%d", "accept error", errno);
-            return false;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                LOG_ERROR("%s:errno is:%d", "accept error", errno);
+            break;
         }
-        if (http_conn::m_user_count >= MAX_FD)
+        ++accepted;
+        if (http_conn::m_user_count >= MAX_FD || connfd >= MAX_FD)
         {
             utils.show_error(connfd, "Internal server busy");
             LOG_ERROR("%s", "Internal server busy");
-            return false;
+            continue;
         }
         timer(connfd, client_address);
     }
-
-    else
-    {
-        while (1)
-        {
-            int connfd = accept(m_listenfd, (struct sockaddr *)&client_address, &client_addrlength);
-            if (connfd < 0)
-            {
-                LOG_ERROR("%s:errno is:%d", "accept error", errno);
-                break;
-            }
-            if (http_conn::m_user_count >= MAX_FD)
-            {
-                utils.show_error(connfd, "Internal server busy");
-                LOG_ERROR("%s", "Internal server busy");
-                break;
-            }
-            timer(connfd, client_address);
-        }
-        return false;
-    }
-    return true;
+    return accepted > 0;
 }
 
-bool WebServer::dealwithsignal(bool &timeout, bool &stop_server)
+bool WebServer::dealwithsignal(bool &stop_server)
 {
-    int ret = 0;
-    int sig;
-    char signals[1024];
-    ret = recv(m_pipefd[0], signals, sizeof(signals), 0);
-    if (ret == -1)
+    struct signalfd_siginfo info[16];
+    ssize_t ret = read(m_signalfd, info, sizeof(info));
+    if (ret <= 0)
     {
         return false;
     }
-    else if (ret == 0)
+    for (size_t i = 0; i < ret / sizeof(info[0]); ++i)
     {
-        return false;
-    }
-    else
-    {
-        for (int i = 0; i < ret; ++i)
+        switch (info[i].ssi_signo)
         {
-            switch (signals[i])
-            {
-            case SIGALRM:
-            {
-                timeout = true;
-                break;
-            }
-            case SIGTERM:
-            {
-                stop_server = true;
-                break;
-            }
-            }
+        case SIGTERM:
+        {
+            stop_server = true;
+            break;
+        }
+        case SIGHUP:
+        {
+            //SIGHUP：把异步日志缓冲区刷到磁盘
+            LOG_INFO("%s", "SIGHUP received, flush log");
+            if (0 == m_close_log)
+                Log::get_instance()->flush();
+            break;
+        }
         }
     }
     return true;
@@ -287,27 +417,13 @@ void WebServer::dealwithread(int sockfd)
     //reactor
     if (1 == m_actormodel)
     {
-        if (timer)
-        {
-            adjust_timer(timer);
-        }
+        //同一批事件中连接可能已被完成通知关闭，fd随时会被复用
+        if (!timer)
+            return;
+        adjust_timer(timer);
 
-        //若监测到读事件，将该事件放入请求队列
+        //若监测到读事件，将该事件放入请求队列，结果由完成通道异步返回
         m_pool->append(users + sockfd, 0);
-
-        while (true)
-        {
-            if (1 == users[sockfd].improv)
-            {
-                if (1 == users[sockfd].timer_flag)
-                {
-                    deal_timer(timer, sockfd);
-                    users[sockfd].timer_flag = 0;
-                }
-                users[sockfd].improv = 0;
-                break;
-            }
-        }
     }
     else
     {
@@ -337,26 +453,11 @@ void WebServer::dealwithwrite(int sockfd)
     //reactor
     if (1 == m_actormodel)
     {
-        if (timer)
-        {
-            adjust_timer(timer);
-        }
+        if (!timer)
+            return;
+        adjust_timer(timer);
 
         m_pool->append(users + sockfd, 1);
-
-        while (true)
-        {
-            if (1 == users[sockfd].improv)
-            {
-                if (1 == users[sockfd].timer_flag)
-                {
-                    deal_timer(timer, sockfd);
-                    users[sockfd].timer_flag = 0;
-                }
-                users[sockfd].improv = 0;
-                break;
-            }
-        }
     }
     else
     {
@@ -365,6 +466,10 @@ void WebServer::dealwithwrite(int sockfd)
         {
             LOG_INFO("send data to the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
 
+            //读缓冲区中已有下一个流水线请求，直接交给工作线程处理
+            if (users[sockfd].has_pending())
+                m_pool->append_p(users + sockfd);
+
             if (timer)
             {
                 adjust_timer(timer);
@@ -377,6 +482,40 @@ void WebServer::dealwithwrite(int sockfd)
     }
 }
 
+//处理reactor模式下工作线程投递的完成通知
+void WebServer::dealwithcompletions()
+{
+    vector<completion> done;
+    m_completions->drain(done);
+
+    for (size_t i = 0; i < done.size(); ++i)
+    {
+        int sockfd = done[i].sockfd;
+        //工作线程关闭连接时序号加一；fd已被新连接复用则通知已过期
+        unsigned int serial = done[i].serial + (1 == done[i].closed ? 1 : 0);
+        if (sockfd < 0 || users[sockfd].get_serial() != serial)
+            continue;
+
+        users[sockfd].improv = 0;
+        util_timer *timer = users_timer[sockfd].timer;
+        //连接已被定时器或对端关闭
+        if (!timer)
+            continue;
+
+        if (1 == done[i].closed)
+        {
+            //工作线程已关闭连接，只回收定时器
+            utils.m_timer_lst.del_timer(timer);
+            users_timer[sockfd].timer = NULL;
+        }
+        else if (1 == done[i].close_conn)
+        {
+            deal_timer(timer, sockfd);
+            users[sockfd].timer_flag = 0;
+        }
+    }
+}
+
 void WebServer::eventLoop()
 {
     bool timeout = false;
@@ -402,18 +541,36 @@ void WebServer::eventLoop()
                 if (false == flag)
                     continue;
             }
+            //处理工作线程的完成通知
+            else if (m_completions && sockfd == m_completions->get_fd())
+            {
+                dealwithcompletions();
+            }
+            //静态文件变化，使缓存失效
+            else if (sockfd == file_cache::get_instance()->get_fd())
+            {
+                file_cache::get_instance()->process_events();
+            }
             else if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
             {
                 //服务器端关闭连接，移除对应的定时器
+                //同一批事件中连接可能已被完成通知关闭
                 util_timer *timer = users_timer[sockfd].timer;
-                deal_timer(timer, sockfd);
+                if (timer)
+                    deal_timer(timer, sockfd);
             }
             //处理信号
-            else if ((sockfd == m_pipefd[0]) && (events[i].events & EPOLLIN))
+            else if (sockfd == m_signalfd)
             {
-                bool flag = dealwithsignal(timeout, stop_server);
+                bool flag = dealwithsignal(stop_server);
                 if (false == flag)
-                    LOG_ERROR("%s", "dealclientdata failure");
+                    LOG_ERROR("%s", "dealwithsignal failure");
+            }
+            //定时器到期
+            else if (sockfd == m_tickfd)
+            {
+                Utils::drain_fd(m_tickfd);
+                timeout = true;
             }
             //处理客户连接上接收到的数据
             else if (events[i].events & EPOLLIN)
@@ -11,13 +11,20 @@
 #include <stdlib.h>
 #include <cassert>
 #include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <signal.h>
+#include <vector>
 
 #include "./threadpool/threadpool.h"
 #include "./http/http_conn.h"
+#include "./reactor/sub_reactor.h"
+#include "./uring/uring_loop.h"
 
 const int MAX_FD = 65536;           //最大文件描述符
 const int MAX_EVENT_NUMBER = 10000; //最大事件数
-const int TIMESLOT = 5;             //最小超时单位
+const int MIN_TIMESLOT = 10;        //定时器检查周期的上下限(毫秒)
+const int MAX_TIMESLOT = 1000;
+const int MAX_ACCEPT_BATCH = 64;    //LT模式下单次事件最多accept的连接数
 
 // 前置声明测试访问器类
 class WebServerTestAccessor;
@@ -31,21 +38,26 @@ public:
 
     void init(int port , string user, string passWord, string databaseName,
               int log_write , int opt_linger, int trigmode, int sql_num,
-              int thread_num, int close_log, int actor_model);
+              int thread_num, int close_log, int actor_model, int reactor_num,
+              int reuseport, int backlog, int idle_timeout, int max_body_kb, int precompress, int gzip_level, int max_requests, int page_cache_mb);
 
     void thread_pool();
     void sql_pool();
     void log_write();
     void trig_mode();
+    int create_listener(bool reuseport);
     void eventListen();
+    void sub_reactors();
+    void uring_loops();
     void eventLoop();
     void timer(int connfd, struct sockaddr_in client_address);
     void adjust_timer(util_timer *timer);
     void deal_timer(util_timer *timer, int sockfd);
     bool dealclientdata();
-    bool dealwithsignal(bool& timeout, bool& stop_server);
+    bool dealwithsignal(bool& stop_server);
     void dealwithread(int sockfd);
     void dealwithwrite(int sockfd);
+    void dealwithcompletions();
 
 public:
     //基础
@@ -55,7 +67,8 @@ public:
     int m_close_log;
     int m_actormodel;
 
-    int m_pipefd[2];
+    int m_signalfd;     //SIGTERM、SIGHUP经signalfd交给主循环
+    int m_tickfd;       //驱动定时器的timerfd
     int m_epollfd;
     http_conn *users;
 
@@ -69,6 +82,19 @@ public:
     //线程池相关
     threadpool<http_conn> *m_pool;
     int m_thread_num;
+    completion_queue *m_completions;  //reactor模式下工作线程的完成通道
+
+    //多反应堆相关，m_reactor_num为0时使用单epoll + 线程池
+    int m_reactor_num;
+    vector<sub_reactor *> m_reactors;
+    int m_next_reactor;
+
+    //io_uring模式(-a 2)下的事件循环，数量同子反应堆数量，至少一个
+    vector<uring_loop *> m_uring_loops;
+    int m_reuseport;    //是否为每个子反应堆创建SO_REUSEPORT监听socket
+    int m_backlog;      //listen队列长度
+    int m_precompress;  //是否预压缩静态文本资源
+    int m_page_cache_mb; //博客页面缓存大小(MB)
 
     //epoll_event相关
     epoll_event events[MAX_EVENT_NUMBER];
@@ -80,6 +106,8 @@ public:
     int m_CONNTrigmode;
 
     //定时器相关
+    int m_idle_timeout; //非活动连接超时时间(毫秒)
+    int m_timeslot;     //定时器检查周期(毫秒)
     client_data *users_timer;
     Utils utils;
 };